@@ -0,0 +1,241 @@
+/*
+ * Wakeup latency of the HAL threads under CPU load. Busy threads keep
+ * every CPU occupied while frames are injected at a fixed interval on the
+ * loopback backend; the time from injection to the framework callback
+ * covers a wakeup of the I/O thread and of the dispatcher. The run is
+ * repeated for each scheduling setting (ro.hdmi.cec.sched.*, cpus.*,
+ * mlock, see jni/cec_sched.h). SCHED_FIFO and negative nice levels need
+ * CAP_SYS_NICE; the threads line shows whether a setting took effect.
+ *
+ * usage: cec_jitter_bench [-l load_threads] [-n frames] [-i interval_us]
+ */
+
+#include <hardware/hdmi_cec.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cec_loopback.h"
+#include "sunxi_cec.h"
+
+extern struct hw_module_t HAL_MODULE_INFO_SYM;
+
+struct setting {
+    const char *name;
+    const char *sched;      /* for all three threads, or NULL */
+    int pin;                /* pin the I/O and dispatch threads to the last CPU */
+    int mlock;
+};
+
+static const struct setting settings[] = {
+    {"default", NULL, 0, 0},
+    {"nice:-10", "nice:-10", 0, 0},
+    {"pinned", NULL, 1, 0},
+    {"fifo:50", "fifo:50", 0, 0},
+    {"fifo:50 pinned mlock", "fifo:50", 1, 1},
+};
+
+static const char *threads[] = {"io", "tx", "dispatch"};
+
+static atomic_int load_running;
+static atomic_ullong inject_ns;
+static uint64_t *samples;
+static atomic_int received;
+static sem_t delivered;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void callback(const hdmi_event_t *event, void *arg) {
+    if (event->type != HDMI_EVENT_CEC_MESSAGE) {
+        return;
+    }
+    uint64_t latency = now_ns() - atomic_load(&inject_ns);
+    samples[atomic_fetch_add(&received, 1)] = latency;
+    sem_post(&delivered);
+}
+
+// Spins on a private buffer so the load also competes for cache.
+static void *load_thread(void *arg) {
+    size_t size = 256 * 1024;
+    unsigned char *buffer = calloc(1, size);
+    unsigned int i = 0;
+    while (atomic_load_explicit(&load_running, memory_order_relaxed)) {
+        buffer[(i += 4099) % size]++;
+    }
+    free(buffer);
+    return NULL;
+}
+
+static void set_property(const char *name, const char *thread, const char *value) {
+    char key[64];
+    snprintf(key, sizeof(key), thread ? "RO_HDMI_CEC_%s_%s" : "RO_HDMI_CEC_%s", name, thread);
+    for (char *c = key; *c; c++) {
+        if (*c >= 'a' && *c <= 'z') {
+            *c -= 'a' - 'A';
+        }
+    }
+    if (value) {
+        setenv(key, value, 1);
+    } else {
+        unsetenv(key);
+    }
+}
+
+static void apply_setting(const struct setting *setting) {
+    char cpus[32];
+    snprintf(cpus, sizeof(cpus), "%#lx", 1UL << (sysconf(_SC_NPROCESSORS_ONLN) - 1));
+    for (int i = 0; i < 3; i++) {
+        set_property("sched", threads[i], setting->sched);
+        set_property("cpus", threads[i], setting->pin && i != 1 ? cpus : NULL);
+    }
+    set_property("mlock", NULL, setting->mlock ? "1" : NULL);
+}
+
+static void print_threads(hdmi_cec_device_t *dev) {
+    FILE *dump = tmpfile();
+    if (!dump) {
+        return;
+    }
+    fflush(stdout);
+    sunxi_cec_dump(dev, fileno(dump));
+    rewind(dump);
+    char line[512];
+    while (fgets(line, sizeof(line), dump)) {
+        if (strncmp(line, "threads: ", 9) == 0) {
+            printf("  %s", line);
+        }
+    }
+    fclose(dump);
+}
+
+static void run(const struct setting *setting, int frames, int interval_us) {
+    apply_setting(setting);
+
+    hdmi_cec_device_t *dev;
+    if (hdmi_cec_open(&HAL_MODULE_INFO_SYM, &dev) != 0) {
+        fprintf(stderr, "cannot open the HAL\n");
+        exit(1);
+    }
+    dev->set_option(dev, HDMI_OPTION_ENABLE_CEC, 1);
+    sunxi_cec_wait_ready(dev, 1000);
+    dev->add_logical_address(dev, CEC_ADDR_PLAYBACK_1);
+    dev->register_event_callback(dev, callback, NULL);
+    struct cec_backend *backend = sunxi_cec_get_backend(dev);
+
+    while (sem_trywait(&delivered) == 0) {
+    }
+    atomic_store(&received, 0);
+    int lost = 0;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (int i = 0; i < frames; i++) {
+        next.tv_nsec += interval_us * 1000L;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR) {
+        }
+
+        unsigned char frame[] = {(CEC_ADDR_TV << 4) | CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_VENDOR_COMMAND, i};
+        atomic_store(&inject_ns, now_ns());
+        cec_loopback_inject_frame(backend, frame, sizeof(frame));
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        while (sem_timedwait(&delivered, &deadline) < 0) {
+            if (errno == ETIMEDOUT) {
+                lost++;
+                break;
+            }
+        }
+    }
+
+    int count = atomic_load(&received);
+    if (count == 0) {
+        printf("%-22s no frames delivered\n", setting->name);
+    } else {
+        qsort(samples, count, sizeof(*samples), compare_u64);
+        int over_1ms = 0, over_10ms = 0;
+        for (int i = 0; i < count; i++) {
+            over_1ms += samples[i] > 1000000;
+            over_10ms += samples[i] > 10000000;
+        }
+        printf("%-22s %7d %8.1f %8.1f %8.1f %9.1f %7d %7d %5d\n", setting->name, count,
+               samples[count / 2] / 1e3, samples[count * 99 / 100] / 1e3, samples[count * 999 / 1000] / 1e3,
+               samples[count - 1] / 1e3, over_1ms, over_10ms, lost);
+    }
+    print_threads(dev);
+    hdmi_cec_close(dev);
+}
+
+int main(int argc, char **argv) {
+    int load = sysconf(_SC_NPROCESSORS_ONLN) * 2;
+    int frames = 2000;
+    int interval_us = 1000;
+    int opt;
+    while ((opt = getopt(argc, argv, "l:n:i:")) != -1) {
+        switch (opt) {
+            case 'l':
+                load = atoi(optarg);
+                break;
+            case 'n':
+                frames = atoi(optarg);
+                break;
+            case 'i':
+                interval_us = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-l load_threads] [-n frames] [-i interval_us]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (frames < 1 || interval_us < 1 || load < 0) {
+        fprintf(stderr, "usage: %s [-l load_threads] [-n frames] [-i interval_us]\n", argv[0]);
+        return 2;
+    }
+
+    samples = calloc(frames, sizeof(*samples));
+    sem_init(&delivered, 0, 0);
+    sunxi_cec_set_backend("loopback");
+
+    atomic_store(&load_running, 1);
+    pthread_t *loaders = calloc(load ? load : 1, sizeof(*loaders));
+    for (int i = 0; i < load; i++) {
+        pthread_create(&loaders[i], NULL, load_thread, NULL);
+    }
+
+    printf("%d load threads on %ld CPUs, %d frames every %d us\n", load, sysconf(_SC_NPROCESSORS_ONLN),
+           frames, interval_us);
+    printf("%-22s %7s %8s %8s %8s %9s %7s %7s %5s\n",
+           "setting", "frames", "p50 us", "p99 us", "p99.9 us", "max us", ">1ms", ">10ms", "lost");
+    for (size_t i = 0; i < sizeof(settings) / sizeof(settings[0]); i++) {
+        run(&settings[i], frames, interval_us);
+    }
+
+    atomic_store(&load_running, 0);
+    for (int i = 0; i < load; i++) {
+        pthread_join(loaders[i], NULL);
+    }
+    free(loaders);
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,186 @@
+/*
+ * Measures how long a remote control key takes from the CEC frame arriving
+ * to the key event, through the uinput fast path and through the framework
+ * callback, plus the pacing of HAL-side repeats and the release timeout.
+ * Runs against the loopback backend with a FIFO standing in for uinput.
+ *
+ * usage: cec_key_bench [presses]
+ */
+
+#include <hardware/hdmi_cec.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <math.h>
+#include <poll.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cec_loopback.h"
+#include "sunxi_cec.h"
+
+extern struct hw_module_t HAL_MODULE_INFO_SYM;
+
+#define TV_HOLD_RESEND_MS 450
+#define HOLD_MS 2000
+
+static sem_t callback_done;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void callback(const hdmi_event_t *event, void *arg) {
+    if (event->type == HDMI_EVENT_CEC_MESSAGE && event->cec.length >= 1 &&
+        event->cec.body[0] == CEC_MESSAGE_USER_CONTROL_PRESSED) {
+        sem_post(&callback_done);
+    }
+}
+
+static void inject_key(struct cec_backend *backend, int opcode, int ui_command) {
+    unsigned char frame[] = {(CEC_ADDR_TV << 4) | CEC_ADDR_PLAYBACK_1, opcode, ui_command};
+    cec_loopback_inject_frame(backend, frame, opcode == CEC_MESSAGE_USER_CONTROL_PRESSED ? 3 : 2);
+}
+
+/* Waits for the next key event; returns its value or -1 on timeout. */
+static int read_key(int fd, int timeout_ms) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return -1;
+    }
+    struct input_event events[2];
+    if (read(fd, events, sizeof(events)) != sizeof(events)) {
+        return -1;
+    }
+    return events[0].value;
+}
+
+static void report(const char *name, uint64_t *samples, int count) {
+    if (!count) {
+        printf("%-24s %8s\n", name, "-");
+        return;
+    }
+    qsort(samples, count, sizeof(*samples), compare_u64);
+    printf("%-24s %8d %10.1f %10.1f %10.1f\n", name, count,
+           samples[count / 2] / 1e3, samples[count * 99 / 100] / 1e3, samples[count - 1] / 1e3);
+}
+
+int main(int argc, char **argv) {
+    int presses = argc > 1 ? atoi(argv[1]) : 1000;
+
+    char fifo[64];
+    snprintf(fifo, sizeof(fifo), "/tmp/cec_key_bench.%d", getpid());
+    if (mkfifo(fifo, 0600) < 0) {
+        fprintf(stderr, "mkfifo %s: %s\n", fifo, strerror(errno));
+        return 1;
+    }
+    // read-write so that the HAL's non-blocking open finds a reader
+    int input_fd = open(fifo, O_RDWR | O_CLOEXEC);
+    setenv("RO_HDMI_CEC_UINPUT_PATH", fifo, 1);
+    sem_init(&callback_done, 0, 0);
+
+    hdmi_cec_device_t *dev;
+    sunxi_cec_set_backend("loopback");
+    if (input_fd < 0 || hdmi_cec_open(&HAL_MODULE_INFO_SYM, &dev) != 0) {
+        fprintf(stderr, "unable to open HAL\n");
+        unlink(fifo);
+        return 1;
+    }
+    struct cec_backend *backend = sunxi_cec_get_backend(dev);
+    dev->register_event_callback(dev, callback, NULL);
+    dev->set_option(dev, HDMI_OPTION_ENABLE_CEC, 1);
+    dev->add_logical_address(dev, CEC_ADDR_PLAYBACK_1);
+
+    uint64_t *fast = calloc(presses, sizeof(uint64_t));
+    uint64_t *framework = calloc(presses, sizeof(uint64_t));
+    int fast_count = 0, framework_count = 0;
+
+    // frame in -> uinput key down
+    sunxi_cec_set_key_fast_path(dev, 1);
+    for (int i = 0; i < presses; i++) {
+        uint64_t start = now_ns();
+        inject_key(backend, CEC_MESSAGE_USER_CONTROL_PRESSED, 0x01);
+        if (read_key(input_fd, 1000) == 1) {
+            fast[fast_count++] = now_ns() - start;
+        }
+        inject_key(backend, CEC_MESSAGE_USER_CONTROL_RELEASED, 0);
+        read_key(input_fd, 1000);
+    }
+
+    // frame in -> framework callback
+    sunxi_cec_set_key_fast_path(dev, 0);
+    for (int i = 0; i < presses; i++) {
+        uint64_t start = now_ns();
+        inject_key(backend, CEC_MESSAGE_USER_CONTROL_PRESSED, 0x01);
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec++;
+        if (sem_timedwait(&callback_done, &deadline) == 0) {
+            framework[framework_count++] = now_ns() - start;
+        }
+        inject_key(backend, CEC_MESSAGE_USER_CONTROL_RELEASED, 0);
+    }
+
+    // a held key as TVs send it: PRESSED again every 450 ms, then nothing
+    sunxi_cec_set_key_fast_path(dev, 1);
+    uint64_t intervals[HOLD_MS / 10];
+    int repeats = 0;
+    uint64_t hold_start = now_ns(), last_event = 0, last_pressed = hold_start;
+    inject_key(backend, CEC_MESSAGE_USER_CONTROL_PRESSED, 0x02);
+    read_key(input_fd, 1000);
+    while (now_ns() - hold_start < HOLD_MS * 1000000ULL) {
+        if (now_ns() - last_pressed >= TV_HOLD_RESEND_MS * 1000000ULL) {
+            inject_key(backend, CEC_MESSAGE_USER_CONTROL_PRESSED, 0x02);
+            last_pressed = now_ns();
+        }
+        if (read_key(input_fd, 10) == 2) {
+            uint64_t now = now_ns();
+            if (last_event && repeats < (int) (sizeof(intervals) / sizeof(intervals[0]))) {
+                intervals[repeats++] = now - last_event;
+            }
+            last_event = now;
+        }
+    }
+    int value;
+    while ((value = read_key(input_fd, 1000)) == 2) {
+    }
+    uint64_t release_ms = (now_ns() - last_pressed) / 1000000;
+
+    double mean = 0, variance = 0;
+    for (int i = 0; i < repeats; i++) {
+        mean += intervals[i] / 1e6;
+    }
+    mean = repeats ? mean / repeats : 0;
+    for (int i = 0; i < repeats; i++) {
+        variance += (intervals[i] / 1e6 - mean) * (intervals[i] / 1e6 - mean);
+    }
+
+    printf("%-24s %8s %10s %10s %10s\n", "path", "presses", "p50 (us)", "p99 (us)", "max (us)");
+    report("uinput fast path", fast, fast_count);
+    report("framework callback", framework, framework_count);
+    printf("\nrepeat: %d intervals, mean %.2f ms, stddev %.3f ms\n",
+           repeats, mean, repeats ? sqrt(variance / repeats) : 0);
+    printf("release: key up %s %llu ms after the last PRESSED (timeout 550 ms)\n",
+           value == 0 ? "came" : "missing,", (unsigned long long) release_ms);
+
+    hdmi_cec_close(dev);
+    close(input_fd);
+    unlink(fifo);
+    free(fast);
+    free(framework);
+    return 0;
+}
@@ -0,0 +1,313 @@
+/*
+ * Microbenchmarks of the HAL entry points, called through the
+ * hdmi_cec_device_t table against the loopback backend: send_message,
+ * sunxi_cec_submit, register_event_callback, get_physical_address,
+ * add/clear_logical_address, and received frames through the read path
+ * up to the callback. For each it reports calls per second, per-call
+ * latency percentiles, and per call the heap allocations, I/O syscalls
+ * and context switches of the whole process (HAL threads included).
+ *
+ * Allocations are counted by wrapping malloc and friends, syscalls by
+ * wrapping the libc calls the HAL makes (futex waits inside pthreads are
+ * not seen; context switches cover them).
+ *
+ * usage: cec_micro_bench [iterations]
+ */
+
+#define _GNU_SOURCE
+
+#include <hardware/hdmi_cec.h>
+
+#include <errno.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cec_loopback.h"
+#include "sunxi_cec.h"
+
+extern struct hw_module_t HAL_MODULE_INFO_SYM;
+
+static atomic_ulong allocations;
+static atomic_ulong syscalls;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+    atomic_fetch_add_explicit(&syscalls, 1, memory_order_relaxed);
+    return syscall(SYS_read, fd, buf, count);
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    atomic_fetch_add_explicit(&syscalls, 1, memory_order_relaxed);
+    return syscall(SYS_write, fd, buf, count);
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int count) {
+    atomic_fetch_add_explicit(&syscalls, 1, memory_order_relaxed);
+    return syscall(SYS_readv, fd, iov, count);
+}
+
+int ioctl(int fd, unsigned long request, ...) {
+    va_list args;
+    va_start(args, request);
+    void *arg = va_arg(args, void *);
+    va_end(args);
+    atomic_fetch_add_explicit(&syscalls, 1, memory_order_relaxed);
+    return syscall(SYS_ioctl, fd, request, arg);
+}
+
+int epoll_wait(int epfd, struct epoll_event *events, int max, int timeout) {
+    atomic_fetch_add_explicit(&syscalls, 1, memory_order_relaxed);
+    return syscall(SYS_epoll_pwait, epfd, events, max, timeout, NULL, 8);
+}
+
+int timerfd_settime(int fd, int flags, const struct itimerspec *value, struct itimerspec *old) {
+    atomic_fetch_add_explicit(&syscalls, 1, memory_order_relaxed);
+    return syscall(SYS_timerfd_settime, fd, flags, value, old);
+}
+
+// Frames kept in flight by the pipelined runs, well inside the TX queue
+// and the dispatch rings so nothing is dropped.
+#define WINDOW 16
+
+static sem_t delivered;
+static atomic_uint received;
+static atomic_uint tx_completed;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void callback(const hdmi_event_t *event, void *arg) {
+    if (event->type == HDMI_EVENT_CEC_MESSAGE) {
+        atomic_fetch_add_explicit(&received, 1, memory_order_release);
+        sem_post(&delivered);
+    } else if (event->type == SUNXI_CEC_EVENT_TX_STATUS) {
+        atomic_fetch_add_explicit(&tx_completed, 1, memory_order_release);
+    }
+}
+
+static void wait_window(atomic_uint *completed, unsigned int base, unsigned int issued, unsigned int window) {
+    while (issued - (atomic_load_explicit(completed, memory_order_acquire) - base) > window) {
+        sched_yield();
+    }
+}
+
+struct run {
+    uint64_t start_ns;
+    unsigned long allocations;
+    unsigned long syscalls;
+    long context_switches;
+};
+
+static long context_switches(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+static void run_begin(struct run *run) {
+    run->allocations = atomic_load(&allocations);
+    run->syscalls = atomic_load(&syscalls);
+    run->context_switches = context_switches();
+    run->start_ns = now_ns();
+}
+
+static void run_end(struct run *run, const char *name, uint64_t *samples, int count) {
+    uint64_t elapsed = now_ns() - run->start_ns;
+    double allocs = (double) (atomic_load(&allocations) - run->allocations) / count;
+    double calls = (double) (atomic_load(&syscalls) - run->syscalls) / count;
+    double switches = (double) (context_switches() - run->context_switches) / count;
+
+    qsort(samples, count, sizeof(*samples), compare_u64);
+    printf("%-26s %8d %10.0f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f %8.2f\n",
+           name, count, count / (elapsed / 1e9),
+           samples[count / 2] / 1e3, samples[count * 9 / 10] / 1e3, samples[count * 99 / 100] / 1e3,
+           samples[count - 1] / 1e3, allocs, calls, switches);
+}
+
+static void bench_send_message(hdmi_cec_device_t *dev, uint64_t *samples, int count) {
+    cec_message_t msg;
+    msg.initiator = CEC_ADDR_PLAYBACK_1;
+    msg.destination = CEC_ADDR_TV;
+    msg.length = 2;
+    msg.body[0] = CEC_MESSAGE_VENDOR_COMMAND;
+
+    struct run run;
+    run_begin(&run);
+    for (int i = 0; i < count; i++) {
+        msg.body[1] = i;
+        uint64_t start = now_ns();
+        dev->send_message(dev, &msg);
+        samples[i] = now_ns() - start;
+    }
+    run_end(&run, "send_message", samples, count);
+}
+
+static void bench_submit(hdmi_cec_device_t *dev, uint64_t *samples, int count) {
+    cec_message_t msg;
+    msg.initiator = CEC_ADDR_PLAYBACK_1;
+    msg.destination = CEC_ADDR_TV;
+    msg.length = 2;
+    msg.body[0] = CEC_MESSAGE_VENDOR_COMMAND;
+
+    unsigned int base = atomic_load(&tx_completed);
+    struct run run;
+    run_begin(&run);
+    for (int i = 0; i < count; i++) {
+        wait_window(&tx_completed, base, i, WINDOW);
+        msg.body[1] = i;
+        uint64_t start = now_ns();
+        sunxi_cec_submit(dev, &msg, CEC_TX_PRIORITY_NORMAL);
+        samples[i] = now_ns() - start;
+    }
+    wait_window(&tx_completed, base, count, 0);
+    run_end(&run, "sunxi_cec_submit", samples, count);
+}
+
+static void bench_register_callback(hdmi_cec_device_t *dev, uint64_t *samples, int count) {
+    struct run run;
+    run_begin(&run);
+    for (int i = 0; i < count; i++) {
+        uint64_t start = now_ns();
+        dev->register_event_callback(dev, callback, NULL);
+        samples[i] = now_ns() - start;
+    }
+    run_end(&run, "register_event_callback", samples, count);
+}
+
+static void bench_physical_address(hdmi_cec_device_t *dev, uint64_t *samples, int count) {
+    struct run run;
+    run_begin(&run);
+    for (int i = 0; i < count; i++) {
+        uint16_t addr;
+        uint64_t start = now_ns();
+        dev->get_physical_address(dev, &addr);
+        samples[i] = now_ns() - start;
+    }
+    run_end(&run, "get_physical_address", samples, count);
+}
+
+static void bench_logical_address(hdmi_cec_device_t *dev, uint64_t *samples, int count) {
+    struct run run;
+    run_begin(&run);
+    for (int i = 0; i < count; i++) {
+        uint64_t start = now_ns();
+        dev->add_logical_address(dev, i & 1 ? CEC_ADDR_PLAYBACK_2 : CEC_ADDR_PLAYBACK_3);
+        samples[i] = now_ns() - start;
+        dev->clear_logical_address(dev);
+    }
+    run_end(&run, "add_logical_address", samples, count);
+    dev->add_logical_address(dev, CEC_ADDR_PLAYBACK_1);
+}
+
+static void inject(struct cec_backend *backend, int i) {
+    unsigned char frame[] = {(CEC_ADDR_TV << 4) | CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_VENDOR_COMMAND, i};
+    while (cec_loopback_inject_frame(backend, frame, sizeof(frame)) == -EAGAIN) {
+        sched_yield();
+    }
+}
+
+// One frame at a time: read path, handling and dispatch up to the callback.
+static void bench_rx_latency(hdmi_cec_device_t *dev, uint64_t *samples, int count) {
+    struct cec_backend *backend = sunxi_cec_get_backend(dev);
+    struct run run;
+    run_begin(&run);
+    for (int i = 0; i < count; i++) {
+        uint64_t start = now_ns();
+        inject(backend, i);
+        sem_wait(&delivered);
+        samples[i] = now_ns() - start;
+    }
+    run_end(&run, "rx inject->callback", samples, count);
+}
+
+// Pipelined: how many frames per second the read path sustains.
+static void bench_rx_throughput(hdmi_cec_device_t *dev, uint64_t *samples, int count) {
+    struct cec_backend *backend = sunxi_cec_get_backend(dev);
+    unsigned int base = atomic_load(&received);
+    struct run run;
+    run_begin(&run);
+    for (int i = 0; i < count; i++) {
+        wait_window(&received, base, i, WINDOW);
+        uint64_t start = now_ns();
+        inject(backend, i);
+        samples[i] = now_ns() - start;
+    }
+    wait_window(&received, base, count, 0);
+    run_end(&run, "rx pipelined (inject)", samples, count);
+    while (sem_trywait(&delivered) == 0) {
+    }
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 20000;
+    if (count < 100) {
+        count = 100;
+    }
+    uint64_t *samples = calloc(count, sizeof(*samples));
+    sem_init(&delivered, 0, 0);
+
+    hdmi_cec_device_t *dev;
+    sunxi_cec_set_backend("loopback");
+    if (hdmi_cec_open(&HAL_MODULE_INFO_SYM, &dev) != 0) {
+        fprintf(stderr, "cannot open the HAL\n");
+        return 1;
+    }
+    dev->set_option(dev, HDMI_OPTION_ENABLE_CEC, 1);
+    sunxi_cec_wait_ready(dev, 1000);
+    dev->add_logical_address(dev, CEC_ADDR_PLAYBACK_1);
+    dev->register_event_callback(dev, callback, NULL);
+
+    printf("%-26s %8s %10s %8s %8s %8s %8s %8s %8s %8s\n",
+           "path", "calls", "calls/s", "p50 us", "p90 us", "p99 us", "max us", "allocs", "syscalls", "csw");
+    bench_send_message(dev, samples, count);
+    bench_submit(dev, samples, count);
+    bench_physical_address(dev, samples, count);
+    bench_logical_address(dev, samples, count);
+    bench_rx_latency(dev, samples, count);
+    bench_rx_throughput(dev, samples, count);
+    bench_register_callback(dev, samples, count);
+
+    hdmi_cec_close(dev);
+    free(samples);
+    return 0;
+}
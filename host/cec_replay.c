@@ -0,0 +1,219 @@
+/*
+ * Plays a capture taken with sunxi_cec_start_capture() (or
+ * persist.sys.hdmi.cec.capture_path) back into the HAL over the loopback
+ * backend. Received records go through the normal read path with their
+ * original spacing divided by speed; transmitted frames in the capture
+ * only seed the loopback (our logical and physical address, who acks).
+ * Prints replay throughput and, with -v, the HAL dump with its latency
+ * histograms.
+ *
+ * usage: cec_replay [-s speed] [-p] [-v] capture
+ *   -s speed   1 for real time, N for N times faster, 0 for no delays
+ *   -p         print the records instead of replaying them
+ */
+
+#include <hardware/hdmi_cec.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cec_capture.h"
+#include "cec_loopback.h"
+#include "sunxi_cec.h"
+
+extern struct hw_module_t HAL_MODULE_INFO_SYM;
+
+static unsigned long long callbacks;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t deadline_ns) {
+    struct timespec ts;
+    ts.tv_sec = deadline_ns / 1000000000ULL;
+    ts.tv_nsec = deadline_ns % 1000000000ULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+static void callback(const hdmi_event_t *event, void *arg) {
+    __atomic_fetch_add(&callbacks, 1, __ATOMIC_RELAXED);
+}
+
+static void print_record(const struct cec_capture_record *record, uint64_t start_ns) {
+    uint64_t ns = record->ns - start_ns;
+    printf("%6llu.%06llu %s", (unsigned long long) (ns / 1000000000ULL),
+           (unsigned long long) (ns % 1000000000ULL / 1000), record->kind == CEC_CAPTURE_TX ? "tx" : "rx");
+    if (record->kind == CEC_CAPTURE_RX && record->event_type != MESSAGE_TYPE_RECEIVE_SUCCESS) {
+        printf(" event=%d\n", record->event_type);
+        return;
+    }
+    for (int i = 0; i < record->length; i++) {
+        printf(" %02x", record->frame[i]);
+    }
+    if (record->kind == CEC_CAPTURE_TX) {
+        printf(" result=%d", record->result);
+    }
+    printf("\n");
+}
+
+int main(int argc, char **argv) {
+    double speed = 1;
+    int print = 0;
+    int verbose = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:pv")) != -1) {
+        switch (opt) {
+            case 's':
+                speed = atof(optarg);
+                break;
+            case 'p':
+                print = 1;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-s speed] [-p] [-v] capture\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-s speed] [-p] [-v] capture\n", argv[0]);
+        return 2;
+    }
+
+    int fd = open(argv[optind], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(struct cec_capture_header)) {
+        fprintf(stderr, "%s: cannot read capture\n", argv[optind]);
+        return 1;
+    }
+    const struct cec_capture_header *header = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    // records are found by masking the index with capacity - 1
+    if (header == MAP_FAILED || memcmp(header->magic, CEC_CAPTURE_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != CEC_CAPTURE_VERSION || header->record_size != sizeof(struct cec_capture_record) ||
+        header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0 ||
+        sizeof(*header) + (size_t) header->capacity * header->record_size > (size_t) st.st_size) {
+        fprintf(stderr, "%s: not a capture file\n", argv[optind]);
+        return 1;
+    }
+    const struct cec_capture_record *records = (const struct cec_capture_record *) (header + 1);
+
+    uint64_t end = atomic_load_explicit((atomic_uint_least64_t *) &header->next, memory_order_acquire);
+    uint64_t begin = end > header->capacity ? end - header->capacity : 0;
+
+    // One pass to learn the bus: our addresses from what we sent, the
+    // other devices from what they sent.
+    uint16_t ours = 0;
+    uint16_t present = 0;
+    int physical_address = -1;
+    unsigned int rx_count = 0, tx_count = 0;
+    for (uint64_t index = begin; index != end; index++) {
+        struct cec_capture_record record;
+        if (!cec_capture_read(header, records, index, &record)) {
+            continue;
+        }
+        if (print) {
+            print_record(&record, header->start_ns);
+        }
+        if (record.length == 0) {
+            rx_count += record.kind == CEC_CAPTURE_RX;
+            continue;
+        }
+        int initiator = record.frame[0] >> 4;
+        if (record.kind == CEC_CAPTURE_TX) {
+            tx_count++;
+            if (initiator != CEC_ADDR_UNREGISTERED) {
+                ours |= 1 << initiator;
+            }
+            if (record.length >= 4 && record.frame[1] == CEC_MESSAGE_REPORT_PHYSICAL_ADDRESS) {
+                physical_address = record.frame[2] << 8 | record.frame[3];
+            }
+        } else {
+            rx_count++;
+            if (initiator != CEC_ADDR_UNREGISTERED) {
+                present |= 1 << initiator;
+            }
+        }
+    }
+    printf("capture: %llu records (%u rx, %u tx) over %llu kept\n", (unsigned long long) end, rx_count, tx_count,
+           (unsigned long long) (end - begin));
+    if (print || rx_count == 0) {
+        return 0;
+    }
+
+    hdmi_cec_device_t *dev;
+    sunxi_cec_set_backend("loopback");
+    if (hdmi_cec_open(&HAL_MODULE_INFO_SYM, &dev) != 0) {
+        fprintf(stderr, "cannot open the HAL\n");
+        return 1;
+    }
+    struct cec_backend *backend = sunxi_cec_get_backend(dev);
+    cec_loopback_set_present(backend, present & ~ours);
+    if (physical_address >= 0) {
+        cec_loopback_set_physical_address(backend, physical_address);
+    }
+    dev->register_event_callback(dev, callback, NULL);
+    dev->set_option(dev, HDMI_OPTION_ENABLE_CEC, 1);
+    sunxi_cec_wait_ready(dev, 1000);
+    for (int addr = 0; addr < CEC_ADDR_UNREGISTERED; addr++) {
+        if (ours & (1 << addr)) {
+            dev->add_logical_address(dev, addr);
+        }
+    }
+
+    uint64_t first_ns = 0;
+    uint64_t start = now_ns();
+    unsigned int replayed = 0, retries = 0;
+    for (uint64_t index = begin; index != end; index++) {
+        struct cec_capture_record record;
+        if (!cec_capture_read(header, records, index, &record) || record.kind != CEC_CAPTURE_RX) {
+            continue;
+        }
+        if (!first_ns) {
+            first_ns = record.ns;
+        }
+        if (speed > 0) {
+            sleep_until(start + (uint64_t) ((record.ns - first_ns) / speed));
+        }
+
+        hdmi_cec_event_t event;
+        memset(&event, 0, sizeof(event));
+        event.event_type = record.event_type;
+        event.msg_len = record.length;
+        memcpy(event.msg, record.frame, record.length);
+        while (cec_loopback_inject(backend, &event) == -EAGAIN) {
+            // the HAL is behind; that is what an accelerated run measures
+            retries++;
+            usleep(100);
+        }
+        replayed++;
+    }
+    uint64_t elapsed = now_ns() - start;
+    usleep(100000);
+
+    printf("replayed %u records in %.3f ms (%.0f/s, %u queue-full waits), speed %g\n",
+           replayed, elapsed / 1e6, replayed / (elapsed / 1e9), retries, speed);
+    printf("hal: %llu callbacks, %llu frames sent (%u in capture)\n",
+           __atomic_load_n(&callbacks, __ATOMIC_RELAXED),
+           (unsigned long long) cec_loopback_sent_count(backend), tx_count);
+    if (verbose) {
+        fflush(stdout);
+        sunxi_cec_dump(dev, STDOUT_FILENO);
+    }
+
+    hdmi_cec_close(dev);
+    return 0;
+}
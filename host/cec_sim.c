@@ -0,0 +1,348 @@
+#include "cec_sim.h"
+
+#include <errno.h>
+#include <string.h>
+
+#define CEC_SIM_NEVER UINT64_MAX
+
+static uint64_t next_random(struct cec_sim *sim) {
+    // xorshift64*, deterministic for a given seed
+    sim->seed ^= sim->seed >> 12;
+    sim->seed ^= sim->seed << 25;
+    sim->seed ^= sim->seed >> 27;
+    return sim->seed * 2685821657736338717ULL;
+}
+
+void cec_sim_init(struct cec_sim *sim, uint64_t seed) {
+    memset(sim, 0, sizeof(*sim));
+    pthread_mutex_init(&sim->lock, NULL);
+    sim->seed = seed ? seed : 1;
+    sim->last_initiator = -1;
+}
+
+void cec_sim_destroy(struct cec_sim *sim) {
+    pthread_mutex_destroy(&sim->lock);
+}
+
+struct cec_sim_node *cec_sim_add_node(struct cec_sim *sim, const char *name, int logical_address) {
+    if (sim->node_count >= CEC_SIM_MAX_NODES) {
+        return NULL;
+    }
+
+    struct cec_sim_node *node = &sim->nodes[sim->node_count++];
+    memset(node, 0, sizeof(*node));
+    node->sim = sim;
+    node->name = name;
+    node->logical_address = logical_address;
+    node->ack_mask = logical_address < 15 ? 1 << logical_address : 0;
+    node->physical_address = 0x1000 + (sim->node_count << 8);
+    node->max_retransmissions = 1;
+    node->reply_delay = 5000;
+    node->traffic_next = CEC_SIM_NEVER;
+    return node;
+}
+
+void cec_sim_set_traffic(struct cec_sim_node *node, const unsigned char *frame, size_t length,
+                         cec_sim_time_t start, cec_sim_time_t period, cec_sim_time_t jitter) {
+    memcpy(node->traffic, frame, length);
+    node->traffic_length = length;
+    node->traffic_period = period;
+    node->traffic_jitter = jitter;
+    node->traffic_next = period ? start : CEC_SIM_NEVER;
+}
+
+cec_sim_time_t cec_sim_frame_time(size_t length) {
+    return CEC_SIM_START_BIT_US + length * CEC_SIM_BLOCK_US;
+}
+
+static int queue_locked(struct cec_sim *sim, struct cec_sim_node *node,
+                        const unsigned char *frame, size_t length) {
+    if (length == 0 || length > CEC_SIM_MAX_FRAME) {
+        return -EINVAL;
+    }
+    if (node->tail - node->head >= CEC_SIM_QUEUE_SIZE) {
+        node->stats.dropped++;
+        return -EAGAIN;
+    }
+
+    struct cec_sim_frame *entry = &node->queue[node->tail++ % CEC_SIM_QUEUE_SIZE];
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->data, frame, length);
+    entry->length = length;
+    entry->queued_at = sim->now;
+    entry->ready_at = sim->now + (sim->in_receive ? node->reply_delay : 0);
+    return 0;
+}
+
+int cec_sim_send(struct cec_sim *sim, struct cec_sim_node *node, const unsigned char *frame, size_t length) {
+    // Receive hooks run with the lock held and queue their replies directly.
+    if (sim->in_receive) {
+        return queue_locked(sim, node, frame, length);
+    }
+
+    pthread_mutex_lock(&sim->lock);
+    int ret = queue_locked(sim, node, frame, length);
+    pthread_mutex_unlock(&sim->lock);
+    return ret;
+}
+
+static cec_sim_time_t start_time(struct cec_sim *sim, struct cec_sim_node *node) {
+    if (node->head == node->tail) {
+        return CEC_SIM_NEVER;
+    }
+
+    const struct cec_sim_frame *frame = &node->queue[node->head % CEC_SIM_QUEUE_SIZE];
+    int initiator = frame->data[0] >> 4;
+    int signal_free;
+    if (node->retransmitting) {
+        signal_free = CEC_SIM_SFT_RETRANSMIT;
+    } else if (initiator == sim->last_initiator) {
+        signal_free = CEC_SIM_SFT_NEXT_FRAME;
+    } else {
+        signal_free = CEC_SIM_SFT_NEW_INITIATOR;
+    }
+
+    cec_sim_time_t start = sim->bus_free_at + signal_free * CEC_SIM_BIT_US;
+    return frame->ready_at > start ? frame->ready_at : start;
+}
+
+static void complete_frame(struct cec_sim *sim, struct cec_sim_node *node, int result) {
+    struct cec_sim_frame *frame = &node->queue[node->head % CEC_SIM_QUEUE_SIZE];
+    cec_sim_time_t latency = sim->now - frame->queued_at;
+
+    node->stats.latency_total += latency;
+    if (frame->attempts) {
+        node->stats.wait_total += frame->started_at - frame->queued_at;
+    }
+    if (latency > node->stats.latency_max) {
+        node->stats.latency_max = latency;
+    }
+    if (result == HDMI_RESULT_SUCCESS) {
+        node->stats.acked++;
+    } else {
+        node->stats.nacked++;
+    }
+
+    struct cec_sim_frame done = *frame;
+    node->head++;
+    node->retransmitting = 0;
+    node->last_result = result;
+
+    if (node->complete) {
+        node->complete(sim, node, &done, result);
+    }
+}
+
+static void deliver(struct cec_sim *sim, struct cec_sim_node *sender,
+                    const unsigned char *frame, size_t length, cec_sim_time_t queued_at) {
+    int destination = frame[0] & 0x0f;
+
+    sim->in_receive = 1;
+    for (int i = 0; i < sim->node_count; i++) {
+        struct cec_sim_node *node = &sim->nodes[i];
+        if (node == sender) {
+            continue;
+        }
+        if (destination != CEC_ADDR_BROADCAST && !(node->ack_mask & (1 << destination))) {
+            continue;
+        }
+
+        node->stats.received++;
+        node->stats.rx_latency_total += sim->now - queued_at;
+        if (sim->now - queued_at > node->stats.rx_latency_max) {
+            node->stats.rx_latency_max = sim->now - queued_at;
+        }
+        if (node->receive) {
+            node->receive(sim, node, frame, length);
+        }
+    }
+    sim->in_receive = 0;
+}
+
+/*
+ * Advances to the next event no later than limit.
+ * Returns 0 if nothing happened before limit.
+ */
+static int step_locked(struct cec_sim *sim, cec_sim_time_t limit) {
+    cec_sim_time_t next_traffic = CEC_SIM_NEVER;
+    cec_sim_time_t next_start = CEC_SIM_NEVER;
+    struct cec_sim_node *generator = NULL;
+
+    for (int i = 0; i < sim->node_count; i++) {
+        struct cec_sim_node *node = &sim->nodes[i];
+        if (node->traffic_next < next_traffic) {
+            next_traffic = node->traffic_next;
+            generator = node;
+        }
+        cec_sim_time_t start = start_time(sim, node);
+        if (start < next_start) {
+            next_start = start;
+        }
+    }
+
+    if (generator && next_traffic <= next_start) {
+        if (next_traffic > limit) {
+            return 0;
+        }
+        sim->now = next_traffic;
+        queue_locked(sim, generator, generator->traffic, generator->traffic_length);
+
+        cec_sim_time_t next = generator->traffic_period;
+        if (generator->traffic_jitter) {
+            next += next_random(sim) % (2 * generator->traffic_jitter + 1);
+            next -= generator->traffic_jitter;
+        }
+        generator->traffic_next = sim->now + next;
+        return 1;
+    }
+
+    if (next_start == CEC_SIM_NEVER || next_start > limit) {
+        return 0;
+    }
+
+    // Everybody ready within the first bit period starts together and
+    // arbitrates on the initiator address: the lowest one wins.
+    struct cec_sim_node *winner = NULL;
+    for (int i = 0; i < sim->node_count; i++) {
+        struct cec_sim_node *node = &sim->nodes[i];
+        if (start_time(sim, node) > next_start + CEC_SIM_BIT_US) {
+            continue;
+        }
+        if (!winner || node->queue[node->head % CEC_SIM_QUEUE_SIZE].data[0] <
+                       winner->queue[winner->head % CEC_SIM_QUEUE_SIZE].data[0]) {
+            winner = node;
+        }
+    }
+    for (int i = 0; i < sim->node_count; i++) {
+        struct cec_sim_node *node = &sim->nodes[i];
+        if (node != winner && start_time(sim, node) <= next_start + CEC_SIM_BIT_US) {
+            node->stats.arbitration_lost++;
+            node->queue[node->head % CEC_SIM_QUEUE_SIZE].lost_arbitration++;
+        }
+    }
+
+    struct cec_sim_frame *frame = &winner->queue[winner->head % CEC_SIM_QUEUE_SIZE];
+    int destination = frame->data[0] & 0x0f;
+    cec_sim_time_t duration = cec_sim_frame_time(frame->length);
+
+    sim->now = next_start + duration;
+    sim->bus_free_at = sim->now;
+    sim->last_initiator = frame->data[0] >> 4;
+    sim->busy_time += duration;
+    sim->frames++;
+
+    winner->stats.sent++;
+    if (frame->attempts++ > 0) {
+        winner->stats.retransmissions++;
+    } else {
+        frame->started_at = next_start;
+    }
+
+    int acked = destination == CEC_ADDR_BROADCAST;
+    for (int i = 0; i < sim->node_count && !acked; i++) {
+        struct cec_sim_node *node = &sim->nodes[i];
+        acked = node != winner && (node->ack_mask & (1 << destination));
+    }
+
+    if (acked) {
+        struct cec_sim_frame sent = *frame;
+        complete_frame(sim, winner, HDMI_RESULT_SUCCESS);
+        deliver(sim, winner, sent.data, sent.length, sent.queued_at);
+    } else if (frame->attempts <= winner->max_retransmissions) {
+        winner->retransmitting = 1;
+    } else {
+        complete_frame(sim, winner, HDMI_RESULT_NACK);
+    }
+    return 1;
+}
+
+int cec_sim_transmit(struct cec_sim *sim, struct cec_sim_node *node, const unsigned char *frame, size_t length) {
+    pthread_mutex_lock(&sim->lock);
+    unsigned int index = node->tail;
+    int ret = queue_locked(sim, node, frame, length);
+    if (ret < 0) {
+        pthread_mutex_unlock(&sim->lock);
+        return HDMI_RESULT_BUSY;
+    }
+
+    // Frames of a node complete in order; remember how ours ended.
+    // A saturated bus can starve a high address forever, so give up the
+    // way a driver would once the frame has waited too long.
+    cec_sim_time_t deadline = sim->now + CEC_SIM_TX_TIMEOUT_US;
+    node->last_result = HDMI_RESULT_FAIL;
+    while ((int) (node->head - index) <= 0) {
+        if (!step_locked(sim, deadline) && node->head == index) {
+            node->head++;
+            node->retransmitting = 0;
+            node->last_result = HDMI_RESULT_BUSY;
+            node->stats.timeouts++;
+        }
+    }
+    ret = node->last_result;
+    pthread_mutex_unlock(&sim->lock);
+    return ret;
+}
+
+void cec_sim_run_until(struct cec_sim *sim, cec_sim_time_t until) {
+    pthread_mutex_lock(&sim->lock);
+    while (step_locked(sim, until)) {
+    }
+    if (sim->now < until) {
+        sim->now = until;
+    }
+    pthread_mutex_unlock(&sim->lock);
+}
+
+cec_sim_time_t cec_sim_now(struct cec_sim *sim) {
+    pthread_mutex_lock(&sim->lock);
+    cec_sim_time_t now = sim->now;
+    pthread_mutex_unlock(&sim->lock);
+    return now;
+}
+
+void cec_sim_tv_receive(struct cec_sim *sim, struct cec_sim_node *node,
+                        const unsigned char *frame, size_t length) {
+    int initiator = frame[0] >> 4;
+    int destination = frame[0] & 0x0f;
+    if (length < 2 || destination == CEC_ADDR_BROADCAST) {
+        return;
+    }
+
+    unsigned char reply[CEC_SIM_MAX_FRAME];
+    reply[0] = (node->logical_address << 4) | initiator;
+
+    switch (frame[1]) {
+        case CEC_MESSAGE_GIVE_DEVICE_POWER_STATUS:
+            reply[1] = CEC_MESSAGE_REPORT_POWER_STATUS;
+            reply[2] = 0x00;
+            cec_sim_send(sim, node, reply, 3);
+            break;
+
+        case CEC_MESSAGE_GIVE_PHYSICAL_ADDRESS:
+            reply[0] = (node->logical_address << 4) | CEC_ADDR_BROADCAST;
+            reply[1] = CEC_MESSAGE_REPORT_PHYSICAL_ADDRESS;
+            reply[2] = node->physical_address >> 8;
+            reply[3] = node->physical_address;
+            reply[4] = CEC_DEVICE_TV;
+            cec_sim_send(sim, node, reply, 5);
+            break;
+
+        case CEC_MESSAGE_GIVE_DEVICE_VENDOR_ID:
+            reply[0] = (node->logical_address << 4) | CEC_ADDR_BROADCAST;
+            reply[1] = CEC_MESSAGE_DEVICE_VENDOR_ID;
+            reply[2] = 0x00;
+            reply[3] = 0x00;
+            reply[4] = 0xf0;
+            cec_sim_send(sim, node, reply, 5);
+            break;
+
+        case CEC_MESSAGE_GET_CEC_VERSION:
+            reply[1] = CEC_MESSAGE_CEC_VERSION;
+            reply[2] = 0x05;
+            cec_sim_send(sim, node, reply, 3);
+            break;
+
+        default:
+            break;
+    }
+}
@@ -0,0 +1,157 @@
+#ifndef HOST_CEC_SIM_H
+#define HOST_CEC_SIM_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cec_backend.h"
+
+/*
+ * Discrete-event model of a CEC bus shared by several virtual devices.
+ *
+ * Time is virtual (microseconds) and only advances when the simulator is
+ * stepped, so runs are deterministic and much faster than real time.
+ * The model covers frame timing (start bit plus 10 bit periods per
+ * block), signal-free times, arbitration between initiators that start
+ * together, and ACK/NACK with retransmission.
+ */
+
+#define CEC_SIM_BIT_US 2400
+#define CEC_SIM_START_BIT_US 4500
+#define CEC_SIM_BLOCK_US (10 * CEC_SIM_BIT_US)
+
+/* Signal-free times before a transmission, in bit periods. */
+#define CEC_SIM_SFT_RETRANSMIT 3
+#define CEC_SIM_SFT_NEW_INITIATOR 5
+#define CEC_SIM_SFT_NEXT_FRAME 7
+
+#define CEC_SIM_MAX_NODES 15
+#define CEC_SIM_QUEUE_SIZE 32
+#define CEC_SIM_MAX_FRAME 17
+
+/* cec_sim_transmit() gives up with HDMI_RESULT_BUSY after this long */
+#define CEC_SIM_TX_TIMEOUT_US 5000000
+
+typedef uint64_t cec_sim_time_t;
+
+struct cec_sim;
+struct cec_sim_node;
+
+struct cec_sim_frame {
+    unsigned char data[CEC_SIM_MAX_FRAME];
+    size_t length;
+    cec_sim_time_t queued_at;
+    cec_sim_time_t ready_at;
+    cec_sim_time_t started_at;  /* first attempt on the wire */
+    int attempts;
+    int lost_arbitration;
+};
+
+/* Called when a node receives a frame; may queue replies with cec_sim_send(). */
+typedef void (*cec_sim_receive_t)(struct cec_sim *sim, struct cec_sim_node *node,
+                                  const unsigned char *frame, size_t length);
+
+/* Called when a frame from this node has completed with HDMI_RESULT_*. */
+typedef void (*cec_sim_complete_t)(struct cec_sim *sim, struct cec_sim_node *node,
+                                   const struct cec_sim_frame *frame, int result);
+
+struct cec_sim_stats {
+    uint64_t sent;
+    uint64_t acked;
+    uint64_t nacked;
+    uint64_t arbitration_lost;
+    uint64_t retransmissions;
+    uint64_t received;
+    cec_sim_time_t rx_latency_total; /* queued at the sender to delivered here */
+    cec_sim_time_t rx_latency_max;
+    uint64_t dropped;               /* queue overflows */
+    uint64_t timeouts;              /* frames abandoned by cec_sim_transmit */
+    cec_sim_time_t latency_total;   /* queued to completion, summed */
+    cec_sim_time_t wait_total;      /* queued to first attempt, summed */
+    cec_sim_time_t latency_max;
+};
+
+struct cec_sim_node {
+    struct cec_sim *sim;
+    const char *name;
+    int logical_address;
+    uint16_t ack_mask;          /* addresses this node acknowledges */
+    uint16_t physical_address;
+    int max_retransmissions;
+    cec_sim_time_t reply_delay; /* processing time before queued replies */
+
+    struct cec_sim_frame queue[CEC_SIM_QUEUE_SIZE];
+    unsigned int head;
+    unsigned int tail;
+    int retransmitting;
+    int last_result;
+
+    /* optional periodic traffic */
+    unsigned char traffic[CEC_SIM_MAX_FRAME];
+    size_t traffic_length;
+    cec_sim_time_t traffic_period;
+    cec_sim_time_t traffic_jitter;
+    cec_sim_time_t traffic_next;
+
+    cec_sim_receive_t receive;
+    cec_sim_complete_t complete;
+    void *arg;
+
+    struct cec_sim_stats stats;
+};
+
+struct cec_sim {
+    pthread_mutex_t lock;
+    cec_sim_time_t now;
+    cec_sim_time_t bus_free_at;
+    int last_initiator;
+    uint64_t seed;
+    int in_receive;
+
+    struct cec_sim_node nodes[CEC_SIM_MAX_NODES];
+    int node_count;
+
+    uint64_t frames;
+    cec_sim_time_t busy_time;
+};
+
+void cec_sim_init(struct cec_sim *sim, uint64_t seed);
+void cec_sim_destroy(struct cec_sim *sim);
+
+/* Adds a device; returns NULL when the bus is full. */
+struct cec_sim_node *cec_sim_add_node(struct cec_sim *sim, const char *name, int logical_address);
+
+/* Makes node send frame every period (+/- jitter), starting at start. */
+void cec_sim_set_traffic(struct cec_sim_node *node, const unsigned char *frame, size_t length,
+                         cec_sim_time_t start, cec_sim_time_t period, cec_sim_time_t jitter);
+
+/* Queues a frame (header + body) at the current virtual time; -EAGAIN if full. */
+int cec_sim_send(struct cec_sim *sim, struct cec_sim_node *node, const unsigned char *frame, size_t length);
+
+/*
+ * Queues a frame and runs the bus until it has completed, as a blocking
+ * transmitter would; returns HDMI_RESULT_*.
+ */
+int cec_sim_transmit(struct cec_sim *sim, struct cec_sim_node *node, const unsigned char *frame, size_t length);
+
+/* Runs the bus until virtual time until. */
+void cec_sim_run_until(struct cec_sim *sim, cec_sim_time_t until);
+
+/* Current virtual time. */
+cec_sim_time_t cec_sim_now(struct cec_sim *sim);
+
+/* Duration of a frame of the given length on the wire. */
+cec_sim_time_t cec_sim_frame_time(size_t length);
+
+/* Default responder for a TV: answers power status, physical address, vendor and version queries. */
+void cec_sim_tv_receive(struct cec_sim *sim, struct cec_sim_node *node,
+                        const unsigned char *frame, size_t length);
+
+/*
+ * Backend attaching the HAL to the bus as one more node; pass the node
+ * (created with cec_sim_add_node) as the backend argument.
+ */
+extern const struct cec_backend_ops cec_sim_backend;
+
+#endif
@@ -0,0 +1,160 @@
+#include "cec_sim.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define SIM_RX_QUEUE_SIZE 64
+
+struct sim_backend {
+    struct cec_sim_node *node;
+    pthread_mutex_t lock;
+    int event_fd;
+    int started;
+    hdmi_cec_event_t queue[SIM_RX_QUEUE_SIZE];
+    unsigned int head;
+    unsigned int tail;
+};
+
+static void sim_receive(struct cec_sim *sim, struct cec_sim_node *node,
+                        const unsigned char *frame, size_t length) {
+    struct sim_backend *backend = node->arg;
+
+    pthread_mutex_lock(&backend->lock);
+    if (backend->started && backend->tail - backend->head < SIM_RX_QUEUE_SIZE) {
+        hdmi_cec_event_t *event = &backend->queue[backend->tail++ % SIM_RX_QUEUE_SIZE];
+        memset(event, 0, sizeof(*event));
+        event->event_type = MESSAGE_TYPE_RECEIVE_SUCCESS;
+        event->msg_len = length;
+        memcpy(event->msg, frame, length);
+
+        uint64_t value = 1;
+        write(backend->event_fd, &value, sizeof(value));
+    } else {
+        node->stats.dropped++;
+    }
+    pthread_mutex_unlock(&backend->lock);
+}
+
+static int sim_open(struct cec_backend *backend) {
+    struct cec_sim_node *node = backend->arg;
+    if (!node) {
+        return -EINVAL;
+    }
+
+    struct sim_backend *sim = calloc(1, sizeof(*sim));
+    if (!sim) {
+        return -ENOMEM;
+    }
+    sim->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (sim->event_fd < 0) {
+        int err = errno;
+        free(sim);
+        return -err;
+    }
+    pthread_mutex_init(&sim->lock, NULL);
+    sim->node = node;
+
+    node->arg = sim;
+    node->receive = sim_receive;
+    node->ack_mask = 0;
+    backend->priv = sim;
+    return sim->event_fd;
+}
+
+static void sim_close(struct cec_backend *backend) {
+    struct sim_backend *sim = backend->priv;
+
+    pthread_mutex_lock(&sim->node->sim->lock);
+    sim->node->receive = NULL;
+    sim->node->ack_mask = 0;
+    pthread_mutex_unlock(&sim->node->sim->lock);
+
+    close(sim->event_fd);
+    pthread_mutex_destroy(&sim->lock);
+    free(sim);
+    backend->priv = NULL;
+}
+
+static int sim_read_events(struct cec_backend *backend, hdmi_cec_event_t *events, int max) {
+    struct sim_backend *sim = backend->priv;
+    uint64_t value;
+    int count = 0;
+
+    pthread_mutex_lock(&sim->lock);
+    read(sim->event_fd, &value, sizeof(value));
+    while (count < max && sim->head != sim->tail) {
+        events[count++] = sim->queue[sim->head++ % SIM_RX_QUEUE_SIZE];
+    }
+    if (sim->head != sim->tail) {
+        value = 1;
+        write(sim->event_fd, &value, sizeof(value));
+    }
+    pthread_mutex_unlock(&sim->lock);
+    return count;
+}
+
+static int sim_write_frame(struct cec_backend *backend, const unsigned char *frame, size_t length) {
+    struct sim_backend *sim = backend->priv;
+    if (!sim->started) {
+        return HDMI_RESULT_FAIL;
+    }
+    return cec_sim_transmit(sim->node->sim, sim->node, frame, length);
+}
+
+static int sim_set_logical_address(struct cec_backend *backend, int addr) {
+    struct sim_backend *sim = backend->priv;
+
+    pthread_mutex_lock(&sim->node->sim->lock);
+    sim->node->logical_address = addr;
+    sim->node->ack_mask = addr < CEC_ADDR_BROADCAST ? 1 << addr : 0;
+    pthread_mutex_unlock(&sim->node->sim->lock);
+    return 0;
+}
+
+static int sim_set_logical_mask(struct cec_backend *backend, uint16_t mask) {
+    struct sim_backend *sim = backend->priv;
+
+    pthread_mutex_lock(&sim->node->sim->lock);
+    sim->node->logical_address = mask ? __builtin_ctz(mask) : CEC_ADDR_UNREGISTERED;
+    sim->node->ack_mask = mask & 0x7fff;
+    pthread_mutex_unlock(&sim->node->sim->lock);
+    return 0;
+}
+
+static int sim_get_physical_address(struct cec_backend *backend, uint16_t *addr) {
+    struct sim_backend *sim = backend->priv;
+    *addr = sim->node->physical_address;
+    return 0;
+}
+
+static int sim_start(struct cec_backend *backend) {
+    struct sim_backend *sim = backend->priv;
+    pthread_mutex_lock(&sim->lock);
+    sim->started = 1;
+    pthread_mutex_unlock(&sim->lock);
+    return 0;
+}
+
+static int sim_stop(struct cec_backend *backend) {
+    struct sim_backend *sim = backend->priv;
+    pthread_mutex_lock(&sim->lock);
+    sim->started = 0;
+    pthread_mutex_unlock(&sim->lock);
+    return 0;
+}
+
+const struct cec_backend_ops cec_sim_backend = {
+        .name = "sim",
+        .open = sim_open,
+        .close = sim_close,
+        .read_events = sim_read_events,
+        .write_frame = sim_write_frame,
+        .set_logical_address = sim_set_logical_address,
+        .set_logical_mask = sim_set_logical_mask,
+        .get_physical_address = sim_get_physical_address,
+        .start = sim_start,
+        .stop = sim_stop,
+};
@@ -0,0 +1,170 @@
+/*
+ * Runs the HAL as one node of a simulated CEC bus and reports how
+ * send_message throughput and receive latency degrade as more devices
+ * join the bus and their traffic grows. All times are virtual.
+ *
+ * The HAL sends one frame every interval and the bus keeps running in
+ * between, so the TV's reply to one frame is not charged to the next.
+ * An interval of 0 sends back to back, which saturates the bus with the
+ * HAL's own requests and replies.
+ *
+ * usage: cec_sim_bench [frames-per-run] [seed] [interval-ms]
+ */
+
+#include <hardware/hdmi_cec.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cec_sim.h"
+#include "sunxi_cec.h"
+
+extern struct hw_module_t HAL_MODULE_INFO_SYM;
+
+static const int background_addresses[] = {1, 5, 8, 2, 3, 9, 11, 6, 7, 10, 12, 13, 14};
+
+struct scenario {
+    int nodes;                  /* background devices besides the TV */
+    cec_sim_time_t period;      /* of each background device, 0 = silent */
+};
+
+static int compare_time(const void *a, const void *b) {
+    cec_sim_time_t x = *(const cec_sim_time_t *) a;
+    cec_sim_time_t y = *(const cec_sim_time_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static double wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int run(const struct scenario *scenario, int frames, uint64_t seed, cec_sim_time_t interval) {
+    static struct cec_sim sim;
+    cec_sim_init(&sim, seed);
+
+    struct cec_sim_node *tv = cec_sim_add_node(&sim, "tv", CEC_ADDR_TV);
+    tv->receive = cec_sim_tv_receive;
+    tv->physical_address = 0x0000;
+
+    struct cec_sim_node *hal = cec_sim_add_node(&sim, "hal", CEC_ADDR_UNREGISTERED);
+
+    for (int i = 0; i < scenario->nodes; i++) {
+        int addr = background_addresses[i];
+        struct cec_sim_node *node = cec_sim_add_node(&sim, "device", addr);
+        if (!node || !scenario->period) {
+            continue;
+        }
+
+        unsigned char frame[5];
+        size_t length;
+        if (i % 2 == 0) {
+            frame[0] = (addr << 4) | CEC_ADDR_TV;
+            frame[1] = CEC_MESSAGE_GIVE_DEVICE_POWER_STATUS;
+            length = 2;
+        } else {
+            frame[0] = (addr << 4) | CEC_ADDR_BROADCAST;
+            frame[1] = CEC_MESSAGE_REPORT_PHYSICAL_ADDRESS;
+            frame[2] = node->physical_address >> 8;
+            frame[3] = node->physical_address;
+            frame[4] = CEC_DEVICE_PLAYBACK;
+            length = 5;
+        }
+        cec_sim_set_traffic(node, frame, length, (i + 1) * 7000, scenario->period, scenario->period / 4);
+    }
+
+    hdmi_cec_device_t *dev;
+    sunxi_cec_set_backend_ops(&cec_sim_backend, hal);
+    if (hdmi_cec_open(&HAL_MODULE_INFO_SYM, &dev) != 0) {
+        fprintf(stderr, "unable to open HAL\n");
+        return -1;
+    }
+    dev->set_option(dev, HDMI_OPTION_ENABLE_CEC, 1);
+    dev->add_logical_address(dev, CEC_ADDR_PLAYBACK_1);
+
+    cec_sim_time_t *latency = calloc(frames, sizeof(*latency));
+    cec_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.initiator = CEC_ADDR_PLAYBACK_1;
+    msg.destination = CEC_ADDR_TV;
+    msg.length = 1;
+    msg.body[0] = CEC_MESSAGE_GIVE_DEVICE_POWER_STATUS;
+
+    int failed = 0;
+    double wall_start = wall_ms();
+    cec_sim_time_t start = cec_sim_now(&sim);
+    cec_sim_time_t next = start;
+    for (int i = 0; i < frames; i++) {
+        // virtual time only moves while someone runs the bus
+        cec_sim_run_until(&sim, next);
+        cec_sim_time_t before = cec_sim_now(&sim);
+        if (dev->send_message(dev, &msg) != HDMI_RESULT_SUCCESS) {
+            failed++;
+        }
+        latency[i] = cec_sim_now(&sim) - before;
+        next += interval;
+    }
+    // let the last replies reach the HAL
+    cec_sim_run_until(&sim, cec_sim_now(&sim) + 100000);
+    cec_sim_time_t elapsed = cec_sim_now(&sim) - start;
+    double wall = wall_ms() - wall_start;
+
+    hdmi_cec_close(dev);
+
+    qsort(latency, frames, sizeof(*latency), compare_time);
+    const struct cec_sim_stats *stats = &hal->stats;
+    printf("%5d %8llu %9.1f %8.1f %8.1f %8.1f %8.1f %6llu %6llu %8.1f %8.1f %5.0f%% %7.0fx\n",
+           sim.node_count,
+           scenario->period ? (unsigned long long) scenario->period / 1000 : 0ULL,
+           frames * 1e6 / elapsed,
+           latency[frames / 2] / 1000.0,
+           latency[frames * 99 / 100] / 1000.0,
+           latency[frames - 1] / 1000.0,
+           stats->acked + stats->nacked ? stats->wait_total / 1000.0 / (stats->acked + stats->nacked) : 0.0,
+           (unsigned long long) stats->arbitration_lost,
+           (unsigned long long) failed,
+           stats->received ? stats->rx_latency_total / 1000.0 / stats->received : 0.0,
+           stats->rx_latency_max / 1000.0,
+           100.0 * sim.busy_time / (sim.now ? sim.now : 1),
+           wall > 0 ? elapsed / 1000.0 / wall : 0.0);
+
+    free(latency);
+    cec_sim_destroy(&sim);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : 200;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], NULL, 0) : 1;
+    int interval_ms = argc > 3 ? atoi(argv[3]) : 500;
+    if (frames <= 0) {
+        frames = 200;
+    }
+    if (interval_ms < 0) {
+        interval_ms = 500;
+    }
+
+    static const struct scenario scenarios[] = {
+            {0, 0},
+            {2, 10000000},
+            {6, 10000000},
+            {13, 10000000},
+            {2, 3000000},
+            {6, 3000000},
+            {13, 3000000},
+    };
+
+    printf("one frame every %d ms; a %zu-byte frame is %.1f ms on the wire\n", interval_ms, (size_t) 2,
+           cec_sim_frame_time(2) / 1000.0);
+    printf("nodes period   tx-fps   tx-p50   tx-p99   tx-max  tx-wait  arbit nacked  rx-mean   rx-max  busy   speed\n");
+    printf("        (ms)              (ms)     (ms)     (ms)     (ms)   lost            (ms)     (ms)\n");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        if (run(&scenarios[i], frames, seed, interval_ms * 1000ULL) < 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
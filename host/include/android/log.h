@@ -0,0 +1,43 @@
+#ifndef HOST_ANDROID_LOG_H
+#define HOST_ANDROID_LOG_H
+
+/*
+ * Minimal stand-in for the NDK logging API so the HAL builds as a host
+ * Linux library. Messages below HOST_LOG_LEVEL are dropped.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+
+typedef enum android_LogPriority {
+    ANDROID_LOG_UNKNOWN = 0,
+    ANDROID_LOG_DEFAULT,
+    ANDROID_LOG_VERBOSE,
+    ANDROID_LOG_DEBUG,
+    ANDROID_LOG_INFO,
+    ANDROID_LOG_WARN,
+    ANDROID_LOG_ERROR,
+    ANDROID_LOG_FATAL,
+    ANDROID_LOG_SILENT,
+} android_LogPriority;
+
+#ifndef HOST_LOG_LEVEL
+#define HOST_LOG_LEVEL ANDROID_LOG_WARN
+#endif
+
+__attribute__((format(printf, 3, 4)))
+static inline int __android_log_print(int prio, const char *tag, const char *fmt, ...) {
+    if (prio < HOST_LOG_LEVEL) {
+        return 0;
+    }
+
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "%s: ", tag);
+    int ret = vfprintf(stderr, fmt, ap);
+    fputc('\n', stderr);
+    va_end(ap);
+    return ret;
+}
+
+#endif
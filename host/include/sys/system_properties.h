@@ -0,0 +1,37 @@
+#ifndef HOST_SYS_SYSTEM_PROPERTIES_H
+#define HOST_SYS_SYSTEM_PROPERTIES_H
+
+/*
+ * Host stand-in for bionic system properties: a property is read from the
+ * environment variable named after it in upper case, with every other
+ * character turned into '_'. For example ro.hdmi.device_type is read from
+ * RO_HDMI_DEVICE_TYPE, ro.hdmi.cec.osd_name from RO_HDMI_CEC_OSD_NAME and
+ * ro.hdmi.cec.auto_reply from RO_HDMI_CEC_AUTO_REPLY.
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PROP_NAME_MAX   32
+#define PROP_VALUE_MAX  92
+
+static inline int __system_property_get(const char *name, char *value) {
+    char key[128];
+    size_t i;
+    for (i = 0; name[i] && i < sizeof(key) - 1; i++) {
+        key[i] = isalnum((unsigned char) name[i]) ? toupper((unsigned char) name[i]) : '_';
+    }
+    key[i] = 0;
+
+    const char *env = getenv(key);
+    if (!env) {
+        value[0] = 0;
+        return 0;
+    }
+    strncpy(value, env, PROP_VALUE_MAX - 1);
+    value[PROP_VALUE_MAX - 1] = 0;
+    return strlen(value);
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef SUNXI_HDMI_CEC_TEST_H
+#define SUNXI_HDMI_CEC_TEST_H
+
+/*
+ * Minimal checks for the host unit tests: a failed CHECK prints where and
+ * what, and the test carries on so that one run shows every failure.
+ * main() returns test_result().
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+static int test_failures;
+
+#define CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        long long actual_ = (long long) (actual); \
+        long long expected_ = (long long) (expected); \
+        if (actual_ != expected_) { \
+            fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, actual_, \
+                    expected_); \
+            test_failures++; \
+        } \
+    } while (0)
+
+static inline void test_sleep_ms(int ms) {
+    struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+    while (nanosleep(&ts, &ts) < 0) {
+    }
+}
+
+static inline int test_result(const char *name) {
+    printf("%s: %s\n", name, test_failures ? "FAILED" : "ok");
+    return test_failures ? 1 : 0;
+}
+
+#endif
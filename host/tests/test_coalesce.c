@@ -0,0 +1,118 @@
+/*
+ * Receive coalescing: duplicate reports within the window, routing reports
+ * made stale by a new route, forgetting on request, key auto-repeat merging
+ * and the properties that turn either off.
+ */
+
+#include <stdlib.h>
+
+#include "cec_coalesce.h"
+#include "cec_stats.h"
+#include "test.h"
+
+#define MS 1000000ULL
+
+static int rx(struct cec_coalesce *coalesce, int initiator, int destination, uint64_t now_ms,
+              const unsigned char *body, size_t length) {
+    return cec_coalesce_rx(coalesce, initiator, destination, body, length, now_ms * MS);
+}
+
+static void test_reports(void) {
+    struct cec_coalesce coalesce;
+    cec_coalesce_init(&coalesce);
+
+    const unsigned char on[] = {CEC_MESSAGE_REPORT_POWER_STATUS, 0x00};
+    const unsigned char standby[] = {CEC_MESSAGE_REPORT_POWER_STATUS, 0x01};
+    CHECK(rx(&coalesce, 0, 4, 1000, on, sizeof(on)));
+    CHECK(!rx(&coalesce, 0, 4, 1100, on, sizeof(on)));
+    // a change always goes through, and so does the next report past the window
+    CHECK(rx(&coalesce, 0, 4, 1200, standby, sizeof(standby)));
+    CHECK(!rx(&coalesce, 0, 4, 1300, standby, sizeof(standby)));
+    CHECK(rx(&coalesce, 0, 4, 1800, standby, sizeof(standby)));
+    // compared per initiator and destination
+    CHECK(rx(&coalesce, 5, 4, 1800, standby, sizeof(standby)));
+    CHECK(rx(&coalesce, 0, 15, 1800, standby, sizeof(standby)));
+
+    // asking a device again gets its answer delivered
+    const unsigned char address[] = {CEC_MESSAGE_REPORT_PHYSICAL_ADDRESS, 0x10, 0x00, 0x04};
+    CHECK(rx(&coalesce, 4, 15, 2000, address, sizeof(address)));
+    CHECK(!rx(&coalesce, 4, 15, 2010, address, sizeof(address)));
+    cec_coalesce_forget(&coalesce, 3);
+    CHECK(!rx(&coalesce, 4, 15, 2020, address, sizeof(address)));
+    cec_coalesce_forget(&coalesce, 4);
+    CHECK(rx(&coalesce, 4, 15, 2030, address, sizeof(address)));
+    cec_coalesce_forget(&coalesce, -1);
+    CHECK(rx(&coalesce, 4, 15, 2040, address, sizeof(address)));
+
+    // a new route makes the last active source worth repeating
+    const unsigned char active[] = {CEC_MESSAGE_ACTIVE_SOURCE, 0x10, 0x00};
+    const unsigned char routing[] = {CEC_MESSAGE_ROUTING_CHANGE, 0x10, 0x00, 0x20, 0x00};
+    CHECK(rx(&coalesce, 4, 15, 3000, active, sizeof(active)));
+    CHECK(!rx(&coalesce, 4, 15, 3010, active, sizeof(active)));
+    CHECK(rx(&coalesce, 0, 15, 3020, routing, sizeof(routing)));
+    CHECK(rx(&coalesce, 4, 15, 3030, active, sizeof(active)));
+
+    // commands are never merged
+    const unsigned char vendor[] = {CEC_MESSAGE_VENDOR_COMMAND, 0x01};
+    CHECK(rx(&coalesce, 0, 4, 4000, vendor, sizeof(vendor)));
+    CHECK(rx(&coalesce, 0, 4, 4000, vendor, sizeof(vendor)));
+
+    CHECK_EQ(cec_counter_get(&coalesce.duplicates), 5);
+    CHECK_EQ(cec_counter_get(&coalesce.suppressed[CEC_MESSAGE_REPORT_POWER_STATUS]), 2);
+    CHECK_EQ(cec_counter_get(&coalesce.delivered), 13);
+}
+
+static void test_keys(void) {
+    struct cec_coalesce coalesce;
+    cec_coalesce_init(&coalesce);
+
+    const unsigned char select[] = {CEC_MESSAGE_USER_CONTROL_PRESSED, 0x00};
+    const unsigned char up[] = {CEC_MESSAGE_USER_CONTROL_PRESSED, 0x01};
+    const unsigned char released[] = {CEC_MESSAGE_USER_CONTROL_RELEASED};
+
+    // Repeats every 100 ms: one is delivered as soon as waiting for the
+    // next would leave more than the hold time since the last delivery.
+    CHECK(rx(&coalesce, 0, 4, 1000, up, sizeof(up)));
+    CHECK(!rx(&coalesce, 0, 4, 1100, up, sizeof(up)));
+    CHECK(!rx(&coalesce, 0, 4, 1200, up, sizeof(up)));
+    CHECK(!rx(&coalesce, 0, 4, 1300, up, sizeof(up)));
+    CHECK(rx(&coalesce, 0, 4, 1400, up, sizeof(up)));
+    CHECK(!rx(&coalesce, 0, 4, 1500, up, sizeof(up)));
+    CHECK_EQ(cec_counter_get(&coalesce.key_repeats), 4);
+
+    // another key, a release, or a press after the release timeout is new
+    CHECK(rx(&coalesce, 0, 4, 1600, select, sizeof(select)));
+    CHECK(rx(&coalesce, 0, 4, 1700, released, sizeof(released)));
+    CHECK(rx(&coalesce, 0, 4, 1800, select, sizeof(select)));
+    CHECK(rx(&coalesce, 0, 4, 2400, select, sizeof(select)));
+    CHECK(rx(&coalesce, 5, 4, 2450, select, sizeof(select)));
+}
+
+static void test_properties(void) {
+    struct cec_coalesce coalesce;
+
+    setenv("RO_HDMI_CEC_RX_DEDUP_MS", "0", 1);
+    setenv("RO_HDMI_CEC_RX_KEY_HOLD_MS", "0", 1);
+    cec_coalesce_init(&coalesce);
+    const unsigned char on[] = {CEC_MESSAGE_REPORT_POWER_STATUS, 0x00};
+    const unsigned char up[] = {CEC_MESSAGE_USER_CONTROL_PRESSED, 0x01};
+    CHECK(rx(&coalesce, 0, 4, 1000, on, sizeof(on)));
+    CHECK(rx(&coalesce, 0, 4, 1001, on, sizeof(on)));
+    CHECK(rx(&coalesce, 0, 4, 1000, up, sizeof(up)));
+    CHECK(rx(&coalesce, 0, 4, 1001, up, sizeof(up)));
+
+    // a hold time past the release timeout would let the key go up
+    setenv("RO_HDMI_CEC_RX_KEY_HOLD_MS", "600", 1);
+    cec_coalesce_init(&coalesce);
+    CHECK_EQ(coalesce.key_hold_ns, CEC_COALESCE_KEY_HOLD_MS * MS);
+
+    unsetenv("RO_HDMI_CEC_RX_DEDUP_MS");
+    unsetenv("RO_HDMI_CEC_RX_KEY_HOLD_MS");
+}
+
+int main(void) {
+    test_reports();
+    test_keys();
+    test_properties();
+    return test_result("test_coalesce");
+}
@@ -0,0 +1,105 @@
+/*
+ * EDID physical address parsing: the HDMI vendor specific data block of a
+ * CEA-861 extension, and the EDIDs that must be rejected.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cec_edid.h"
+#include "test.h"
+
+#define EDID_SIZE (2 * CEC_EDID_BLOCK_SIZE)
+
+static void checksum(uint8_t *block) {
+    uint8_t sum = 0;
+    for (int i = 0; i < CEC_EDID_BLOCK_SIZE - 1; i++) {
+        sum += block[i];
+    }
+    block[CEC_EDID_BLOCK_SIZE - 1] = -sum;
+}
+
+// Base block plus one CEA extension: a video data block, then the VSDB
+// with physical address 1.2.0.0 and the given OUI.
+static void build(uint8_t *edid, uint32_t oui) {
+    static const uint8_t header[8] = {0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00};
+    memset(edid, 0, EDID_SIZE);
+    memcpy(edid, header, sizeof(header));
+    edid[126] = 1;
+    checksum(edid);
+
+    uint8_t *cea = edid + CEC_EDID_BLOCK_SIZE;
+    const uint8_t blocks[] = {
+            0x42, 0x10, 0x04,                                   // video, 2 bytes
+            0x65, oui, oui >> 8, oui >> 16, 0x12, 0x00,         // vendor, 5 bytes
+    };
+    cea[0] = 0x02;
+    cea[1] = 0x03;
+    cea[2] = 4 + sizeof(blocks);
+    memcpy(cea + 4, blocks, sizeof(blocks));
+    checksum(cea);
+}
+
+static int read_file(const void *data, size_t length, uint16_t *addr) {
+    char path[] = "/tmp/cec_test_edid.XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0 || write(fd, data, length) != (ssize_t) length) {
+        return -EIO;
+    }
+    close(fd);
+    int ret = cec_edid_read_physical_address(path, addr);
+    unlink(path);
+    return ret;
+}
+
+int main(void) {
+    uint8_t edid[EDID_SIZE];
+    uint16_t addr = 0;
+
+    build(edid, 0x000c03);
+    CHECK_EQ(cec_edid_parse_physical_address(edid, sizeof(edid), &addr), 0);
+    CHECK_EQ(addr, 0x1200);
+
+    // raw and as the hex dump some kernels print
+    addr = 0;
+    CHECK_EQ(read_file(edid, sizeof(edid), &addr), 0);
+    CHECK_EQ(addr, 0x1200);
+    char text[EDID_SIZE * 3 + 1];
+    for (int i = 0; i < EDID_SIZE; i++) {
+        snprintf(text + i * 3, 4, "%02x%c", edid[i], i % 16 == 15 ? '\n' : ' ');
+    }
+    addr = 0;
+    CHECK_EQ(read_file(text, strlen(text), &addr), 0);
+    CHECK_EQ(addr, 0x1200);
+
+    // too short, or not an EDID
+    CHECK_EQ(cec_edid_parse_physical_address(edid, CEC_EDID_BLOCK_SIZE - 1, &addr), -EINVAL);
+    edid[0] = 0x01;
+    CHECK_EQ(cec_edid_parse_physical_address(edid, sizeof(edid), &addr), -EINVAL);
+
+    // no extension block, or fewer bytes than the extension count says
+    build(edid, 0x000c03);
+    CHECK_EQ(cec_edid_parse_physical_address(edid, CEC_EDID_BLOCK_SIZE, &addr), -ENOENT);
+    edid[126] = 0;
+    checksum(edid);
+    CHECK_EQ(cec_edid_parse_physical_address(edid, sizeof(edid), &addr), -ENOENT);
+
+    // an extension with a bad checksum is skipped
+    build(edid, 0x000c03);
+    edid[CEC_EDID_BLOCK_SIZE + 8]++;
+    CHECK_EQ(cec_edid_parse_physical_address(edid, sizeof(edid), &addr), -ENOENT);
+
+    // a vendor block of another OUI (HDMI Forum) carries no address
+    build(edid, 0xc45dd8);
+    CHECK_EQ(cec_edid_parse_physical_address(edid, sizeof(edid), &addr), -ENOENT);
+
+    // a data block running past the collection ends the walk
+    build(edid, 0x000c03);
+    edid[CEC_EDID_BLOCK_SIZE + 4] = 0x5f;
+    checksum(edid + CEC_EDID_BLOCK_SIZE);
+    CHECK_EQ(cec_edid_parse_physical_address(edid, sizeof(edid), &addr), -ENOENT);
+
+    return test_result("test_edid");
+}
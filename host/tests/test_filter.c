@@ -0,0 +1,68 @@
+/*
+ * Receive filter verdicts: addressing and operand checks from the opcode
+ * table, runtime allow bitmaps, ro.hdmi.cec.filter.deny and the counters.
+ */
+
+#include <stdlib.h>
+
+#include "cec_filter.h"
+#include "cec_stats.h"
+#include "test.h"
+
+#define DIRECTED SUNXI_CEC_FILTER_DIRECTED
+#define BROADCAST SUNXI_CEC_FILTER_BROADCAST
+#define OTHER SUNXI_CEC_FILTER_OTHER
+
+int main(void) {
+    struct cec_filter filter;
+
+    // vendor commands denied by the product configuration
+    setenv("RO_HDMI_CEC_FILTER_DENY", "89,zz", 1);
+    cec_filter_init(&filter);
+    unsetenv("RO_HDMI_CEC_FILTER_DENY");
+
+    // well-formed frames to us or to everyone are delivered
+    CHECK_EQ(cec_filter_rx(&filter, DIRECTED, CEC_MESSAGE_GIVE_OSD_NAME, 0), CEC_FILTER_DELIVER);
+    CHECK_EQ(cec_filter_rx(&filter, BROADCAST, CEC_MESSAGE_ACTIVE_SOURCE, 2), CEC_FILTER_DELIVER);
+
+    // wrong addressing or too few operands
+    CHECK_EQ(cec_filter_rx(&filter, BROADCAST, CEC_MESSAGE_GIVE_OSD_NAME, 0), CEC_FILTER_DROP);
+    CHECK_EQ(cec_filter_rx(&filter, DIRECTED, CEC_MESSAGE_ACTIVE_SOURCE, 2), CEC_FILTER_DROP);
+    CHECK_EQ(cec_filter_rx(&filter, BROADCAST, CEC_MESSAGE_ACTIVE_SOURCE, 1), CEC_FILTER_DROP);
+    CHECK_EQ(cec_filter_rx(&filter, DIRECTED, CEC_MESSAGE_FEATURE_ABORT, 1), CEC_FILTER_DROP);
+    CHECK_EQ(cec_counter_get(&filter.malformed), 4);
+
+    // unknown opcodes are the framework's business
+    CHECK_EQ(cec_filter_rx(&filter, DIRECTED, 0x01, 0), CEC_FILTER_DELIVER);
+    CHECK_EQ(cec_filter_rx(&filter, BROADCAST, 0x01, 5), CEC_FILTER_DELIVER);
+
+    // denied by ro.hdmi.cec.filter.deny, in both directions of addressing
+    CHECK_EQ(cec_filter_rx(&filter, DIRECTED, CEC_MESSAGE_VENDOR_COMMAND, 1), CEC_FILTER_DROP);
+    CHECK_EQ(cec_counter_get(&filter.filtered[CEC_MESSAGE_VENDOR_COMMAND]), 1);
+
+    // frames to other devices: only what the HAL itself uses is kept
+    CHECK_EQ(cec_filter_rx(&filter, OTHER, CEC_MESSAGE_GIVE_OSD_NAME, 0), CEC_FILTER_HAL_ONLY);
+    CHECK_EQ(cec_filter_rx(&filter, OTHER, CEC_MESSAGE_PLAY, 1), CEC_FILTER_DROP);
+    CHECK_EQ(cec_filter_set(&filter, SUNXI_CEC_FILTER_RX, OTHER, CEC_MESSAGE_PLAY, 1), 0);
+    CHECK_EQ(cec_filter_rx(&filter, OTHER, CEC_MESSAGE_PLAY, 1), CEC_FILTER_DELIVER);
+
+    // a denied opcode the HAL acts on still reaches the HAL
+    CHECK_EQ(cec_filter_set(&filter, SUNXI_CEC_FILTER_RX, DIRECTED, CEC_MESSAGE_USER_CONTROL_PRESSED, 0), 0);
+    CHECK_EQ(cec_filter_rx(&filter, DIRECTED, CEC_MESSAGE_USER_CONTROL_PRESSED, 1), CEC_FILTER_HAL_ONLY);
+    CHECK_EQ(cec_filter_set(&filter, SUNXI_CEC_FILTER_RX, DIRECTED, -1, 1), 0);
+    CHECK_EQ(cec_filter_rx(&filter, DIRECTED, CEC_MESSAGE_USER_CONTROL_PRESSED, 1), CEC_FILTER_DELIVER);
+
+    // TX status reporting
+    CHECK(cec_filter_tx(&filter, DIRECTED, CEC_MESSAGE_VENDOR_COMMAND));
+    CHECK_EQ(cec_filter_set(&filter, SUNXI_CEC_FILTER_TX, DIRECTED, CEC_MESSAGE_VENDOR_COMMAND, 0), 0);
+    CHECK(!cec_filter_tx(&filter, DIRECTED, CEC_MESSAGE_VENDOR_COMMAND));
+    CHECK(cec_filter_tx(&filter, DIRECTED, -1));
+    CHECK_EQ(cec_counter_get(&filter.tx_filtered), 1);
+
+    // bad arguments
+    CHECK(cec_filter_set(&filter, 2, DIRECTED, 0, 1) < 0);
+    CHECK(cec_filter_set(&filter, SUNXI_CEC_FILTER_RX, 3, 0, 1) < 0);
+    CHECK(cec_filter_set(&filter, SUNXI_CEC_FILTER_RX, DIRECTED, 0x100, 1) < 0);
+
+    return test_result("test_filter");
+}
@@ -0,0 +1,102 @@
+/*
+ * Hotplug debouncing on a running event loop: reports only after the
+ * debounce of their direction, flaps shorter than it are swallowed, and
+ * CEC traffic from the TV counts as a connect signal.
+ */
+
+#include <stdlib.h>
+
+#include "cec_hotplug.h"
+#include "cec_stats.h"
+#include "test.h"
+
+#define CONNECT_MS 20
+#define DISCONNECT_MS 80
+#define TICK_MS 2
+#define END_MS 600
+
+struct step {
+    int at_ms;
+    int connected;
+    int source;
+};
+
+static const struct step script[] = {
+        {0, 1, CEC_HOTPLUG_KERNEL},     // reported at CONNECT_MS
+        {100, 0, CEC_HOTPLUG_KERNEL},
+        {130, 1, CEC_HOTPLUG_KERNEL},   // back before DISCONNECT_MS: a flap
+        {200, 0, CEC_HOTPLUG_KERNEL},
+        {220, 0, CEC_HOTPLUG_KERNEL},   // repeated signals do not restart the debounce
+        {400, 1, CEC_HOTPLUG_CEC},
+        {405, 1, CEC_HOTPLUG_CEC},
+};
+
+#define STEPS (int) (sizeof(script) / sizeof(script[0]))
+
+static struct cec_loop loop;
+static struct cec_hotplug hotplug;
+static struct cec_timer tick;
+static uint64_t start_ns;
+static int next_step;
+
+static int reports[8];
+static int report_ms[8];
+static int report_count;
+
+static int elapsed_ms(void) {
+    return (cec_now_ns() - start_ns) / 1000000;
+}
+
+static void report(struct cec_hotplug *debouncer, int connected) {
+    if (report_count < 8) {
+        reports[report_count] = connected;
+        report_ms[report_count] = elapsed_ms();
+    }
+    report_count++;
+}
+
+// Signals have to come from the loop thread, so the script runs off a timer.
+static void tick_fired(struct cec_timer *timer) {
+    int now = elapsed_ms();
+    while (next_step < STEPS && script[next_step].at_ms <= now) {
+        cec_hotplug_signal(&hotplug, script[next_step].connected, script[next_step].source);
+        next_step++;
+    }
+    if (now >= END_MS) {
+        cec_loop_stop(&loop);
+    }
+}
+
+int main(void) {
+    setenv("RO_HDMI_CEC_HOTPLUG_CONNECT_MS", "20", 1);
+    setenv("RO_HDMI_CEC_HOTPLUG_DISCONNECT_MS", "80", 1);
+
+    CHECK_EQ(cec_loop_init(&loop), 0);
+    CHECK_EQ(cec_hotplug_init(&hotplug, &loop, report, NULL), 0);
+    CHECK_EQ(cec_timer_init(&tick, &loop, tick_fired, NULL), 0);
+    CHECK_EQ(atomic_load(&hotplug.reported), CEC_HOTPLUG_UNKNOWN);
+
+    start_ns = cec_now_ns();
+    cec_timer_arm_periodic(&tick, 1, TICK_MS);
+    cec_loop_run(&loop);
+
+    CHECK_EQ(report_count, 3);
+    CHECK_EQ(reports[0], 1);
+    CHECK(report_ms[0] >= CONNECT_MS && report_ms[0] < 100);
+    CHECK_EQ(reports[1], 0);
+    CHECK(report_ms[1] >= 200 + DISCONNECT_MS && report_ms[1] < 400);
+    CHECK_EQ(reports[2], 1);
+    CHECK(report_ms[2] >= 400 + CONNECT_MS);
+    CHECK_EQ(atomic_load(&hotplug.reported), CEC_HOTPLUG_CONNECTED);
+    CHECK_EQ(atomic_load(&hotplug.pending), CEC_HOTPLUG_UNKNOWN);
+
+    CHECK_EQ(cec_counter_get(&hotplug.flaps), 1);
+    CHECK_EQ(cec_counter_get(&hotplug.reports), 3);
+    CHECK_EQ(cec_counter_get(&hotplug.signals[CEC_HOTPLUG_KERNEL]), 5);
+    CHECK_EQ(cec_counter_get(&hotplug.signals[CEC_HOTPLUG_CEC]), 2);
+
+    cec_timer_destroy(&tick);
+    cec_hotplug_destroy(&hotplug);
+    cec_loop_destroy(&loop);
+    return test_result("test_hotplug");
+}
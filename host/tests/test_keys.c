@@ -0,0 +1,76 @@
+/*
+ * Remote control keys on the uinput fast path, through the whole HAL on
+ * the loopback backend with a FIFO standing in for uinput: keys sent to
+ * us are injected, keys the TV sends to other devices are not.
+ */
+
+#include <hardware/hdmi_cec.h>
+
+#include <fcntl.h>
+#include <linux/input.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cec_loopback.h"
+#include "sunxi_cec.h"
+#include "test.h"
+
+extern struct hw_module_t HAL_MODULE_INFO_SYM;
+
+static void inject_key(struct cec_backend *backend, int destination, int opcode) {
+    unsigned char frame[] = {(CEC_ADDR_TV << 4) | destination, opcode, 0x01};
+    cec_loopback_inject_frame(backend, frame, opcode == CEC_MESSAGE_USER_CONTROL_PRESSED ? 3 : 2);
+}
+
+/* Returns the value of the next key event, or -1 if none comes in time. */
+static int read_key(int fd, int timeout_ms) {
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+        return -1;
+    }
+    struct input_event events[2];
+    if (read(fd, events, sizeof(events)) != sizeof(events)) {
+        return -1;
+    }
+    return events[0].value;
+}
+
+int main(void) {
+    char fifo[64];
+    snprintf(fifo, sizeof(fifo), "/tmp/cec_test_keys.%d", getpid());
+    CHECK_EQ(mkfifo(fifo, 0600), 0);
+    // read-write so that the HAL's non-blocking open finds a reader
+    int input_fd = open(fifo, O_RDWR | O_CLOEXEC);
+    CHECK(input_fd >= 0);
+    setenv("RO_HDMI_CEC_UINPUT_PATH", fifo, 1);
+
+    hdmi_cec_device_t *dev;
+    sunxi_cec_set_backend("loopback");
+    CHECK_EQ(hdmi_cec_open(&HAL_MODULE_INFO_SYM, &dev), 0);
+    struct cec_backend *backend = sunxi_cec_get_backend(dev);
+    dev->set_option(dev, HDMI_OPTION_ENABLE_CEC, 1);
+    dev->add_logical_address(dev, CEC_ADDR_PLAYBACK_1);
+    sunxi_cec_set_key_fast_path(dev, 1);
+
+    // a key for a recorder or a soundbar is none of our business
+    inject_key(backend, CEC_ADDR_RECORDER_1, CEC_MESSAGE_USER_CONTROL_PRESSED);
+    CHECK_EQ(read_key(input_fd, 100), -1);
+    inject_key(backend, CEC_ADDR_AUDIO_SYSTEM, CEC_MESSAGE_USER_CONTROL_PRESSED);
+    inject_key(backend, CEC_ADDR_AUDIO_SYSTEM, CEC_MESSAGE_USER_CONTROL_RELEASED);
+    CHECK_EQ(read_key(input_fd, 100), -1);
+    inject_key(backend, CEC_ADDR_BROADCAST, CEC_MESSAGE_USER_CONTROL_PRESSED);
+    CHECK_EQ(read_key(input_fd, 100), -1);
+
+    // ours is pressed and released
+    inject_key(backend, CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_USER_CONTROL_PRESSED);
+    CHECK_EQ(read_key(input_fd, 1000), 1);
+    inject_key(backend, CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_USER_CONTROL_RELEASED);
+    CHECK_EQ(read_key(input_fd, 1000), 0);
+
+    hdmi_cec_close(dev);
+    close(input_fd);
+    unlink(fifo);
+    return test_result("test_keys");
+}
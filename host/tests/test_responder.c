@@ -0,0 +1,68 @@
+/*
+ * Auto-responder: which queries the HAL answers itself and what it says,
+ * and the product properties that hand them back to the framework.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cec_responder.h"
+#include "test.h"
+
+static size_t reply(const struct cec_responder *responder, int address, int opcode, unsigned char *body,
+                    int *broadcast) {
+    return cec_responder_reply(responder, address, opcode, body, broadcast);
+}
+
+int main(void) {
+    struct cec_responder responder;
+    unsigned char body[CEC_MESSAGE_BODY_MAX_LENGTH];
+    int broadcast = -1;
+
+    cec_responder_init(&responder, 0x001582, 0x05);
+    responder.physical_address = 0x1000;
+
+    CHECK_EQ(reply(&responder, CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_GIVE_PHYSICAL_ADDRESS, body, &broadcast), 4);
+    CHECK_EQ(broadcast, 1);
+    CHECK_EQ(body[0], CEC_MESSAGE_REPORT_PHYSICAL_ADDRESS);
+    CHECK_EQ(body[3], CEC_DEVICE_PLAYBACK);
+    CHECK_EQ(reply(&responder, CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_GIVE_DEVICE_VENDOR_ID, body, &broadcast), 4);
+    CHECK_EQ(body[3], 0x82);
+    CHECK_EQ(reply(&responder, CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_GIVE_DEVICE_POWER_STATUS, body, &broadcast), 2);
+    CHECK_EQ(broadcast, 0);
+    CHECK_EQ(reply(&responder, CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_GIVE_DECK_STATUS, body, &broadcast), 2);
+    CHECK_EQ(reply(&responder, CEC_ADDR_TUNER_1, CEC_MESSAGE_GIVE_DECK_STATUS, body, &broadcast), 0);
+
+    // the user's device name belongs to the framework unless the product fixes one
+    CHECK_EQ(reply(&responder, CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_GIVE_OSD_NAME, body, &broadcast), 0);
+
+    // only a TV tells the menu language, and only once it knows it
+    CHECK_EQ(reply(&responder, CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_GET_MENU_LANGUAGE, body, &broadcast), 3);
+    CHECK_EQ(body[0], CEC_MESSAGE_FEATURE_ABORT);
+    CHECK_EQ(body[1], CEC_MESSAGE_GET_MENU_LANGUAGE);
+    CHECK_EQ(reply(&responder, CEC_ADDR_TV, CEC_MESSAGE_GET_MENU_LANGUAGE, body, &broadcast), 0);
+    responder.language = 0x656e67;
+    CHECK_EQ(reply(&responder, CEC_ADDR_TV, CEC_MESSAGE_GET_MENU_LANGUAGE, body, &broadcast), 4);
+    CHECK_EQ(broadcast, 1);
+
+    // not a query
+    CHECK_EQ(reply(&responder, CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_STANDBY, body, &broadcast), 0);
+
+    setenv("RO_HDMI_CEC_OSD_NAME", "Living room", 1);
+    cec_responder_init(&responder, 0x001582, 0x05);
+    CHECK_EQ(reply(&responder, CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_GIVE_OSD_NAME, body, &broadcast), 12);
+    CHECK(!memcmp(body + 1, "Living room", 11));
+
+    // only the listed opcodes
+    setenv("RO_HDMI_CEC_AUTO_REPLY", "8f,83", 1);
+    cec_responder_init(&responder, 0x001582, 0x05);
+    responder.physical_address = 0x1000;
+    CHECK_EQ(reply(&responder, CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_GIVE_DEVICE_POWER_STATUS, body, &broadcast), 2);
+    CHECK_EQ(reply(&responder, CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_GIVE_PHYSICAL_ADDRESS, body, &broadcast), 4);
+    CHECK_EQ(reply(&responder, CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_GIVE_OSD_NAME, body, &broadcast), 0);
+    CHECK_EQ(reply(&responder, CEC_ADDR_PLAYBACK_1, CEC_MESSAGE_GIVE_DEVICE_VENDOR_ID, body, &broadcast), 0);
+    unsetenv("RO_HDMI_CEC_AUTO_REPLY");
+    unsetenv("RO_HDMI_CEC_OSD_NAME");
+
+    return test_result("test_responder");
+}
@@ -0,0 +1,186 @@
+/*
+ * Transmit engine over the loopback transport: retransmission on NACK and
+ * BUSY per priority class, deduplication of state reports, and coalescing
+ * of queued frames, which must never swallow a submission with a status.
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+
+#include "cec_backend.h"
+#include "cec_loopback.h"
+#include "cec_tx.h"
+#include "test.h"
+
+static struct cec_backend backend = {.ops = &cec_backend_loopback};
+static struct cec_tx tx;
+static atomic_int completed;
+static atomic_int notified;
+
+static int transmit(struct cec_tx *engine, const cec_message_t *msg) {
+    unsigned char frame[CEC_MESSAGE_BODY_MAX_LENGTH + 1];
+    frame[0] = (msg->initiator << 4) | (msg->destination & 0x0f);
+    memcpy(frame + 1, msg->body, msg->length);
+    return backend.ops->write_frame(&backend, frame, msg->length + 1);
+}
+
+static void complete(struct cec_tx *engine, const struct cec_tx_entry *entry, int result) {
+    if (entry->flags & CEC_TX_NOTIFY) {
+        atomic_fetch_add(&notified, 1);
+    }
+    atomic_fetch_add(&completed, 1);
+}
+
+static cec_message_t message(int destination, const unsigned char *body, size_t length) {
+    cec_message_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.initiator = CEC_ADDR_PLAYBACK_1;
+    msg.destination = destination;
+    msg.length = length;
+    memcpy(msg.body, body, length);
+    return msg;
+}
+
+static int wait_completed(int count) {
+    for (int i = 0; i < 200 && atomic_load(&completed) < count; i++) {
+        test_sleep_ms(5);
+    }
+    return atomic_load(&completed);
+}
+
+static void test_retry(void) {
+    struct cec_tx_retry_stats stats[CEC_TX_PRIORITY_COUNT];
+    const unsigned char give_name[] = {CEC_MESSAGE_GIVE_OSD_NAME};
+    cec_message_t to_tv = message(CEC_ADDR_TV, give_name, sizeof(give_name));
+    cec_message_t to_nobody = message(CEC_ADDR_RECORDER_1, give_name, sizeof(give_name));
+    cec_message_t poll = message(CEC_ADDR_RECORDER_1, give_name, 0);
+
+    // a NACK within the allowance is retransmitted
+    uint64_t sent = cec_loopback_sent_count(&backend);
+    cec_loopback_fail_next(&backend, HDMI_RESULT_NACK, 1);
+    CHECK_EQ(cec_tx_send(&tx, &to_tv, CEC_TX_PRIORITY_NORMAL), HDMI_RESULT_SUCCESS);
+    CHECK_EQ(cec_loopback_sent_count(&backend) - sent, 2);
+
+    // an absent device is given up on after nack_retries
+    sent = cec_loopback_sent_count(&backend);
+    CHECK_EQ(cec_tx_send(&tx, &to_nobody, CEC_TX_PRIORITY_NORMAL), HDMI_RESULT_NACK);
+    CHECK_EQ(cec_loopback_sent_count(&backend) - sent, 3);
+
+    // lost arbitration has its own allowance
+    sent = cec_loopback_sent_count(&backend);
+    cec_loopback_fail_next(&backend, HDMI_RESULT_BUSY, 4);
+    CHECK_EQ(cec_tx_send(&tx, &to_tv, CEC_TX_PRIORITY_NORMAL), HDMI_RESULT_SUCCESS);
+    CHECK_EQ(cec_loopback_sent_count(&backend) - sent, 5);
+
+    // a poll NACK is an answer
+    sent = cec_loopback_sent_count(&backend);
+    CHECK_EQ(cec_tx_send(&tx, &poll, CEC_TX_PRIORITY_POLL), HDMI_RESULT_NACK);
+    CHECK_EQ(cec_loopback_sent_count(&backend) - sent, 1);
+
+    // and the policy can be changed while running
+    struct cec_tx_retry_policy none = {0, 0};
+    cec_tx_set_retry(&tx, CEC_TX_PRIORITY_NORMAL, &none);
+    sent = cec_loopback_sent_count(&backend);
+    CHECK_EQ(cec_tx_send(&tx, &to_nobody, CEC_TX_PRIORITY_NORMAL), HDMI_RESULT_NACK);
+    CHECK_EQ(cec_loopback_sent_count(&backend) - sent, 1);
+
+    cec_tx_get_retry_stats(&tx, stats);
+    CHECK_EQ(stats[CEC_TX_PRIORITY_NORMAL].nack_retries, 3);
+    CHECK_EQ(stats[CEC_TX_PRIORITY_NORMAL].busy_retries, 4);
+    CHECK_EQ(stats[CEC_TX_PRIORITY_NORMAL].recovered, 2);
+    CHECK_EQ(stats[CEC_TX_PRIORITY_NORMAL].exhausted, 1);
+    CHECK_EQ(stats[CEC_TX_PRIORITY_POLL].nack_retries, 0);
+    CHECK_EQ(stats[CEC_TX_PRIORITY_POLL].exhausted, 0);
+}
+
+static void test_dedup(void) {
+    struct cec_tx_coalesce_stats stats;
+    const unsigned char on[] = {CEC_MESSAGE_REPORT_POWER_STATUS, 0x00};
+    const unsigned char standby[] = {CEC_MESSAGE_REPORT_POWER_STATUS, 0x01};
+    cec_message_t report_on = message(CEC_ADDR_TV, on, sizeof(on));
+    cec_message_t report_standby = message(CEC_ADDR_TV, standby, sizeof(standby));
+
+    // the same state again is acknowledged without touching the bus
+    uint64_t sent = cec_loopback_sent_count(&backend);
+    CHECK_EQ(cec_tx_send(&tx, &report_on, -1), HDMI_RESULT_SUCCESS);
+    CHECK_EQ(cec_tx_send(&tx, &report_on, -1), HDMI_RESULT_SUCCESS);
+    CHECK_EQ(cec_loopback_sent_count(&backend) - sent, 1);
+
+    // unless the state changed, it was forgotten, or a status was asked for
+    CHECK_EQ(cec_tx_send(&tx, &report_standby, -1), HDMI_RESULT_SUCCESS);
+    cec_tx_forget(&tx, CEC_ADDR_TV, CEC_MESSAGE_REPORT_POWER_STATUS);
+    CHECK_EQ(cec_tx_send(&tx, &report_standby, -1), HDMI_RESULT_SUCCESS);
+    CHECK_EQ(cec_loopback_sent_count(&backend) - sent, 3);
+
+    int before = atomic_load(&completed);
+    CHECK_EQ(cec_tx_submit(&tx, &report_standby, -1, CEC_TX_NOTIFY, 0), 0);
+    CHECK_EQ(wait_completed(before + 1), before + 1);
+    CHECK_EQ(cec_loopback_sent_count(&backend) - sent, 4);
+
+    cec_tx_get_coalesce_stats(&tx, &stats);
+    CHECK_EQ(stats.suppressed, 1);
+}
+
+static void test_coalesce(void) {
+    struct cec_tx_coalesce_stats stats;
+    const unsigned char give_name[] = {CEC_MESSAGE_GIVE_OSD_NAME};
+    const unsigned char vendor_a[] = {CEC_MESSAGE_DEVICE_VENDOR_ID, 0x00, 0x0c, 0x03};
+    const unsigned char vendor_b[] = {CEC_MESSAGE_DEVICE_VENDOR_ID, 0x00, 0x0c, 0x04};
+    const unsigned char active[] = {CEC_MESSAGE_ACTIVE_SOURCE, 0x10, 0x00};
+    cec_message_t busy = message(CEC_ADDR_TV, give_name, sizeof(give_name));
+    cec_message_t id_a = message(CEC_ADDR_BROADCAST, vendor_a, sizeof(vendor_a));
+    cec_message_t id_b = message(CEC_ADDR_BROADCAST, vendor_b, sizeof(vendor_b));
+    cec_message_t source = message(CEC_ADDR_BROADCAST, active, sizeof(active));
+
+    cec_tx_set_dedup_window(&tx, 0);
+    cec_tx_get_coalesce_stats(&tx, &stats);
+    uint64_t merged = stats.merged;
+    uint64_t superseded = stats.superseded;
+
+    // keep the engine on the wire while the reports queue up behind it
+    cec_loopback_set_frame_delay(&backend, 50000);
+    uint64_t sent = cec_loopback_sent_count(&backend);
+    int before = atomic_load(&completed);
+    atomic_store(&notified, 0);
+    CHECK_EQ(cec_tx_submit(&tx, &busy, -1, 0, 0), 0);
+    test_sleep_ms(10);
+
+    CHECK_EQ(cec_tx_submit(&tx, &id_a, -1, 0, 0), 0);
+    CHECK_EQ(cec_tx_submit(&tx, &id_a, -1, 0, 0), 0);
+    CHECK_EQ(cec_tx_submit(&tx, &id_b, -1, 0, 0), 0);
+    CHECK_EQ(cec_tx_submit(&tx, &source, -1, CEC_TX_NOTIFY, 0), 0);
+    CHECK_EQ(cec_tx_submit(&tx, &source, -1, CEC_TX_NOTIFY, 0), 0);
+    CHECK_EQ(cec_tx_submit(&tx, &source, -1, 0, 0), 0);
+
+    // busy, one vendor ID, and every active source
+    CHECK_EQ(wait_completed(before + 5), before + 5);
+    test_sleep_ms(60);
+    CHECK_EQ(atomic_load(&completed), before + 5);
+    CHECK_EQ(atomic_load(&notified), 2);
+    CHECK_EQ(cec_loopback_sent_count(&backend) - sent, 5);
+    unsigned char last[CEC_MESSAGE_BODY_MAX_LENGTH + 1];
+    CHECK_EQ(cec_loopback_last_sent(&backend, last), sizeof(active) + 1);
+
+    cec_tx_get_coalesce_stats(&tx, &stats);
+    CHECK_EQ(stats.merged - merged, 1);
+    CHECK_EQ(stats.superseded - superseded, 1);
+
+    cec_loopback_set_frame_delay(&backend, 0);
+    cec_tx_set_dedup_window(&tx, CEC_TX_DEDUP_WINDOW_MS);
+}
+
+int main(void) {
+    CHECK(backend.ops->open(&backend) >= 0);
+    CHECK_EQ(backend.ops->start(&backend), 0);
+    cec_loopback_set_present(&backend, 1 << CEC_ADDR_TV);
+    CHECK_EQ(cec_tx_start(&tx, transmit, complete, NULL, NULL), 0);
+
+    test_retry();
+    test_dedup();
+    test_coalesce();
+
+    cec_tx_stop(&tx);
+    backend.ops->stop(&backend);
+    backend.ops->close(&backend);
+    return test_result("test_tx");
+}
@@ -17,7 +17,25 @@ LOCAL_SHARED_LIBRARIES := \
 LOCAL_LDLIBS := -llog
 
 LOCAL_SRC_FILES += \
-    sunxi.c
+    sunxi.c \
+    cec_loop.c \
+    cec_tx.c \
+    cec_dispatch.c \
+    cec_edid.c \
+    cec_filter.c \
+    cec_hotplug.c \
+    cec_keys.c \
+    cec_stats.c \
+    cec_topology.c \
+    cec_config.c \
+    cec_responder.c \
+    cec_sched.c \
+    cec_trace.c \
+    cec_capture.c \
+    cec_coalesce.c \
+    cec_backend.c \
+    cec_backend_sunxi.c \
+    cec_backend_loopback.c
 
 LOCAL_CFLAGS += \
     -fno-short-enums \
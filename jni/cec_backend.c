@@ -0,0 +1,17 @@
+#include "cec_backend.h"
+
+#include <string.h>
+
+static const struct cec_backend_ops *const backends[] = {
+        &cec_backend_sunxi,
+        &cec_backend_loopback,
+};
+
+const struct cec_backend_ops *cec_backend_find(const char *name) {
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (!strcmp(backends[i]->name, name)) {
+            return backends[i];
+        }
+    }
+    return NULL;
+}
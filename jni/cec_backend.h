@@ -0,0 +1,75 @@
+#ifndef SUNXI_HDMI_CEC_BACKEND_H
+#define SUNXI_HDMI_CEC_BACKEND_H
+
+#include <hardware/hdmi_cec.h>
+
+#include <stdint.h>
+
+/*
+ * Transport backends. All device I/O of the HAL goes through this table,
+ * so the HAL can run against the sunxi character device, an in-process
+ * loopback or a simulated bus.
+ */
+
+#define MESSAGE_TYPE_RECEIVE_SUCCESS            1
+#define MESSAGE_TYPE_NOACK              2
+#define MESSAGE_TYPE_DISCONNECTED               3
+#define MESSAGE_TYPE_CONNECTED          4
+#define MESSAGE_TYPE_SEND_SUCCESS               5
+
+/* Record format of the sunxi driver, shared by every backend. */
+typedef struct hdmi_cec_event {
+    int event_type;
+    int msg_len;
+    unsigned char msg[17];
+} hdmi_cec_event_t;
+
+struct cec_backend;
+
+struct cec_backend_ops {
+    const char *name;
+
+    /* Returns a pollable fd that becomes readable when events are pending, or -errno. */
+    int (*open)(struct cec_backend *backend);
+    void (*close)(struct cec_backend *backend);
+
+    /* Reads up to max pending records; returns their count, 0 if none or -errno. */
+    int (*read_events)(struct cec_backend *backend, hdmi_cec_event_t *events, int max);
+
+    /* Transmits header + body; returns one of HDMI_RESULT_*. */
+    int (*write_frame)(struct cec_backend *backend, const unsigned char *frame, size_t length);
+
+    int (*set_logical_address)(struct cec_backend *backend, int addr);
+
+    /*
+     * Claims every address in mask (bit per logical address) in one update;
+     * 0 releases them all. Optional: NULL or -ENOTTY when the transport
+     * only holds a single address.
+     */
+    int (*set_logical_mask)(struct cec_backend *backend, uint16_t mask);
+
+    /*
+     * Lets only received frames whose opcode bit is set in opcodes
+     * (256 bits) reach read_events; polls always pass. Optional: NULL or
+     * -ENOTTY when the transport cannot filter.
+     */
+    int (*set_rx_filter)(struct cec_backend *backend, const uint32_t *opcodes);
+
+    int (*get_physical_address)(struct cec_backend *backend, uint16_t *addr);
+    int (*start)(struct cec_backend *backend);
+    int (*stop)(struct cec_backend *backend);
+};
+
+struct cec_backend {
+    const struct cec_backend_ops *ops;
+    void *arg;      /* configuration handed to open(), e.g. a simulated bus */
+    void *priv;
+};
+
+extern const struct cec_backend_ops cec_backend_sunxi;
+extern const struct cec_backend_ops cec_backend_loopback;
+
+/* Looks a backend up by name; returns NULL if unknown. */
+const struct cec_backend_ops *cec_backend_find(const char *name);
+
+#endif
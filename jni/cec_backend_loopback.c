@@ -0,0 +1,327 @@
+#define LOG_TAG "sunxi-hdmi-cec"
+
+#include "cec_loopback.h"
+#include "log.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+struct loopback_response {
+    int destination;
+    int opcode;
+    unsigned char reply[CEC_MESSAGE_BODY_MAX_LENGTH + 1];
+    size_t length;
+};
+
+struct loopback_backend {
+    pthread_mutex_t lock;
+    int event_fd;
+
+    hdmi_cec_event_t queue[CEC_LOOPBACK_QUEUE_SIZE];
+    unsigned int head;
+    unsigned int tail;
+
+    struct loopback_response responses[CEC_LOOPBACK_MAX_RESPONSES];
+    int response_count;
+
+    uint16_t present;
+    uint16_t physical_address;
+    int logical_address;
+    uint16_t logical_mask;
+    uint32_t rx_filter[8];
+    int rx_filter_set;
+    uint64_t filtered_count;
+    int started;
+    int fail_result;
+    int fail_count;
+    unsigned int frame_delay_us;
+
+    unsigned char last_sent[CEC_MESSAGE_BODY_MAX_LENGTH + 1];
+    size_t last_sent_length;
+    uint64_t sent_count;
+};
+
+static int inject_locked(struct loopback_backend *loopback, const hdmi_cec_event_t *event) {
+    // dropped before the HAL ever wakes up, like a driver-side filter
+    if (loopback->rx_filter_set && event->event_type == MESSAGE_TYPE_RECEIVE_SUCCESS && event->msg_len >= 2 &&
+        !(loopback->rx_filter[event->msg[1] / 32] >> (event->msg[1] % 32) & 1)) {
+        loopback->filtered_count++;
+        return 0;
+    }
+    if (loopback->tail - loopback->head >= CEC_LOOPBACK_QUEUE_SIZE) {
+        return -EAGAIN;
+    }
+    loopback->queue[loopback->tail++ % CEC_LOOPBACK_QUEUE_SIZE] = *event;
+
+    uint64_t value = 1;
+    write(loopback->event_fd, &value, sizeof(value));
+    return 0;
+}
+
+static int loopback_open(struct cec_backend *backend) {
+    struct loopback_backend *loopback = calloc(1, sizeof(*loopback));
+    if (!loopback) {
+        return -ENOMEM;
+    }
+
+    loopback->event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (loopback->event_fd < 0) {
+        int err = errno;
+        free(loopback);
+        return -err;
+    }
+
+    pthread_mutex_init(&loopback->lock, NULL);
+    loopback->present = 1 << CEC_ADDR_TV;
+    loopback->physical_address = 0x1000;
+    loopback->logical_address = CEC_ADDR_UNREGISTERED;
+
+    backend->priv = loopback;
+    return loopback->event_fd;
+}
+
+static void loopback_close(struct cec_backend *backend) {
+    struct loopback_backend *loopback = backend->priv;
+    close(loopback->event_fd);
+    pthread_mutex_destroy(&loopback->lock);
+    free(loopback);
+    backend->priv = NULL;
+}
+
+static int loopback_read_events(struct cec_backend *backend, hdmi_cec_event_t *events, int max) {
+    struct loopback_backend *loopback = backend->priv;
+    uint64_t value;
+    int count = 0;
+
+    pthread_mutex_lock(&loopback->lock);
+    read(loopback->event_fd, &value, sizeof(value));
+    while (count < max && loopback->head != loopback->tail) {
+        events[count++] = loopback->queue[loopback->head++ % CEC_LOOPBACK_QUEUE_SIZE];
+    }
+    if (loopback->head != loopback->tail) {
+        // keep the fd readable for what did not fit
+        value = 1;
+        write(loopback->event_fd, &value, sizeof(value));
+    }
+    pthread_mutex_unlock(&loopback->lock);
+    return count;
+}
+
+static int loopback_write_frame(struct cec_backend *backend, const unsigned char *frame, size_t length) {
+    struct loopback_backend *loopback = backend->priv;
+    int destination = frame[0] & 0x0f;
+    int result = HDMI_RESULT_SUCCESS;
+
+    if (loopback->frame_delay_us) {
+        usleep(loopback->frame_delay_us);
+    }
+
+    pthread_mutex_lock(&loopback->lock);
+    loopback->sent_count++;
+    memcpy(loopback->last_sent, frame, length);
+    loopback->last_sent_length = length;
+
+    if (!loopback->started) {
+        result = HDMI_RESULT_FAIL;
+    } else if (loopback->fail_count > 0) {
+        loopback->fail_count--;
+        result = loopback->fail_result;
+    } else if (destination != CEC_ADDR_BROADCAST && !(loopback->present & (1 << destination))) {
+        result = HDMI_RESULT_NACK;
+    }
+
+    if (result == HDMI_RESULT_SUCCESS && length >= 2) {
+        for (int i = 0; i < loopback->response_count; i++) {
+            struct loopback_response *response = &loopback->responses[i];
+            if (response->opcode != frame[1]) {
+                continue;
+            }
+            if (response->destination >= 0 && response->destination != destination) {
+                continue;
+            }
+
+            hdmi_cec_event_t event;
+            memset(&event, 0, sizeof(event));
+            event.event_type = MESSAGE_TYPE_RECEIVE_SUCCESS;
+            event.msg_len = response->length;
+            memcpy(event.msg, response->reply, response->length);
+            inject_locked(loopback, &event);
+        }
+    }
+    pthread_mutex_unlock(&loopback->lock);
+    return result;
+}
+
+static int loopback_set_logical_address(struct cec_backend *backend, int addr) {
+    struct loopback_backend *loopback = backend->priv;
+    if (!loopback->started) {
+        return -ENODEV;
+    }
+    loopback->logical_address = addr;
+    loopback->logical_mask = addr < CEC_ADDR_UNREGISTERED ? 1 << addr : 0;
+    return 0;
+}
+
+static int loopback_set_rx_filter(struct cec_backend *backend, const uint32_t *opcodes) {
+    struct loopback_backend *loopback = backend->priv;
+    pthread_mutex_lock(&loopback->lock);
+    memcpy(loopback->rx_filter, opcodes, sizeof(loopback->rx_filter));
+    loopback->rx_filter_set = 1;
+    pthread_mutex_unlock(&loopback->lock);
+    return 0;
+}
+
+static int loopback_set_logical_mask(struct cec_backend *backend, uint16_t mask) {
+    struct loopback_backend *loopback = backend->priv;
+    if (!loopback->started) {
+        return -ENODEV;
+    }
+    loopback->logical_mask = mask;
+    loopback->logical_address = mask ? __builtin_ctz(mask) : CEC_ADDR_UNREGISTERED;
+    return 0;
+}
+
+static int loopback_get_physical_address(struct cec_backend *backend, uint16_t *addr) {
+    struct loopback_backend *loopback = backend->priv;
+    *addr = loopback->physical_address;
+    return 0;
+}
+
+static int loopback_start(struct cec_backend *backend) {
+    struct loopback_backend *loopback = backend->priv;
+    loopback->started = 1;
+    return 0;
+}
+
+static int loopback_stop(struct cec_backend *backend) {
+    struct loopback_backend *loopback = backend->priv;
+    loopback->started = 0;
+    return 0;
+}
+
+const struct cec_backend_ops cec_backend_loopback = {
+        .name = "loopback",
+        .open = loopback_open,
+        .close = loopback_close,
+        .read_events = loopback_read_events,
+        .write_frame = loopback_write_frame,
+        .set_logical_address = loopback_set_logical_address,
+        .set_logical_mask = loopback_set_logical_mask,
+        .set_rx_filter = loopback_set_rx_filter,
+        .get_physical_address = loopback_get_physical_address,
+        .start = loopback_start,
+        .stop = loopback_stop,
+};
+
+void cec_loopback_set_present(struct cec_backend *backend, uint16_t mask) {
+    struct loopback_backend *loopback = backend->priv;
+    pthread_mutex_lock(&loopback->lock);
+    loopback->present = mask;
+    pthread_mutex_unlock(&loopback->lock);
+}
+
+void cec_loopback_set_physical_address(struct cec_backend *backend, uint16_t addr) {
+    struct loopback_backend *loopback = backend->priv;
+    loopback->physical_address = addr;
+}
+
+void cec_loopback_fail_next(struct cec_backend *backend, int result, int count) {
+    struct loopback_backend *loopback = backend->priv;
+    pthread_mutex_lock(&loopback->lock);
+    loopback->fail_result = result;
+    loopback->fail_count = count;
+    pthread_mutex_unlock(&loopback->lock);
+}
+
+void cec_loopback_set_frame_delay(struct cec_backend *backend, unsigned int delay_us) {
+    struct loopback_backend *loopback = backend->priv;
+    loopback->frame_delay_us = delay_us;
+}
+
+int cec_loopback_add_response(struct cec_backend *backend, int destination, int opcode,
+                              const unsigned char *reply, size_t length) {
+    struct loopback_backend *loopback = backend->priv;
+    if (length == 0 || length > sizeof(loopback->responses[0].reply)) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&loopback->lock);
+    if (loopback->response_count >= CEC_LOOPBACK_MAX_RESPONSES) {
+        pthread_mutex_unlock(&loopback->lock);
+        return -ENOSPC;
+    }
+    struct loopback_response *response = &loopback->responses[loopback->response_count++];
+    response->destination = destination;
+    response->opcode = opcode;
+    memcpy(response->reply, reply, length);
+    response->length = length;
+    pthread_mutex_unlock(&loopback->lock);
+    return 0;
+}
+
+void cec_loopback_clear_responses(struct cec_backend *backend) {
+    struct loopback_backend *loopback = backend->priv;
+    pthread_mutex_lock(&loopback->lock);
+    loopback->response_count = 0;
+    pthread_mutex_unlock(&loopback->lock);
+}
+
+int cec_loopback_inject(struct cec_backend *backend, const hdmi_cec_event_t *event) {
+    struct loopback_backend *loopback = backend->priv;
+    pthread_mutex_lock(&loopback->lock);
+    int ret = inject_locked(loopback, event);
+    pthread_mutex_unlock(&loopback->lock);
+    return ret;
+}
+
+int cec_loopback_inject_frame(struct cec_backend *backend, const unsigned char *frame, size_t length) {
+    hdmi_cec_event_t event;
+    if (length == 0 || length > sizeof(event.msg)) {
+        return -EINVAL;
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.event_type = MESSAGE_TYPE_RECEIVE_SUCCESS;
+    event.msg_len = length;
+    memcpy(event.msg, frame, length);
+    return cec_loopback_inject(backend, &event);
+}
+
+size_t cec_loopback_last_sent(struct cec_backend *backend, unsigned char *frame) {
+    struct loopback_backend *loopback = backend->priv;
+    pthread_mutex_lock(&loopback->lock);
+    size_t length = loopback->last_sent_length;
+    memcpy(frame, loopback->last_sent, length);
+    pthread_mutex_unlock(&loopback->lock);
+    return length;
+}
+
+uint64_t cec_loopback_sent_count(struct cec_backend *backend) {
+    struct loopback_backend *loopback = backend->priv;
+    pthread_mutex_lock(&loopback->lock);
+    uint64_t count = loopback->sent_count;
+    pthread_mutex_unlock(&loopback->lock);
+    return count;
+}
+
+int cec_loopback_logical_address(struct cec_backend *backend) {
+    struct loopback_backend *loopback = backend->priv;
+    return loopback->logical_address;
+}
+
+uint16_t cec_loopback_logical_mask(struct cec_backend *backend) {
+    struct loopback_backend *loopback = backend->priv;
+    return loopback->logical_mask;
+}
+
+uint64_t cec_loopback_filtered_count(struct cec_backend *backend) {
+    struct loopback_backend *loopback = backend->priv;
+    pthread_mutex_lock(&loopback->lock);
+    uint64_t count = loopback->filtered_count;
+    pthread_mutex_unlock(&loopback->lock);
+    return count;
+}
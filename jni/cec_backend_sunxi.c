@@ -0,0 +1,159 @@
+#define LOG_TAG "sunxi-hdmi-cec"
+
+#include "cec_backend.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define HDMICEC_IOC_MAGIC  'H'
+#define HDMICEC_IOC_SETLOGICALADDRESS _IOW(HDMICEC_IOC_MAGIC,  1, unsigned char)
+#define HDMICEC_IOC_STARTDEVICE _IO(HDMICEC_IOC_MAGIC,  2)
+#define HDMICEC_IOC_STOPDEVICE  _IO(HDMICEC_IOC_MAGIC,  3)
+#define HDMICEC_IOC_GETPHYADDRESS _IOR(HDMICEC_IOC_MAGIC,  4, unsigned char[4])
+#define HDMICEC_IOC_SETLOGICALMASK _IOW(HDMICEC_IOC_MAGIC,  5, unsigned short)
+#define HDMICEC_IOC_SETRXFILTER _IOW(HDMICEC_IOC_MAGIC,  6, uint32_t[8])
+
+#define CEC_SUNXI_PATH "/dev/sunxi_hdmi_cec"
+#define CEC_SUNXI_READ_BATCH 16
+
+struct sunxi_backend {
+    int fd;
+    struct iovec iov[CEC_SUNXI_READ_BATCH];
+};
+
+static int sunxi_open(struct cec_backend *backend) {
+    struct sunxi_backend *sunxi = calloc(1, sizeof(*sunxi));
+    if (!sunxi) {
+        return -ENOMEM;
+    }
+
+    // Non-blocking so that the batched read stops at the first empty slot.
+    sunxi->fd = open(CEC_SUNXI_PATH, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (sunxi->fd < 0) {
+        int err = errno;
+        ALOGE("unable to open device: %d", err);
+        free(sunxi);
+        return -err;
+    }
+
+    backend->priv = sunxi;
+    return sunxi->fd;
+}
+
+static void sunxi_close(struct cec_backend *backend) {
+    struct sunxi_backend *sunxi = backend->priv;
+    close(sunxi->fd);
+    free(sunxi);
+    backend->priv = NULL;
+}
+
+static int sunxi_read_events(struct cec_backend *backend, hdmi_cec_event_t *events, int max) {
+    struct sunxi_backend *sunxi = backend->priv;
+    if (max > CEC_SUNXI_READ_BATCH) {
+        max = CEC_SUNXI_READ_BATCH;
+    }
+
+    // readv() falls back to one read per record for drivers that return a
+    // single record per read, and stops at the first EAGAIN, so a single
+    // syscall returns the whole backlog.
+    for (int i = 0; i < max; i++) {
+        sunxi->iov[i].iov_base = &events[i];
+        sunxi->iov[i].iov_len = sizeof(events[i]);
+    }
+
+    ssize_t ret = readv(sunxi->fd, sunxi->iov, max);
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -errno;
+    } else if (ret == 0) {
+        return -ENODEV;
+    }
+    return (ret + sizeof(hdmi_cec_event_t) - 1) / sizeof(hdmi_cec_event_t);
+}
+
+static int sunxi_write_frame(struct cec_backend *backend, const unsigned char *frame, size_t length) {
+    struct sunxi_backend *sunxi = backend->priv;
+
+    // The driver's write returns once the frame is on the wire; errno is
+    // left as the driver set it for the caller to log.
+    if (write(sunxi->fd, frame, length) >= 0) {
+        return HDMI_RESULT_SUCCESS;
+    }
+    switch (errno) {
+        case EIO:       // not acknowledged
+            return HDMI_RESULT_NACK;
+        case EBUSY:     // line busy or arbitration lost
+        case EAGAIN:    // transmitter still busy with another frame
+            return HDMI_RESULT_BUSY;
+        default:
+            return HDMI_RESULT_FAIL;
+    }
+}
+
+static int sunxi_set_logical_address(struct cec_backend *backend, int addr) {
+    struct sunxi_backend *sunxi = backend->priv;
+    if (ioctl(sunxi->fd, HDMICEC_IOC_SETLOGICALADDRESS, addr) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+static int sunxi_set_logical_mask(struct cec_backend *backend, uint16_t mask) {
+    struct sunxi_backend *sunxi = backend->priv;
+    unsigned short value = mask;
+    if (ioctl(sunxi->fd, HDMICEC_IOC_SETLOGICALMASK, &value) < 0) {
+        // older drivers reject the unknown ioctl with one of these
+        return errno == EINVAL || errno == ENOTTY ? -ENOTTY : -errno;
+    }
+    return 0;
+}
+
+static int sunxi_set_rx_filter(struct cec_backend *backend, const uint32_t *opcodes) {
+    struct sunxi_backend *sunxi = backend->priv;
+    if (ioctl(sunxi->fd, HDMICEC_IOC_SETRXFILTER, opcodes) < 0) {
+        return errno == EINVAL || errno == ENOTTY ? -ENOTTY : -errno;
+    }
+    return 0;
+}
+
+static int sunxi_get_physical_address(struct cec_backend *backend, uint16_t *addr) {
+    struct sunxi_backend *sunxi = backend->priv;
+    if (ioctl(sunxi->fd, HDMICEC_IOC_GETPHYADDRESS, addr) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+static int sunxi_start(struct cec_backend *backend) {
+    struct sunxi_backend *sunxi = backend->priv;
+    if (ioctl(sunxi->fd, HDMICEC_IOC_STARTDEVICE, NULL) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+static int sunxi_stop(struct cec_backend *backend) {
+    struct sunxi_backend *sunxi = backend->priv;
+    if (ioctl(sunxi->fd, HDMICEC_IOC_STOPDEVICE, NULL) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+const struct cec_backend_ops cec_backend_sunxi = {
+        .name = "sunxi",
+        .open = sunxi_open,
+        .close = sunxi_close,
+        .read_events = sunxi_read_events,
+        .write_frame = sunxi_write_frame,
+        .set_logical_address = sunxi_set_logical_address,
+        .set_logical_mask = sunxi_set_logical_mask,
+        .set_rx_filter = sunxi_set_rx_filter,
+        .get_physical_address = sunxi_get_physical_address,
+        .start = sunxi_start,
+        .stop = sunxi_stop,
+};
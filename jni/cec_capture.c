@@ -0,0 +1,110 @@
+#include "cec_capture.h"
+#include "cec_seqlock.h"
+#include "cec_stats.h"
+#include "log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// the file format must not change with the compiler
+_Static_assert(sizeof(struct cec_capture_header) == 64, "capture header size");
+_Static_assert(sizeof(struct cec_capture_record) == 40, "capture record size");
+
+int cec_capture_open(struct cec_capture *capture, const char *path, unsigned int records) {
+    unsigned int capacity = 1;
+    while (capacity < records) {
+        capacity <<= 1;
+    }
+    size_t size = sizeof(struct cec_capture_header) + (size_t) capacity * sizeof(struct cec_capture_record);
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (fd < 0) {
+        return -errno;
+    }
+    if (ftruncate(fd, size) < 0) {
+        int err = errno;
+        close(fd);
+        return -err;
+    }
+    // Blocks are allocated now: a sparse file would allocate on the first
+    // store to each page, or raise SIGBUS there once the disk is full.
+    int err = posix_fallocate(fd, 0, size);
+    if (err != 0) {
+        close(fd);
+        return -err;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -errno;
+    }
+    // Keeps the pages from being reclaimed and faulted back in; without
+    // the privilege this is best effort.
+    if (mlock(map, size) < 0) {
+        ALOGW("cec_capture_open: unable to lock %zu bytes: %d", size, errno);
+    }
+
+    // The file is fresh, so the records start out zeroed (incomplete).
+    struct cec_capture_header *header = map;
+    memcpy(header->magic, CEC_CAPTURE_MAGIC, sizeof(header->magic));
+    header->version = CEC_CAPTURE_VERSION;
+    header->record_size = sizeof(struct cec_capture_record);
+    header->capacity = capacity;
+    header->start_ns = cec_now_ns();
+    atomic_store_explicit(&header->next, 0, memory_order_relaxed);
+
+    capture->header = header;
+    capture->records = (struct cec_capture_record *) (header + 1);
+    capture->size = size;
+    atomic_store_explicit(&capture->enabled, 1, memory_order_release);
+    return 0;
+}
+
+void cec_capture_close(struct cec_capture *capture) {
+    if (!capture->header) {
+        return;
+    }
+    atomic_store_explicit(&capture->enabled, 0, memory_order_relaxed);
+    munmap(capture->header, capture->size);
+    capture->header = NULL;
+    capture->records = NULL;
+}
+
+void cec_capture_add(struct cec_capture *capture, int kind, int event_type, const unsigned char *frame,
+                     size_t length, int result) {
+    if (!atomic_load_explicit(&capture->enabled, memory_order_acquire)) {
+        return;
+    }
+
+    struct cec_capture_header *header = capture->header;
+    uint64_t index = atomic_fetch_add_explicit(&header->next, 1, memory_order_relaxed);
+    struct cec_capture_record *record = &capture->records[index & (header->capacity - 1)];
+
+    cec_seqlock_slot_begin(&record->sequence, index);
+
+    if (length > sizeof(record->frame)) {
+        length = sizeof(record->frame);
+    }
+    record->kind = kind;
+    record->event_type = event_type;
+    record->length = length;
+    record->result = result;
+    record->ns = cec_now_ns();
+    memcpy(record->frame, frame, length);
+
+    cec_seqlock_slot_end(&record->sequence, index);
+}
+
+int cec_capture_read(const struct cec_capture_header *header, const struct cec_capture_record *records,
+                     uint64_t index, struct cec_capture_record *record) {
+    const struct cec_capture_record *slot = &records[index & (header->capacity - 1)];
+
+    if (!cec_seqlock_slot_ready(&slot->sequence, index)) {
+        return 0;
+    }
+    memcpy(record, slot, sizeof(*record));
+    return !cec_seqlock_slot_retry(&slot->sequence, index);
+}
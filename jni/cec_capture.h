@@ -0,0 +1,66 @@
+#ifndef SUNXI_HDMI_CEC_CAPTURE_H
+#define SUNXI_HDMI_CEC_CAPTURE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bus capture into a memory-mapped ring file. Appending a record is one
+ * atomic add and a 40-byte copy into the page cache, and the kernel writes
+ * the file back on its own. The file is allocated, faulted in and locked
+ * when opened, so appends take no page faults; a store to a page that is
+ * being written back can still wait for that I/O on filesystems that need
+ * stable pages. The file is read back by host/cec_replay.c.
+ */
+
+#define CEC_CAPTURE_MAGIC "CECCAP01"
+#define CEC_CAPTURE_VERSION 1
+#define CEC_CAPTURE_DEFAULT_RECORDS 65536
+
+enum cec_capture_kind {
+    CEC_CAPTURE_RX = 1,         /* driver record as read: hdmi_cec_event_t */
+    CEC_CAPTURE_TX = 2,         /* frame we transmitted and its HDMI_RESULT_* */
+};
+
+struct cec_capture_record {
+    atomic_uint sequence;       /* 2 * (index + 1) once complete */
+    uint8_t kind;
+    uint8_t event_type;         /* MESSAGE_TYPE_* for RX */
+    uint8_t length;             /* bytes used in frame */
+    int8_t result;              /* HDMI_RESULT_* for TX */
+    uint64_t ns;                /* CLOCK_MONOTONIC */
+    uint8_t frame[17];          /* header + body */
+    uint8_t reserved[7];
+};
+
+struct cec_capture_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t capacity;          /* records; a power of two */
+    uint32_t reserved;
+    atomic_uint_least64_t next; /* records ever appended */
+    uint64_t start_ns;          /* CLOCK_MONOTONIC when capture started */
+    uint8_t padding[24];
+};
+
+struct cec_capture {
+    struct cec_capture_header *header;
+    struct cec_capture_record *records;
+    size_t size;
+    atomic_int enabled;
+};
+
+/* Maps a fresh capture file of records entries (rounded up to a power of two). */
+int cec_capture_open(struct cec_capture *capture, const char *path, unsigned int records);
+void cec_capture_close(struct cec_capture *capture);
+
+void cec_capture_add(struct cec_capture *capture, int kind, int event_type, const unsigned char *frame,
+                     size_t length, int result);
+
+/* Copies record index out if it is complete and not yet overwritten. */
+int cec_capture_read(const struct cec_capture_header *header, const struct cec_capture_record *records,
+                     uint64_t index, struct cec_capture_record *record);
+
+#endif
@@ -0,0 +1,145 @@
+#include "cec_coalesce.h"
+#include "cec_config.h"
+#include "cec_filter.h"
+#include "cec_stats.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void cec_coalesce_init(struct cec_coalesce *coalesce) {
+    memset(coalesce, 0, sizeof(*coalesce));
+    long window_ms = cec_config_get_int("ro.hdmi.cec.rx_dedup_ms", CEC_COALESCE_DEDUP_MS);
+    long hold_ms = cec_config_get_int("ro.hdmi.cec.rx_key_hold_ms", CEC_COALESCE_KEY_HOLD_MS);
+    coalesce->window_ns = window_ms > 0 ? window_ms * 1000000ULL : 0;
+    // past the timeout the framework would release the key in between
+    if (hold_ms >= CEC_COALESCE_KEY_TIMEOUT_MS) {
+        hold_ms = CEC_COALESCE_KEY_HOLD_MS;
+    }
+    coalesce->key_hold_ns = hold_ms > 0 ? hold_ms * 1000000ULL : 0;
+}
+
+void cec_coalesce_forget(struct cec_coalesce *coalesce, int address) {
+    for (int i = 0; i < CEC_ADDR_BROADCAST; i++) {
+        if (address < 0 || address == i) {
+            atomic_fetch_add_explicit(&coalesce->generation[i], 1, memory_order_relaxed);
+        }
+    }
+}
+
+// A press is merged while it repeats the held key and the next one is
+// expected early enough for the framework's release timeout.
+static int key_event(struct cec_coalesce *coalesce, int initiator, const unsigned char *body, size_t length,
+                     uint64_t now_ns) {
+    if (body[0] == CEC_MESSAGE_USER_CONTROL_RELEASED) {
+        coalesce->key_held = 0;
+        return 1;
+    }
+
+    uint64_t gap = now_ns - coalesce->key_press_ns;
+    if (coalesce->key_held && coalesce->key_initiator == initiator && coalesce->key_length == length &&
+        !memcmp(coalesce->key_body, body, length) && gap < CEC_COALESCE_KEY_TIMEOUT_MS * 1000000ULL) {
+        coalesce->key_press_ns = now_ns;
+        if (now_ns - coalesce->key_delivered_ns + gap < coalesce->key_hold_ns) {
+            cec_counter_add(&coalesce->key_repeats, 1);
+            return 0;
+        }
+        coalesce->key_delivered_ns = now_ns;
+        return 1;
+    }
+
+    coalesce->key_held = 1;
+    coalesce->key_initiator = initiator;
+    coalesce->key_length = length;
+    memcpy(coalesce->key_body, body, length);
+    coalesce->key_press_ns = coalesce->key_delivered_ns = now_ns;
+    return 1;
+}
+
+static void forget_routing(struct cec_coalesce *coalesce) {
+    for (int initiator = 0; initiator < CEC_ADDR_BROADCAST; initiator++) {
+        for (int i = 0; i < CEC_COALESCE_SLOTS; i++) {
+            struct cec_coalesce_report *report = &coalesce->reports[initiator][i];
+            if (report->ns && cec_opcode_table[report->body[0]].flags & CEC_OPCODE_ROUTING) {
+                report->ns = 0;
+            }
+        }
+    }
+}
+
+static int report_event(struct cec_coalesce *coalesce, int initiator, int destination,
+                        const unsigned char *body, size_t length, uint64_t now_ns) {
+    struct cec_coalesce_report *reports = coalesce->reports[initiator];
+    unsigned int generation = atomic_load_explicit(&coalesce->generation[initiator], memory_order_relaxed);
+
+    // One slot per kind of report so that the newest one is compared.
+    struct cec_coalesce_report *slot = NULL;
+    struct cec_coalesce_report *oldest = &reports[0];
+    for (int i = 0; i < CEC_COALESCE_SLOTS && !slot; i++) {
+        if (reports[i].ns && reports[i].body[0] == body[0] && reports[i].destination == destination) {
+            slot = &reports[i];
+        } else if (reports[i].ns < oldest->ns) {
+            oldest = &reports[i];
+        }
+    }
+
+    if (slot && slot->generation == generation && now_ns - slot->ns < coalesce->window_ns &&
+        slot->length == length && !memcmp(slot->body, body, length)) {
+        cec_counter_add(&coalesce->duplicates, 1);
+        return 0;
+    }
+
+    // A new active source makes every earlier routing report stale.
+    if (cec_opcode_table[body[0]].flags & CEC_OPCODE_ROUTING) {
+        forget_routing(coalesce);
+    }
+    if (!slot) {
+        slot = oldest;
+    }
+    slot->ns = now_ns;
+    slot->generation = generation;
+    slot->destination = destination;
+    slot->length = length;
+    memcpy(slot->body, body, length);
+    return 1;
+}
+
+int cec_coalesce_rx(struct cec_coalesce *coalesce, int initiator, int destination,
+                    const unsigned char *body, size_t length, uint64_t now_ns) {
+    int deliver = 1;
+    int flags = cec_opcode_table[body[0]].flags;
+
+    if (initiator < 0 || initiator >= CEC_ADDR_BROADCAST || length > CEC_MESSAGE_BODY_MAX_LENGTH) {
+        // nothing to compare with
+    } else if (body[0] == CEC_MESSAGE_USER_CONTROL_PRESSED || body[0] == CEC_MESSAGE_USER_CONTROL_RELEASED) {
+        deliver = !coalesce->key_hold_ns || key_event(coalesce, initiator, body, length, now_ns);
+    } else if (flags & CEC_OPCODE_REPORT) {
+        deliver = !coalesce->window_ns || report_event(coalesce, initiator, destination, body, length, now_ns);
+    } else if (flags & CEC_OPCODE_ROUTING) {
+        forget_routing(coalesce);
+    }
+
+    if (deliver) {
+        cec_counter_add(&coalesce->delivered, 1);
+    } else {
+        cec_counter_add(&coalesce->suppressed[body[0]], 1);
+    }
+    return deliver;
+}
+
+void cec_coalesce_dump(struct cec_coalesce *coalesce, int fd, uint64_t callback_ns) {
+    uint64_t duplicates = cec_counter_get(&coalesce->duplicates);
+    uint64_t key_repeats = cec_counter_get(&coalesce->key_repeats);
+    uint64_t saved = duplicates + key_repeats;
+    dprintf(fd, "rx coalesce: window_ms=%llu key_hold_ms=%llu delivered=%llu duplicates=%llu key_repeats=%llu "
+                "saved_callback_us=%llu\n",
+            (unsigned long long) (coalesce->window_ns / 1000000),
+            (unsigned long long) (coalesce->key_hold_ns / 1000000),
+            (unsigned long long) cec_counter_get(&coalesce->delivered), (unsigned long long) duplicates,
+            (unsigned long long) key_repeats, (unsigned long long) (saved * callback_ns / 1000));
+    for (int opcode = 0; opcode < 256; opcode++) {
+        uint64_t count = cec_counter_get(&coalesce->suppressed[opcode]);
+        if (count) {
+            dprintf(fd, "  suppressed %02x: %llu\n", opcode, (unsigned long long) count);
+        }
+    }
+}
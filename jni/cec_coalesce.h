@@ -0,0 +1,79 @@
+#ifndef SUNXI_HDMI_CEC_COALESCE_H
+#define SUNXI_HDMI_CEC_COALESCE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <hardware/hdmi_cec.h>
+
+/*
+ * Last stage of the receive path before the framework callback. A report
+ * identical to the last one delivered from the same device, within the
+ * window, is not delivered again; neither are auto-repeated presses of a
+ * held key beyond what keeps the framework's release timeout from firing.
+ * Anything that differs from what was delivered goes through, so no state
+ * change is ever lost. Loop thread only, except cec_coalesce_forget().
+ *
+ *   ro.hdmi.cec.rx_dedup_ms      duplicate window (default 500, 0 disables)
+ *   ro.hdmi.cec.rx_key_hold_ms   longest gap between delivered presses of a
+ *                                held key (default 450, 0 delivers them all)
+ */
+
+#define CEC_COALESCE_DEDUP_MS 500
+#define CEC_COALESCE_KEY_HOLD_MS 450
+#define CEC_COALESCE_KEY_TIMEOUT_MS 550     /* CEC follower release timeout */
+#define CEC_COALESCE_SLOTS 8                /* remembered reports per initiator */
+
+struct cec_coalesce_report {
+    uint64_t ns;            /* 0 if unused */
+    unsigned int generation;
+    uint8_t destination;
+    uint8_t length;
+    unsigned char body[CEC_MESSAGE_BODY_MAX_LENGTH];
+};
+
+struct cec_coalesce {
+    uint64_t window_ns;
+    uint64_t key_hold_ns;
+
+    struct cec_coalesce_report reports[CEC_ADDR_BROADCAST][CEC_COALESCE_SLOTS];
+    /* bumped to invalidate what was delivered from an initiator */
+    atomic_uint generation[CEC_ADDR_BROADCAST];
+
+    /* the key the framework was told is down */
+    int key_held;
+    int key_initiator;
+    uint8_t key_length;
+    unsigned char key_body[CEC_MESSAGE_BODY_MAX_LENGTH];
+    uint64_t key_press_ns;      /* last press received */
+    uint64_t key_delivered_ns;  /* last press delivered */
+
+    /* written by the loop thread, read by any */
+    atomic_ullong delivered;
+    atomic_ullong duplicates;
+    atomic_ullong key_repeats;
+    atomic_ullong suppressed[256];
+};
+
+void cec_coalesce_init(struct cec_coalesce *coalesce);
+
+/*
+ * Decides whether a received frame (opcode + operands) reaches the
+ * framework. Returns 1 to deliver it, 0 if it adds nothing.
+ */
+int cec_coalesce_rx(struct cec_coalesce *coalesce, int initiator, int destination,
+                    const unsigned char *body, size_t length, uint64_t now_ns);
+
+/*
+ * Forgets what was delivered from address (-1 for everyone), so that its
+ * next reports go through even if unchanged. Called when we ask a device
+ * for something, since the framework then waits for an answer. Safe from
+ * any thread.
+ */
+void cec_coalesce_forget(struct cec_coalesce *coalesce, int address);
+
+/* callback_ns, the mean callback time, estimates the time saved. */
+void cec_coalesce_dump(struct cec_coalesce *coalesce, int fd, uint64_t callback_ns);
+
+#endif
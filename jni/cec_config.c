@@ -0,0 +1,26 @@
+#include "cec_config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int cec_config_get(const char *key, char *value, const char *default_value) {
+    int length = __system_property_get(key, value);
+    if (length > 0) {
+        return length;
+    }
+
+    strncpy(value, default_value, PROP_VALUE_MAX - 1);
+    value[PROP_VALUE_MAX - 1] = 0;
+    return strlen(value);
+}
+
+long cec_config_get_int(const char *key, long default_value) {
+    char value[PROP_VALUE_MAX];
+    if (__system_property_get(key, value) <= 0) {
+        return default_value;
+    }
+
+    char *end;
+    long result = strtol(value, &end, 0);
+    return end == value ? default_value : result;
+}
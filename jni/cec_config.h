@@ -0,0 +1,16 @@
+#ifndef SUNXI_HDMI_CEC_CONFIG_H
+#define SUNXI_HDMI_CEC_CONFIG_H
+
+#include <sys/system_properties.h>
+
+/*
+ * Per-product configuration read from system properties.
+ */
+
+/* Copies the property into value (PROP_VALUE_MAX bytes) or default_value if unset. */
+int cec_config_get(const char *key, char *value, const char *default_value);
+
+/* Parses the property as an integer (any base strtol accepts). */
+long cec_config_get_int(const char *key, long default_value);
+
+#endif
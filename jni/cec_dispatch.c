@@ -0,0 +1,166 @@
+#define LOG_TAG "sunxi-hdmi-cec"
+
+#include "cec_dispatch.h"
+#include "cec_stats.h"
+#include "log.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#define SLOW_CALLBACK_NS (10 * 1000000ULL)
+
+static int ring_pop(struct cec_ring *ring, struct cec_dispatch_item *item) {
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head == tail) {
+        return 0;
+    }
+
+    *item = ring->slots[head % CEC_DISPATCH_RING_SIZE];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    return 1;
+}
+
+static int ring_empty(struct cec_ring *ring) {
+    return atomic_load(&ring->head) == atomic_load(&ring->tail);
+}
+
+static void deliver(struct cec_dispatch *dispatch, const struct cec_dispatch_item *item) {
+    uint64_t start = cec_now_ns();
+    dispatch->deliver(dispatch, item);
+    uint64_t duration = cec_now_ns() - start;
+
+    cec_counter_add(&dispatch->callbacks, 1);
+    cec_counter_add(&dispatch->callback_ns_total, duration);
+    if (duration > cec_counter_get(&dispatch->callback_ns_max)) {
+        atomic_store_explicit(&dispatch->callback_ns_max, duration, memory_order_relaxed);
+    }
+    if (duration > SLOW_CALLBACK_NS) {
+        cec_counter_add(&dispatch->slow_callbacks, 1);
+    }
+}
+
+static int is_stopped(struct cec_dispatch *dispatch) {
+    return atomic_load_explicit(&dispatch->stopped, memory_order_acquire);
+}
+
+static void *dispatch_thread(void *arg) {
+    struct cec_dispatch *dispatch = arg;
+    struct cec_dispatch_item item;
+
+    cec_sched_apply(dispatch->sched);
+    while (!is_stopped(dispatch)) {
+        int busy = 0;
+
+        // Received frames first: TX status is never time critical.
+        while (!is_stopped(dispatch) && ring_pop(&dispatch->rx, &item)) {
+            deliver(dispatch, &item);
+            busy = 1;
+        }
+        if (!is_stopped(dispatch) && ring_pop(&dispatch->tx, &item)) {
+            deliver(dispatch, &item);
+            busy = 1;
+        }
+        if (busy) {
+            continue;
+        }
+
+        // Announce that we are about to sleep, then re-check so a push
+        // racing with us either sees the flag or is seen here.
+        atomic_store(&dispatch->sleeping, 1);
+        if (!ring_empty(&dispatch->rx) || !ring_empty(&dispatch->tx) || is_stopped(dispatch)) {
+            atomic_store(&dispatch->sleeping, 0);
+            continue;
+        }
+
+        uint64_t value;
+        if (read(dispatch->wake_fd, &value, sizeof(value)) < 0 && errno != EINTR) {
+            ALOGW("dispatch_thread: wait failed: %d", errno);
+        }
+        atomic_store(&dispatch->sleeping, 0);
+    }
+    return NULL;
+}
+
+static void wake(struct cec_dispatch *dispatch) {
+    uint64_t value = 1;
+    if (write(dispatch->wake_fd, &value, sizeof(value)) < 0) {
+        ALOGW("cec_dispatch: wake failed: %d", errno);
+    }
+}
+
+int cec_dispatch_start(struct cec_dispatch *dispatch, cec_dispatch_deliver_t deliver, void *arg,
+                       struct cec_sched *sched) {
+    memset(dispatch, 0, sizeof(*dispatch));
+    dispatch->deliver = deliver;
+    dispatch->arg = arg;
+    dispatch->sched = sched;
+
+    dispatch->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (dispatch->wake_fd < 0) {
+        ALOGE("cec_dispatch_start: eventfd failed: %d", errno);
+        return -errno;
+    }
+
+    int ret = pthread_create(&dispatch->thread, NULL, dispatch_thread, dispatch);
+    if (ret != 0) {
+        ALOGE("cec_dispatch_start: unable to start thread: %d", ret);
+        close(dispatch->wake_fd);
+        return -ret;
+    }
+
+    dispatch->running = 1;
+    return 0;
+}
+
+void cec_dispatch_stop(struct cec_dispatch *dispatch) {
+    if (!dispatch->running) {
+        return;
+    }
+
+    atomic_store_explicit(&dispatch->stopped, 1, memory_order_release);
+    wake(dispatch);
+    pthread_join(dispatch->thread, NULL);
+    close(dispatch->wake_fd);
+    dispatch->running = 0;
+}
+
+int cec_dispatch_push(struct cec_dispatch *dispatch, struct cec_ring *ring, const hdmi_event_t *event,
+                      uint64_t stamp_ns) {
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    unsigned int used = tail - head;
+
+    if (used >= CEC_DISPATCH_RING_SIZE) {
+        cec_counter_add(&ring->overflows, 1);
+        return -ENOSPC;
+    }
+
+    ring->slots[tail % CEC_DISPATCH_RING_SIZE].event = *event;
+    ring->slots[tail % CEC_DISPATCH_RING_SIZE].stamp_ns = stamp_ns;
+    // sequentially consistent, pairs with the sleeping flag below
+    atomic_store(&ring->tail, tail + 1);
+
+    if (used + 1 > atomic_load_explicit(&ring->high_water, memory_order_relaxed)) {
+        atomic_store_explicit(&ring->high_water, used + 1, memory_order_relaxed);
+    }
+
+    // Only pay for the syscall when the dispatcher is actually asleep.
+    if (atomic_exchange(&dispatch->sleeping, 0)) {
+        wake(dispatch);
+    }
+    return 0;
+}
+
+void cec_dispatch_get_stats(struct cec_dispatch *dispatch, struct sunxi_cec_dispatch_stats *stats) {
+    stats->rx_overflows = cec_counter_get(&dispatch->rx.overflows);
+    stats->rx_high_water = atomic_load_explicit(&dispatch->rx.high_water, memory_order_relaxed);
+    stats->tx_overflows = cec_counter_get(&dispatch->tx.overflows);
+    stats->tx_high_water = atomic_load_explicit(&dispatch->tx.high_water, memory_order_relaxed);
+    stats->callbacks = cec_counter_get(&dispatch->callbacks);
+    stats->callback_ns_total = cec_counter_get(&dispatch->callback_ns_total);
+    stats->callback_ns_max = cec_counter_get(&dispatch->callback_ns_max);
+    stats->slow_callbacks = cec_counter_get(&dispatch->slow_callbacks);
+}
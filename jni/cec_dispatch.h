@@ -0,0 +1,77 @@
+#ifndef SUNXI_HDMI_CEC_DISPATCH_H
+#define SUNXI_HDMI_CEC_DISPATCH_H
+
+#include <hardware/hdmi_cec.h>
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "cec_sched.h"
+#include "sunxi_cec.h"
+
+/*
+ * Hands fully built events from the I/O threads to a dispatcher thread
+ * that runs the framework callback, so a slow callback never stalls
+ * reading from the device.
+ *
+ * Each producer thread owns one single-producer/single-consumer ring;
+ * pushing never blocks and never allocates.
+ */
+
+#define CEC_DISPATCH_RING_SIZE 64   /* power of two */
+
+struct cec_dispatch_item {
+    hdmi_event_t event;
+    uint64_t stamp_ns;  /* when the producer got hold of the event */
+};
+
+struct cec_ring {
+    struct cec_dispatch_item slots[CEC_DISPATCH_RING_SIZE];
+    atomic_uint head;   /* next slot to consume */
+    atomic_uint tail;   /* next slot to fill */
+    /* written by the producer, read by any */
+    atomic_ullong overflows;
+    atomic_uint high_water;
+};
+
+struct cec_dispatch;
+
+/* Runs the callback for one event on the dispatcher thread. */
+typedef void (*cec_dispatch_deliver_t)(struct cec_dispatch *dispatch, const struct cec_dispatch_item *item);
+
+struct cec_dispatch {
+    struct cec_ring rx;     /* produced by the processing thread */
+    struct cec_ring tx;     /* produced by the TX thread */
+
+    int wake_fd;
+    atomic_int sleeping;
+    atomic_int stopped;     /* set by cec_dispatch_stop */
+    pthread_t thread;
+    int running;
+
+    cec_dispatch_deliver_t deliver;
+    void *arg;
+    struct cec_sched *sched;
+
+    /* written by the dispatcher thread, read by any */
+    atomic_ullong callbacks;
+    atomic_ullong callback_ns_total;
+    atomic_ullong callback_ns_max;
+    atomic_ullong slow_callbacks;
+};
+
+/* sched (may be NULL) is applied by the dispatcher thread when it starts. */
+int cec_dispatch_start(struct cec_dispatch *dispatch, cec_dispatch_deliver_t deliver, void *arg,
+                       struct cec_sched *sched);
+void cec_dispatch_stop(struct cec_dispatch *dispatch);
+
+/*
+ * Queues an event on a ring; call it only from that ring's producer thread.
+ * Returns 0 or -ENOSPC when the ring is full and the event was dropped.
+ */
+int cec_dispatch_push(struct cec_dispatch *dispatch, struct cec_ring *ring, const hdmi_event_t *event,
+                      uint64_t stamp_ns);
+
+void cec_dispatch_get_stats(struct cec_dispatch *dispatch, struct sunxi_cec_dispatch_stats *stats);
+
+#endif
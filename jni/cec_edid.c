@@ -0,0 +1,138 @@
+#include "cec_edid.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CEA_EXTENSION_TAG 0x02
+#define CEA_DATA_BLOCK_VENDOR 3
+#define HDMI_OUI 0x000c03
+
+static const uint8_t edid_header[8] = {0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00};
+
+static int block_checksum_ok(const uint8_t *block) {
+    uint8_t sum = 0;
+    for (int i = 0; i < CEC_EDID_BLOCK_SIZE; i++) {
+        sum += block[i];
+    }
+    return sum == 0;
+}
+
+static int parse_cea_block(const uint8_t *block, uint16_t *addr) {
+    // Data block collection runs from byte 4 up to the detailed timings.
+    int end = block[2];
+    if (end < 4 || end > CEC_EDID_BLOCK_SIZE - 1) {
+        return -ENOENT;
+    }
+
+    for (int offset = 4; offset < end;) {
+        int tag = block[offset] >> 5;
+        int length = block[offset] & 0x1f;
+        const uint8_t *payload = block + offset + 1;
+
+        if (offset + 1 + length > end) {
+            return -EINVAL;
+        }
+        if (tag == CEA_DATA_BLOCK_VENDOR && length >= 5 &&
+            (payload[0] | payload[1] << 8 | payload[2] << 16) == HDMI_OUI) {
+            *addr = payload[3] << 8 | payload[4];
+            return 0;
+        }
+        offset += 1 + length;
+    }
+    return -ENOENT;
+}
+
+int cec_edid_parse_physical_address(const uint8_t *edid, size_t length, uint16_t *addr) {
+    if (length < CEC_EDID_BLOCK_SIZE || memcmp(edid, edid_header, sizeof(edid_header)) != 0) {
+        return -EINVAL;
+    }
+
+    size_t blocks = 1 + edid[126];
+    if (blocks > length / CEC_EDID_BLOCK_SIZE) {
+        blocks = length / CEC_EDID_BLOCK_SIZE;
+    }
+
+    for (size_t i = 1; i < blocks; i++) {
+        const uint8_t *block = edid + i * CEC_EDID_BLOCK_SIZE;
+        if (block[0] != CEA_EXTENSION_TAG || block[1] < 3 || !block_checksum_ok(block)) {
+            continue;
+        }
+        if (parse_cea_block(block, addr) == 0) {
+            return 0;
+        }
+    }
+    return -ENOENT;
+}
+
+static int hex_value(int c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = tolower(c);
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// Some kernels print the EDID as hex dump; the separators are ignored.
+static size_t parse_hex(const char *text, size_t length, uint8_t *edid, size_t max) {
+    size_t count = 0;
+    int high = -1;
+
+    for (size_t i = 0; i < length && count < max; i++) {
+        int value = hex_value((unsigned char) text[i]);
+        if (value < 0) {
+            high = -1;
+            continue;
+        }
+        if (high < 0) {
+            high = value;
+        } else {
+            edid[count++] = high << 4 | value;
+            high = -1;
+        }
+    }
+    return count;
+}
+
+int cec_edid_read_physical_address(const char *path, uint16_t *addr) {
+    char buffer[CEC_EDID_MAX_BLOCKS * CEC_EDID_BLOCK_SIZE * 3 + 1];
+    uint8_t edid[CEC_EDID_MAX_BLOCKS * CEC_EDID_BLOCK_SIZE];
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    size_t length = 0;
+    while (length < sizeof(buffer)) {
+        ssize_t ret = read(fd, buffer + length, sizeof(buffer) - length);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            int err = -errno;
+            close(fd);
+            return err;
+        }
+        if (ret == 0) {
+            break;
+        }
+        length += ret;
+    }
+    close(fd);
+
+    if (length >= sizeof(edid_header) && memcmp(buffer, edid_header, sizeof(edid_header)) == 0) {
+        if (length > sizeof(edid)) {
+            length = sizeof(edid);
+        }
+        return cec_edid_parse_physical_address((const uint8_t *) buffer, length, addr);
+    }
+
+    length = parse_hex(buffer, length, edid, sizeof(edid));
+    return cec_edid_parse_physical_address(edid, length, addr);
+}
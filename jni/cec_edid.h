@@ -0,0 +1,26 @@
+#ifndef SUNXI_HDMI_CEC_EDID_H
+#define SUNXI_HDMI_CEC_EDID_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Physical address lookup in the sink EDID, from the HDMI vendor
+ * specific data block (IEEE OUI 00-0C-03) of a CEA-861 extension.
+ */
+
+#define CEC_EDID_BLOCK_SIZE 128
+#define CEC_EDID_MAX_BLOCKS 8
+
+#define CEC_EDID_DEFAULT_PATH "/sys/class/hdmi/hdmi/attr/edid"
+
+/* Returns 0 and the address, or -ENOENT if the EDID carries none, or -EINVAL. */
+int cec_edid_parse_physical_address(const uint8_t *edid, size_t length, uint16_t *addr);
+
+/*
+ * Reads the EDID from path, either raw or as hex text, and parses it.
+ * Returns 0 or -errno.
+ */
+int cec_edid_read_physical_address(const char *path, uint16_t *addr);
+
+#endif
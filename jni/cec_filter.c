@@ -0,0 +1,211 @@
+#include "cec_filter.h"
+#include "cec_config.h"
+#include "cec_stats.h"
+#include "log.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <hardware/hdmi_cec.h>
+
+#define D (CEC_OPCODE_KNOWN | CEC_OPCODE_DIRECTED)
+#define B (CEC_OPCODE_KNOWN | CEC_OPCODE_BROADCAST)
+#define DB (D | B)
+#define HAL CEC_OPCODE_HAL
+#define QUERY (CEC_OPCODE_HAL | CEC_OPCODE_STANDBY)
+#define WAKE CEC_OPCODE_WAKE
+#define REPORT CEC_OPCODE_REPORT
+#define ROUTE CEC_OPCODE_ROUTING
+
+/* addressing and minimum operands as in HDMI 1.4b CEC, table 7 and 8 */
+const struct cec_opcode_info cec_opcode_table[256] = {
+        [CEC_MESSAGE_FEATURE_ABORT] = {D, 2},
+        [CEC_MESSAGE_IMAGE_VIEW_ON] = {D | WAKE, 0},
+        [CEC_MESSAGE_TUNER_STEP_INCREMENT] = {D, 0},
+        [CEC_MESSAGE_TUNER_STEP_DECREMENT] = {D, 0},
+        [CEC_MESSAGE_TUNER_DEVICE_STATUS] = {D | REPORT, 1},
+        [CEC_MESSAGE_GIVE_TUNER_DEVICE_STATUS] = {D, 1},
+        [CEC_MESSAGE_RECORD_ON] = {D, 1},
+        [CEC_MESSAGE_RECORD_STATUS] = {D, 1},
+        [CEC_MESSAGE_RECORD_OFF] = {D, 0},
+        [CEC_MESSAGE_TEXT_VIEW_ON] = {D | WAKE, 0},
+        [CEC_MESSAGE_RECORD_TV_SCREEN] = {D, 0},
+        [CEC_MESSAGE_GIVE_DECK_STATUS] = {D | QUERY, 1},
+        [CEC_MESSAGE_DECK_STATUS] = {D | REPORT, 1},
+        [CEC_MESSAGE_SET_MENU_LANGUAGE] = {B | REPORT, 3},
+        [CEC_MESSAGE_CLEAR_ANALOG_TIMER] = {D, 11},
+        [CEC_MESSAGE_SET_ANALOG_TIMER] = {D, 11},
+        [CEC_MESSAGE_TIMER_STATUS] = {D, 1},
+        [CEC_MESSAGE_STANDBY] = {DB, 0},
+        [CEC_MESSAGE_PLAY] = {D, 1},
+        [CEC_MESSAGE_DECK_CONTROL] = {D, 1},
+        [CEC_MESSAGE_TIMER_CLEARED_STATUS] = {D, 1},
+        [CEC_MESSAGE_USER_CONTROL_PRESSED] = {D | HAL | WAKE, 1},
+        [CEC_MESSAGE_USER_CONTROL_RELEASED] = {D | HAL, 0},
+        [CEC_MESSAGE_GIVE_OSD_NAME] = {D | QUERY, 0},
+        [CEC_MESSAGE_SET_OSD_NAME] = {D | HAL | REPORT, 1},
+        [CEC_MESSAGE_SET_OSD_STRING] = {D, 1},
+        [CEC_MESSAGE_SET_TIMER_PROGRAM_TITLE] = {D, 1},
+        [CEC_MESSAGE_SYSTEM_AUDIO_MODE_REQUEST] = {D, 0},
+        [CEC_MESSAGE_GIVE_AUDIO_STATUS] = {D, 0},
+        [CEC_MESSAGE_SET_SYSTEM_AUDIO_MODE] = {DB, 1},
+        [CEC_MESSAGE_REPORT_AUDIO_STATUS] = {D | REPORT, 1},
+        [CEC_MESSAGE_GIVE_SYSTEM_AUDIO_MODE_STATUS] = {D, 0},
+        [CEC_MESSAGE_SYSTEM_AUDIO_MODE_STATUS] = {D | REPORT, 1},
+        [CEC_MESSAGE_ROUTING_CHANGE] = {B | HAL | WAKE | ROUTE, 4},
+        [CEC_MESSAGE_ROUTING_INFORMATION] = {B | HAL | ROUTE, 2},
+        [CEC_MESSAGE_ACTIVE_SOURCE] = {B | HAL | WAKE | REPORT | ROUTE, 2},
+        [CEC_MESSAGE_GIVE_PHYSICAL_ADDRESS] = {D | QUERY, 0},
+        [CEC_MESSAGE_REPORT_PHYSICAL_ADDRESS] = {B | HAL | REPORT, 3},
+        [CEC_MESSAGE_REQUEST_ACTIVE_SOURCE] = {B, 0},
+        [CEC_MESSAGE_SET_STREAM_PATH] = {B | HAL | WAKE | ROUTE, 2},
+        [CEC_MESSAGE_DEVICE_VENDOR_ID] = {B | QUERY | REPORT, 3},
+        [CEC_MESSAGE_VENDOR_COMMAND] = {D, 0},
+        [CEC_MESSAGE_VENDOR_REMOTE_BUTTON_DOWN] = {DB, 0},
+        [CEC_MESSAGE_VENDOR_REMOTE_BUTTON_UP] = {DB, 0},
+        [CEC_MESSAGE_GIVE_DEVICE_VENDOR_ID] = {D | QUERY, 0},
+        [CEC_MESSAGE_MENU_REQUEST] = {D, 1},
+        [CEC_MESSAGE_MENU_STATUS] = {D | REPORT, 1},
+        [CEC_MESSAGE_GIVE_DEVICE_POWER_STATUS] = {D | QUERY, 0},
+        [CEC_MESSAGE_REPORT_POWER_STATUS] = {DB | HAL | REPORT, 1},
+        [CEC_MESSAGE_GET_MENU_LANGUAGE] = {D | QUERY, 0},
+        [CEC_MESSAGE_SELECT_ANALOG_SERVICE] = {D, 4},
+        [CEC_MESSAGE_SELECT_DIGITAL_SERVICE] = {D, 7},
+        [CEC_MESSAGE_SET_DIGITAL_TIMER] = {D, 14},
+        [CEC_MESSAGE_CLEAR_DIGITAL_TIMER] = {D, 14},
+        [CEC_MESSAGE_SET_AUDIO_RATE] = {D, 1},
+        [CEC_MESSAGE_INACTIVE_SOURCE] = {D | HAL | REPORT | ROUTE, 2},
+        [CEC_MESSAGE_CEC_VERSION] = {D | HAL | REPORT, 1},
+        [CEC_MESSAGE_GET_CEC_VERSION] = {D | QUERY, 0},
+        [CEC_MESSAGE_VENDOR_COMMAND_WITH_ID] = {DB, 3},
+        [CEC_MESSAGE_CLEAR_EXTERNAL_TIMER] = {D, 9},
+        [CEC_MESSAGE_SET_EXTERNAL_TIMER] = {D, 9},
+        [CEC_MESSAGE_INITIATE_ARC] = {D, 0},
+        [CEC_MESSAGE_REPORT_ARC_INITIATED] = {D, 0},
+        [CEC_MESSAGE_REPORT_ARC_TERMINATED] = {D, 0},
+        [CEC_MESSAGE_REQUEST_ARC_INITIATION] = {D, 0},
+        [CEC_MESSAGE_REQUEST_ARC_TERMINATION] = {D, 0},
+        [CEC_MESSAGE_TERMINATE_ARC] = {D, 0},
+        [CEC_MESSAGE_ABORT] = {D, 0},
+};
+
+static void set_all(atomic_uint *words, unsigned int value) {
+    for (int i = 0; i < CEC_FILTER_WORDS; i++) {
+        atomic_store_explicit(&words[i], value, memory_order_relaxed);
+    }
+}
+
+static int is_allowed(struct cec_filter *filter, int direction, int destination, int opcode) {
+    unsigned int word = atomic_load_explicit(&filter->allow[direction][destination][opcode / 32],
+                                             memory_order_relaxed);
+    return word >> (opcode % 32) & 1;
+}
+
+void cec_filter_init(struct cec_filter *filter) {
+    memset(filter, 0, sizeof(*filter));
+    for (int direction = SUNXI_CEC_FILTER_RX; direction <= SUNXI_CEC_FILTER_TX; direction++) {
+        set_all(filter->allow[direction][SUNXI_CEC_FILTER_DIRECTED], ~0u);
+        set_all(filter->allow[direction][SUNXI_CEC_FILTER_BROADCAST], ~0u);
+    }
+
+    char value[PROP_VALUE_MAX];
+    if (!cec_config_get("ro.hdmi.cec.filter.deny", value, "")) {
+        return;
+    }
+    char *save = NULL;
+    for (char *token = strtok_r(value, ",", &save); token; token = strtok_r(NULL, ",", &save)) {
+        char *end;
+        long opcode = strtol(token, &end, 16);
+        if (end == token || opcode < 0 || opcode > 0xff) {
+            ALOGW("cec_filter_init: invalid opcode in ro.hdmi.cec.filter.deny: %s", token);
+            continue;
+        }
+        cec_filter_set(filter, SUNXI_CEC_FILTER_RX, SUNXI_CEC_FILTER_DIRECTED, opcode, 0);
+        cec_filter_set(filter, SUNXI_CEC_FILTER_RX, SUNXI_CEC_FILTER_BROADCAST, opcode, 0);
+    }
+}
+
+int cec_filter_set(struct cec_filter *filter, int direction, int destination, int opcode, int allow) {
+    if (direction < SUNXI_CEC_FILTER_RX || direction > SUNXI_CEC_FILTER_TX ||
+        destination < SUNXI_CEC_FILTER_DIRECTED || destination > SUNXI_CEC_FILTER_OTHER ||
+        opcode < -1 || opcode > 0xff) {
+        return -EINVAL;
+    }
+
+    atomic_uint *words = filter->allow[direction][destination];
+    if (opcode < 0) {
+        set_all(words, allow ? ~0u : 0);
+    } else if (allow) {
+        atomic_fetch_or_explicit(&words[opcode / 32], 1u << (opcode % 32), memory_order_relaxed);
+    } else {
+        atomic_fetch_and_explicit(&words[opcode / 32], ~(1u << (opcode % 32)), memory_order_relaxed);
+    }
+    return 0;
+}
+
+int cec_filter_rx(struct cec_filter *filter, int destination, int opcode, size_t operands) {
+    const struct cec_opcode_info *info = &cec_opcode_table[opcode];
+
+    // Frames with the wrong addressing or too few operands are ignored,
+    // as the spec asks; opcodes we do not know are left to the framework.
+    if (info->flags & CEC_OPCODE_KNOWN) {
+        int addressing = destination == SUNXI_CEC_FILTER_BROADCAST ? CEC_OPCODE_BROADCAST : CEC_OPCODE_DIRECTED;
+        if (!(info->flags & addressing) || operands < info->min_operands) {
+            cec_counter_add(&filter->malformed, 1);
+            return CEC_FILTER_DROP;
+        }
+    }
+
+    if (is_allowed(filter, SUNXI_CEC_FILTER_RX, destination, opcode)) {
+        return CEC_FILTER_DELIVER;
+    }
+    cec_counter_add(&filter->filtered[opcode], 1);
+    return info->flags & CEC_OPCODE_HAL ? CEC_FILTER_HAL_ONLY : CEC_FILTER_DROP;
+}
+
+int cec_filter_tx(struct cec_filter *filter, int destination, int opcode) {
+    if (opcode < 0 || is_allowed(filter, SUNXI_CEC_FILTER_TX, destination, opcode)) {
+        return 1;
+    }
+    cec_counter_add(&filter->tx_filtered, 1);
+    return 0;
+}
+
+void cec_filter_driver_mask(struct cec_filter *filter, int standby, uint32_t *mask) {
+    for (int opcode = 0; opcode < 256; opcode++) {
+        int flags = cec_opcode_table[opcode].flags;
+        int needed;
+        if (standby) {
+            needed = flags & (CEC_OPCODE_STANDBY | CEC_OPCODE_WAKE);
+        } else {
+            needed = (flags & CEC_OPCODE_HAL) ||
+                     is_allowed(filter, SUNXI_CEC_FILTER_RX, SUNXI_CEC_FILTER_DIRECTED, opcode) ||
+                     is_allowed(filter, SUNXI_CEC_FILTER_RX, SUNXI_CEC_FILTER_BROADCAST, opcode) ||
+                     is_allowed(filter, SUNXI_CEC_FILTER_RX, SUNXI_CEC_FILTER_OTHER, opcode);
+        }
+        if (opcode % 32 == 0) {
+            mask[opcode / 32] = 0;
+        }
+        if (needed) {
+            mask[opcode / 32] |= 1u << (opcode % 32);
+        }
+    }
+}
+
+void cec_filter_dump(struct cec_filter *filter, int fd) {
+    uint64_t total = 0;
+    for (int opcode = 0; opcode < 256; opcode++) {
+        total += cec_counter_get(&filter->filtered[opcode]);
+    }
+    dprintf(fd, "filter: filtered=%llu malformed=%llu tx_filtered=%llu\n",
+            (unsigned long long) total, (unsigned long long) cec_counter_get(&filter->malformed),
+            (unsigned long long) cec_counter_get(&filter->tx_filtered));
+    for (int opcode = 0; opcode < 256; opcode++) {
+        uint64_t count = cec_counter_get(&filter->filtered[opcode]);
+        if (count) {
+            dprintf(fd, "  0x%02x %llu\n", opcode, (unsigned long long) count);
+        }
+    }
+}
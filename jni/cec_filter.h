@@ -0,0 +1,77 @@
+#ifndef SUNXI_HDMI_CEC_FILTER_H
+#define SUNXI_HDMI_CEC_FILTER_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sunxi_cec.h"
+
+/*
+ * Decides per frame whether the framework gets to see it, from a fixed
+ * table of what each opcode is and runtime allow bitmaps per direction
+ * and destination. The bitmaps may be changed from any thread; the check
+ * is a single relaxed load.
+ */
+
+/* opcode metadata */
+#define CEC_OPCODE_KNOWN        0x01
+#define CEC_OPCODE_DIRECTED     0x02    /* valid sent to one device */
+#define CEC_OPCODE_BROADCAST    0x04    /* valid sent to all devices */
+#define CEC_OPCODE_HAL          0x08    /* the HAL itself acts on it */
+#define CEC_OPCODE_STANDBY      0x10    /* ... even in standby */
+#define CEC_OPCODE_WAKE         0x20    /* may wake the system */
+#define CEC_OPCODE_REPORT       0x40    /* reports state; an identical repeat adds nothing */
+#define CEC_OPCODE_ROUTING      0x80    /* changes or reports which source is active */
+
+struct cec_opcode_info {
+    uint8_t flags;
+    uint8_t min_operands;
+};
+
+extern const struct cec_opcode_info cec_opcode_table[256];
+
+enum cec_filter_verdict {
+    CEC_FILTER_DROP,        /* malformed, or nobody wants it */
+    CEC_FILTER_HAL_ONLY,    /* handled inside the HAL, not delivered */
+    CEC_FILTER_DELIVER,
+};
+
+#define CEC_FILTER_WORDS (256 / 32)
+
+struct cec_filter {
+    atomic_uint allow[2][3][CEC_FILTER_WORDS];  /* [direction][destination] */
+
+    /* written by the reader thread, read by any */
+    atomic_ullong filtered[256];
+    atomic_ullong malformed;
+    /* written by the TX thread, read by any */
+    atomic_ullong tx_filtered;
+};
+
+/*
+ * Allows everything directed to us or broadcast, and nothing directed to
+ * other devices; then denies the opcodes listed in ro.hdmi.cec.filter.deny
+ * (comma separated) for received frames.
+ */
+void cec_filter_init(struct cec_filter *filter);
+
+/* opcode -1 changes every opcode. Returns 0 or -EINVAL. */
+int cec_filter_set(struct cec_filter *filter, int direction, int destination, int opcode, int allow);
+
+/* Classifies a received frame and counts what is not delivered. Reader thread only. */
+int cec_filter_rx(struct cec_filter *filter, int destination, int opcode, size_t operands);
+
+/* Whether the TX status of opcode is reported. TX thread only. */
+int cec_filter_tx(struct cec_filter *filter, int destination, int opcode);
+
+/*
+ * Opcodes the driver has to pass up at all, bit per opcode: everything
+ * that is delivered or used by the HAL, or in standby only what the HAL
+ * still answers or may wake the system.
+ */
+void cec_filter_driver_mask(struct cec_filter *filter, int standby, uint32_t *mask);
+
+void cec_filter_dump(struct cec_filter *filter, int fd);
+
+#endif
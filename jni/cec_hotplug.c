@@ -0,0 +1,71 @@
+#define LOG_TAG "sunxi-hdmi-cec"
+
+#include "cec_config.h"
+#include "cec_hotplug.h"
+#include "cec_stats.h"
+#include "log.h"
+
+#include <string.h>
+
+static void set_pending(struct cec_hotplug *hotplug, int state) {
+    atomic_store_explicit(&hotplug->pending, state, memory_order_relaxed);
+}
+
+static void deliver(struct cec_hotplug *hotplug, int connected) {
+    set_pending(hotplug, CEC_HOTPLUG_UNKNOWN);
+    atomic_store_explicit(&hotplug->reported, connected, memory_order_relaxed);
+    cec_counter_add(&hotplug->reports, 1);
+    hotplug->report(hotplug, connected);
+}
+
+static void debounce_fired(struct cec_timer *timer) {
+    struct cec_hotplug *hotplug = timer->arg;
+    int pending = atomic_load_explicit(&hotplug->pending, memory_order_relaxed);
+    if (pending != CEC_HOTPLUG_UNKNOWN) {
+        deliver(hotplug, pending);
+    }
+}
+
+int cec_hotplug_init(struct cec_hotplug *hotplug, struct cec_loop *loop, cec_hotplug_report_t report, void *arg) {
+    memset(hotplug, 0, sizeof(*hotplug));
+    atomic_init(&hotplug->reported, CEC_HOTPLUG_UNKNOWN);
+    atomic_init(&hotplug->pending, CEC_HOTPLUG_UNKNOWN);
+    hotplug->report = report;
+    hotplug->arg = arg;
+    hotplug->connect_ms = cec_config_get_int("ro.hdmi.cec.hotplug_connect_ms", CEC_HOTPLUG_CONNECT_MS);
+    hotplug->disconnect_ms = cec_config_get_int("ro.hdmi.cec.hotplug_disconnect_ms", CEC_HOTPLUG_DISCONNECT_MS);
+    return cec_timer_init(&hotplug->timer, loop, debounce_fired, hotplug);
+}
+
+void cec_hotplug_destroy(struct cec_hotplug *hotplug) {
+    cec_timer_destroy(&hotplug->timer);
+}
+
+void cec_hotplug_signal(struct cec_hotplug *hotplug, int connected, int source) {
+    connected = !!connected;
+    cec_counter_add(&hotplug->signals[source == CEC_HOTPLUG_CEC], 1);
+
+    int pending = atomic_load_explicit(&hotplug->pending, memory_order_relaxed);
+    if (connected == atomic_load_explicit(&hotplug->reported, memory_order_relaxed)) {
+        if (pending != CEC_HOTPLUG_UNKNOWN) {
+            ALOGV("cec_hotplug: %s flap suppressed", connected ? "disconnect" : "connect");
+            cec_counter_add(&hotplug->flaps, 1);
+            set_pending(hotplug, CEC_HOTPLUG_UNKNOWN);
+            cec_timer_cancel(&hotplug->timer);
+        }
+        return;
+    }
+    if (connected == pending) {
+        // the debounce runs from the first signal of a transition
+        return;
+    }
+
+    int delay_ms = connected ? hotplug->connect_ms : hotplug->disconnect_ms;
+    if (delay_ms <= 0) {
+        cec_timer_cancel(&hotplug->timer);
+        deliver(hotplug, connected);
+        return;
+    }
+    set_pending(hotplug, connected);
+    cec_timer_arm(&hotplug->timer, delay_ms);
+}
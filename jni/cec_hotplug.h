@@ -0,0 +1,61 @@
+#ifndef SUNXI_HDMI_CEC_HOTPLUG_H
+#define SUNXI_HDMI_CEC_HOTPLUG_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "cec_loop.h"
+
+/*
+ * Debounced connection state. Kernel hotplug events and CEC traffic from
+ * the TV are both signals; a change is only reported once the newest
+ * signal has held for the debounce time of its direction, so a flapping
+ * link yields at most one report per real transition. Loop thread only.
+ */
+
+#define CEC_HOTPLUG_CONNECT_MS 100
+#define CEC_HOTPLUG_DISCONNECT_MS 1500
+
+enum cec_hotplug_state {
+    CEC_HOTPLUG_UNKNOWN = -1,
+    CEC_HOTPLUG_DISCONNECTED = 0,
+    CEC_HOTPLUG_CONNECTED = 1,
+};
+
+enum cec_hotplug_source {
+    CEC_HOTPLUG_KERNEL,
+    CEC_HOTPLUG_CEC,        /* the TV talked to us */
+};
+
+struct cec_hotplug;
+
+typedef void (*cec_hotplug_report_t)(struct cec_hotplug *hotplug, int connected);
+
+struct cec_hotplug {
+    /* written by the loop thread; reported is read by is_connected() */
+    atomic_int reported;    /* enum cec_hotplug_state */
+    atomic_int pending;     /* state waiting for its debounce, or UNKNOWN */
+    int connect_ms;
+    int disconnect_ms;
+    struct cec_timer timer;
+
+    cec_hotplug_report_t report;
+    void *arg;
+
+    /* written by the loop thread, read by any */
+    atomic_ullong signals[2];   /* per source */
+    atomic_ullong reports;
+    atomic_ullong flaps;        /* transitions that reverted before their debounce */
+};
+
+/*
+ * Reads ro.hdmi.cec.hotplug_connect_ms and ro.hdmi.cec.hotplug_disconnect_ms;
+ * the longer disconnect time is the hysteresis that rides out TV standby
+ * and AV receiver switching.
+ */
+int cec_hotplug_init(struct cec_hotplug *hotplug, struct cec_loop *loop, cec_hotplug_report_t report, void *arg);
+void cec_hotplug_destroy(struct cec_hotplug *hotplug);
+
+void cec_hotplug_signal(struct cec_hotplug *hotplug, int connected, int source);
+
+#endif
@@ -0,0 +1,239 @@
+#define LOG_TAG "sunxi-hdmi-cec"
+
+#include "cec_config.h"
+#include "cec_keys.h"
+#include "cec_stats.h"
+#include "log.h"
+
+#include <hardware/hdmi_cec.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+/* CEC UI command -> linux key, following the framework's HdmiCecKeycode */
+static const unsigned short ui_command_keys[256] = {
+        [0x00] = KEY_SELECT,
+        [0x01] = KEY_UP,
+        [0x02] = KEY_DOWN,
+        [0x03] = KEY_LEFT,
+        [0x04] = KEY_RIGHT,
+        [0x09] = KEY_HOMEPAGE,
+        [0x0a] = KEY_SETUP,
+        [0x0b] = KEY_MENU,
+        [0x0d] = KEY_BACK,
+        [0x20] = KEY_0,
+        [0x21] = KEY_1,
+        [0x22] = KEY_2,
+        [0x23] = KEY_3,
+        [0x24] = KEY_4,
+        [0x25] = KEY_5,
+        [0x26] = KEY_6,
+        [0x27] = KEY_7,
+        [0x28] = KEY_8,
+        [0x29] = KEY_9,
+        [0x2b] = KEY_ENTER,
+        [0x30] = KEY_CHANNELUP,
+        [0x31] = KEY_CHANNELDOWN,
+        [0x35] = KEY_INFO,
+        [0x41] = KEY_VOLUMEUP,
+        [0x42] = KEY_VOLUMEDOWN,
+        [0x43] = KEY_MUTE,
+        [0x44] = KEY_PLAY,
+        [0x45] = KEY_STOP,
+        [0x46] = KEY_PAUSE,
+        [0x47] = KEY_RECORD,
+        [0x48] = KEY_REWIND,
+        [0x49] = KEY_FASTFORWARD,
+        [0x4a] = KEY_EJECTCD,
+        [0x4b] = KEY_NEXTSONG,
+        [0x4c] = KEY_PREVIOUSSONG,
+        [0x61] = KEY_PLAYPAUSE,
+        [0x71] = KEY_BLUE,
+        [0x72] = KEY_RED,
+        [0x73] = KEY_GREEN,
+        [0x74] = KEY_YELLOW,
+};
+
+static int open_device(struct cec_keys *keys) {
+    int fd = open(keys->path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    // uinput_user_dev rather than UI_DEV_SETUP, which needs linux 4.5
+    if (ioctl(fd, UI_SET_EVBIT, EV_KEY) < 0) {
+        if (errno != ENOTTY && errno != EINVAL) {
+            int err = -errno;
+            close(fd);
+            return err;
+        }
+        ALOGI("cec_keys: %s is not uinput, writing raw events", keys->path);
+        keys->raw = 1;
+        keys->fd = fd;
+        return 0;
+    }
+    ioctl(fd, UI_SET_EVBIT, EV_SYN);
+    for (int i = 0; i < 256; i++) {
+        if (ui_command_keys[i]) {
+            ioctl(fd, UI_SET_KEYBIT, ui_command_keys[i]);
+        }
+    }
+
+    struct uinput_user_dev device;
+    memset(&device, 0, sizeof(device));
+    strncpy(device.name, "sunxi-hdmi-cec", UINPUT_MAX_NAME_SIZE - 1);
+    device.id.bustype = BUS_HOST;
+    device.id.vendor = 0x1582;
+    if (write(fd, &device, sizeof(device)) != sizeof(device) || ioctl(fd, UI_DEV_CREATE) < 0) {
+        int err = -errno;
+        close(fd);
+        return err;
+    }
+
+    keys->raw = 0;
+    keys->fd = fd;
+    return 0;
+}
+
+static void emit(struct cec_keys *keys, int key, int value) {
+    if (keys->fd < 0) {
+        return;
+    }
+
+    // the kernel stamps uinput events itself; raw sinks get our clock
+    struct input_event events[2];
+    memset(events, 0, sizeof(events));
+    if (keys->raw) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        events[0].time.tv_sec = events[1].time.tv_sec = now.tv_sec;
+        events[0].time.tv_usec = events[1].time.tv_usec = now.tv_nsec / 1000;
+    }
+    events[0].type = EV_KEY;
+    events[0].code = key;
+    events[0].value = value;
+    events[1].type = EV_SYN;
+    events[1].code = SYN_REPORT;
+
+    if (write(keys->fd, events, sizeof(events)) != sizeof(events)) {
+        cec_counter_add(&keys->write_errors, 1);
+    }
+}
+
+static void release(struct cec_keys *keys) {
+    if (!keys->key) {
+        return;
+    }
+    emit(keys, keys->key, 0);
+    keys->key = 0;
+    cec_timer_cancel(&keys->repeat_timer);
+    cec_timer_cancel(&keys->release_timer);
+}
+
+static void repeat_fired(struct cec_timer *timer) {
+    struct cec_keys *keys = timer->arg;
+    if (keys->key) {
+        emit(keys, keys->key, 2);
+        cec_counter_add(&keys->repeats, 1);
+    }
+}
+
+static void release_fired(struct cec_timer *timer) {
+    struct cec_keys *keys = timer->arg;
+    if (keys->key) {
+        cec_counter_add(&keys->timeouts, 1);
+        release(keys);
+    }
+}
+
+int cec_keys_init(struct cec_keys *keys, struct cec_loop *loop) {
+    memset(keys, 0, sizeof(*keys));
+    keys->fd = -1;
+    keys->repeat_timer.source.fd = -1;
+    keys->release_timer.source.fd = -1;
+
+    cec_config_get("ro.hdmi.cec.uinput_path", keys->path, CEC_KEYS_DEFAULT_PATH);
+    keys->repeat_delay_ms = cec_config_get_int("ro.hdmi.cec.key_repeat_delay_ms", CEC_KEYS_REPEAT_DELAY_MS);
+    keys->repeat_period_ms = cec_config_get_int("ro.hdmi.cec.key_repeat_period_ms", CEC_KEYS_REPEAT_PERIOD_MS);
+    atomic_init(&keys->enabled, cec_config_get_int("persist.sys.hdmi.cec.key_fast_path", 0) != 0);
+
+    if (cec_timer_init(&keys->repeat_timer, loop, repeat_fired, keys) < 0 ||
+        cec_timer_init(&keys->release_timer, loop, release_fired, keys) < 0) {
+        cec_timer_destroy(&keys->repeat_timer);
+        return -1;
+    }
+    return 0;
+}
+
+void cec_keys_destroy(struct cec_keys *keys) {
+    release(keys);
+    cec_timer_destroy(&keys->repeat_timer);
+    cec_timer_destroy(&keys->release_timer);
+    if (keys->fd >= 0) {
+        if (!keys->raw) {
+            ioctl(keys->fd, UI_DEV_DESTROY);
+        }
+        close(keys->fd);
+        keys->fd = -1;
+    }
+}
+
+void cec_keys_set_enabled(struct cec_keys *keys, int enabled) {
+    atomic_store_explicit(&keys->enabled, enabled != 0, memory_order_relaxed);
+}
+
+int cec_keys_handle(struct cec_keys *keys, int opcode, const unsigned char *operands, size_t length) {
+    if (!atomic_load_explicit(&keys->enabled, memory_order_relaxed)) {
+        // switched off with a key held: let go of it, the framework takes over
+        release(keys);
+        return 0;
+    }
+
+    if (opcode == CEC_MESSAGE_USER_CONTROL_RELEASED) {
+        if (!keys->key) {
+            return 0;
+        }
+        release(keys);
+        return 1;
+    }
+    if (opcode != CEC_MESSAGE_USER_CONTROL_PRESSED || length < 1) {
+        return 0;
+    }
+
+    int key = ui_command_keys[operands[0]];
+    if (!key) {
+        release(keys);
+        return 0;
+    }
+
+    if (keys->fd < 0) {
+        int ret = open_device(keys);
+        if (ret < 0) {
+            ALOGE("cec_keys: unable to open %s: %d, disabling", keys->path, ret);
+            cec_keys_set_enabled(keys, 0);
+            return 0;
+        }
+    }
+
+    // TVs resend PRESSED while the button is held; only the timeout moves
+    if (key == keys->key) {
+        cec_timer_arm(&keys->release_timer, CEC_KEYS_RELEASE_TIMEOUT_MS);
+        return 1;
+    }
+
+    release(keys);
+    emit(keys, key, 1);
+    cec_timer_arm(&keys->release_timer, CEC_KEYS_RELEASE_TIMEOUT_MS);
+    keys->key = key;
+    cec_counter_add(&keys->presses, 1);
+    if (keys->repeat_delay_ms > 0 && keys->repeat_period_ms > 0) {
+        cec_timer_arm_periodic(&keys->repeat_timer, keys->repeat_delay_ms, keys->repeat_period_ms);
+    }
+    return 1;
+}
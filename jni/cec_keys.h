@@ -0,0 +1,66 @@
+#ifndef SUNXI_HDMI_CEC_KEYS_H
+#define SUNXI_HDMI_CEC_KEYS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/system_properties.h>
+
+#include "cec_loop.h"
+
+/*
+ * Remote control fast path: CEC UI commands are turned into key events on
+ * a uinput device straight from the reader thread, with auto-repeat paced
+ * by the HAL and the CEC 550 ms release timeout, instead of going through
+ * the framework. Everything but cec_keys_set_enabled() runs on the loop
+ * thread.
+ */
+
+#define CEC_KEYS_RELEASE_TIMEOUT_MS 550
+#define CEC_KEYS_REPEAT_DELAY_MS 400
+#define CEC_KEYS_REPEAT_PERIOD_MS 100
+
+#define CEC_KEYS_DEFAULT_PATH "/dev/uinput"
+
+struct cec_keys {
+    atomic_int enabled;
+
+    char path[PROP_VALUE_MAX];
+    int fd;                 /* -1 until the first key */
+    int raw;                /* path is not uinput; input_event records are written as is */
+
+    int key;                /* linux key held down, 0 if none */
+    int repeat_delay_ms;
+    int repeat_period_ms;
+    struct cec_timer repeat_timer;
+    struct cec_timer release_timer;
+
+    /* written by the loop thread, read by any */
+    atomic_ullong presses;
+    atomic_ullong repeats;
+    atomic_ullong timeouts;
+    atomic_ullong write_errors;
+};
+
+/*
+ * Reads the configuration:
+ *   persist.sys.hdmi.cec.key_fast_path   1 to enable at open (default 0)
+ *   ro.hdmi.cec.uinput_path              device to create (default /dev/uinput)
+ *   ro.hdmi.cec.key_repeat_delay_ms      first repeat (default 400, 0 disables)
+ *   ro.hdmi.cec.key_repeat_period_ms     repeat period (default 100)
+ */
+int cec_keys_init(struct cec_keys *keys, struct cec_loop *loop);
+void cec_keys_destroy(struct cec_keys *keys);
+
+/* Safe from any thread; a key held when disabled is released on the next event. */
+void cec_keys_set_enabled(struct cec_keys *keys, int enabled);
+
+/*
+ * Handles USER_CONTROL_PRESSED / RELEASED (opcode + operands). Returns 1
+ * when a key event was generated and the frame should not be forwarded,
+ * 0 when the frame is left to the framework.
+ */
+int cec_keys_handle(struct cec_keys *keys, int opcode, const unsigned char *operands, size_t length);
+
+#endif
@@ -0,0 +1,191 @@
+#define LOG_TAG "sunxi-hdmi-cec"
+
+#include "cec_loop.h"
+#include "log.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#define CEC_LOOP_MAX_EVENTS 8
+
+static int is_stopped(struct cec_loop *loop) {
+    return atomic_load_explicit(&loop->stopped, memory_order_acquire);
+}
+
+static void stop_handler(struct cec_loop_source *source, uint32_t events) {
+    struct cec_loop *loop = source->arg;
+    uint64_t value;
+    read(source->fd, &value, sizeof(value));
+    atomic_store_explicit(&loop->stopped, 1, memory_order_release);
+}
+
+int cec_loop_init(struct cec_loop *loop) {
+    memset(loop, 0, sizeof(*loop));
+    loop->stop_fd = -1;
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        ALOGE("cec_loop_init: epoll_create1 failed: %d", errno);
+        return -errno;
+    }
+
+    loop->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (loop->stop_fd < 0) {
+        int err = errno;
+        ALOGE("cec_loop_init: eventfd failed: %d", err);
+        close(loop->epoll_fd);
+        loop->epoll_fd = -1;
+        return -err;
+    }
+
+    return 0;
+}
+
+void cec_loop_destroy(struct cec_loop *loop) {
+    if (loop->stop_fd >= 0) {
+        close(loop->stop_fd);
+        loop->stop_fd = -1;
+    }
+    if (loop->epoll_fd >= 0) {
+        close(loop->epoll_fd);
+        loop->epoll_fd = -1;
+    }
+}
+
+int cec_loop_add(struct cec_loop *loop, struct cec_loop_source *source, uint32_t events) {
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = source;
+
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, source->fd, &event) < 0) {
+        ALOGE("cec_loop_add: fd=%d failed: %d", source->fd, errno);
+        return -errno;
+    }
+    return 0;
+}
+
+int cec_loop_remove(struct cec_loop *loop, struct cec_loop_source *source) {
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, source->fd, NULL) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+void cec_loop_run(struct cec_loop *loop) {
+    struct cec_loop_source stop_source = {
+            .fd = loop->stop_fd,
+            .handler = stop_handler,
+            .arg = loop,
+    };
+
+    if (cec_loop_add(loop, &stop_source, EPOLLIN) < 0) {
+        return;
+    }
+
+    while (!is_stopped(loop)) {
+        struct epoll_event events[CEC_LOOP_MAX_EVENTS];
+        int count = epoll_wait(loop->epoll_fd, events, CEC_LOOP_MAX_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // EBADF or EINVAL will not go away; retrying would only spin.
+            ALOGE("cec_loop_run: epoll_wait failed: %d", errno);
+            break;
+        }
+
+        for (int i = 0; i < count && !is_stopped(loop); i++) {
+            struct cec_loop_source *source = events[i].data.ptr;
+            source->handler(source, events[i].events);
+        }
+    }
+
+    cec_loop_remove(loop, &stop_source);
+}
+
+void cec_loop_stop(struct cec_loop *loop) {
+    uint64_t value = 1;
+    atomic_store_explicit(&loop->stopped, 1, memory_order_release);
+    if (write(loop->stop_fd, &value, sizeof(value)) < 0) {
+        ALOGW("cec_loop_stop: failed: %d", errno);
+    }
+}
+
+static void timer_handler(struct cec_loop_source *source, uint32_t events) {
+    struct cec_timer *timer = source->arg;
+    uint64_t expirations;
+    if (read(source->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        // cancelled or re-armed after the expiry was queued
+        return;
+    }
+    timer->fire(timer);
+}
+
+int cec_timer_init(struct cec_timer *timer, struct cec_loop *loop,
+                   void (*fire)(struct cec_timer *timer), void *arg) {
+    memset(timer, 0, sizeof(*timer));
+    timer->loop = loop;
+    timer->fire = fire;
+    timer->arg = arg;
+    timer->source.handler = timer_handler;
+    timer->source.arg = timer;
+    timer->source.fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (timer->source.fd < 0) {
+        ALOGE("cec_timer_init: timerfd_create failed: %d", errno);
+        return -errno;
+    }
+
+    int ret = cec_loop_add(loop, &timer->source, EPOLLIN);
+    if (ret < 0) {
+        close(timer->source.fd);
+        timer->source.fd = -1;
+    }
+    return ret;
+}
+
+void cec_timer_destroy(struct cec_timer *timer) {
+    if (timer->source.fd < 0) {
+        return;
+    }
+    cec_loop_remove(timer->loop, &timer->source);
+    close(timer->source.fd);
+    timer->source.fd = -1;
+}
+
+int cec_timer_arm(struct cec_timer *timer, unsigned int timeout_ms) {
+    return cec_timer_arm_periodic(timer, timeout_ms, 0);
+}
+
+int cec_timer_arm_periodic(struct cec_timer *timer, unsigned int timeout_ms, unsigned int period_ms) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = timeout_ms / 1000;
+    spec.it_value.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    if (timeout_ms == 0) {
+        // a zero it_value would disarm the timer; fire as soon as possible
+        spec.it_value.tv_nsec = 1;
+    }
+    spec.it_interval.tv_sec = period_ms / 1000;
+    spec.it_interval.tv_nsec = (period_ms % 1000) * 1000000L;
+
+    if (timerfd_settime(timer->source.fd, 0, &spec, NULL) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+int cec_timer_cancel(struct cec_timer *timer) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+
+    if (timerfd_settime(timer->source.fd, 0, &spec, NULL) < 0) {
+        return -errno;
+    }
+    return 0;
+}
@@ -0,0 +1,60 @@
+#ifndef SUNXI_HDMI_CEC_LOOP_H
+#define SUNXI_HDMI_CEC_LOOP_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Single-threaded epoll event loop used by the processing thread.
+ *
+ * The loop blocks without a timeout; it is woken only by its sources:
+ * the device fd, the shutdown eventfd and any armed timers.
+ */
+
+struct cec_loop_source;
+
+typedef void (*cec_loop_handler_t)(struct cec_loop_source *source, uint32_t events);
+
+struct cec_loop_source {
+    int fd;
+    cec_loop_handler_t handler;
+    void *arg;
+};
+
+struct cec_loop {
+    int epoll_fd;
+    int stop_fd;
+    atomic_int stopped;     /* set by cec_loop_stop from any thread */
+};
+
+struct cec_timer {
+    struct cec_loop_source source;
+    struct cec_loop *loop;
+    void (*fire)(struct cec_timer *timer);
+    void *arg;
+};
+
+int cec_loop_init(struct cec_loop *loop);
+void cec_loop_destroy(struct cec_loop *loop);
+int cec_loop_add(struct cec_loop *loop, struct cec_loop_source *source, uint32_t events);
+int cec_loop_remove(struct cec_loop *loop, struct cec_loop_source *source);
+
+/*
+ * Runs until cec_loop_stop() is called, or epoll_wait fails with anything
+ * but EINTR; safe to call stop from any thread.
+ */
+void cec_loop_run(struct cec_loop *loop);
+void cec_loop_stop(struct cec_loop *loop);
+
+int cec_timer_init(struct cec_timer *timer, struct cec_loop *loop,
+                   void (*fire)(struct cec_timer *timer), void *arg);
+void cec_timer_destroy(struct cec_timer *timer);
+
+/* One-shot timer; re-arming replaces any pending expiry. */
+int cec_timer_arm(struct cec_timer *timer, unsigned int timeout_ms);
+
+/* Fires after timeout_ms, then every period_ms (kernel-paced, no drift) until cancelled. */
+int cec_timer_arm_periodic(struct cec_timer *timer, unsigned int timeout_ms, unsigned int period_ms);
+int cec_timer_cancel(struct cec_timer *timer);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef SUNXI_HDMI_CEC_LOOPBACK_H
+#define SUNXI_HDMI_CEC_LOOPBACK_H
+
+#include "cec_backend.h"
+
+/*
+ * In-process loopback transport for host testing and benchmarking.
+ *
+ * Transmitted frames are acknowledged by the logical addresses marked
+ * present, may trigger scripted responses, and can be made to fail with
+ * injected NACK or BUSY results. Received traffic is injected by the test.
+ */
+
+#define CEC_LOOPBACK_MAX_RESPONSES 16
+#define CEC_LOOPBACK_QUEUE_SIZE 64
+
+/* Logical addresses acknowledging directed frames (bit n = address n). */
+void cec_loopback_set_present(struct cec_backend *backend, uint16_t mask);
+
+/* Physical address reported by get_physical_address. */
+void cec_loopback_set_physical_address(struct cec_backend *backend, uint16_t addr);
+
+/* Makes the next count transmissions fail with result (HDMI_RESULT_NACK or _BUSY). */
+void cec_loopback_fail_next(struct cec_backend *backend, int result, int count);
+
+/* Simulated time on the wire per transmitted frame. */
+void cec_loopback_set_frame_delay(struct cec_backend *backend, unsigned int delay_us);
+
+/*
+ * Replies with reply (header + body) whenever a frame with the given opcode
+ * is sent to destination (-1 matches any destination).
+ * Returns 0 or -ENOSPC when the script is full.
+ */
+int cec_loopback_add_response(struct cec_backend *backend, int destination, int opcode,
+                              const unsigned char *reply, size_t length);
+void cec_loopback_clear_responses(struct cec_backend *backend);
+
+/* Queues a received record; returns 0 or -EAGAIN when the queue is full. */
+int cec_loopback_inject(struct cec_backend *backend, const hdmi_cec_event_t *event);
+
+/* Queues a received frame (header + body). */
+int cec_loopback_inject_frame(struct cec_backend *backend, const unsigned char *frame, size_t length);
+
+/* Copies the last transmitted frame; returns its length or 0 if none. */
+size_t cec_loopback_last_sent(struct cec_backend *backend, unsigned char *frame);
+
+/* Number of write_frame calls seen, successful or not. */
+uint64_t cec_loopback_sent_count(struct cec_backend *backend);
+
+/* Current logical address as set by the HAL; the lowest one when several are claimed. */
+int cec_loopback_logical_address(struct cec_backend *backend);
+
+/* Every logical address claimed by the HAL, bit per address. */
+uint16_t cec_loopback_logical_mask(struct cec_backend *backend);
+
+/* Received frames dropped by the filter the HAL pushed down. */
+uint64_t cec_loopback_filtered_count(struct cec_backend *backend);
+
+#endif
@@ -0,0 +1,204 @@
+#define LOG_TAG "sunxi-hdmi-cec"
+
+#include "cec_config.h"
+#include "cec_responder.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLY_BROADCAST 1
+#define REPLY_DECK_ONLY 2       /* only for playback and recording addresses */
+#define REPLY_TV_ONLY 4         /* only a TV answers; others feature-abort */
+
+struct responder_entry {
+    int opcode;
+    int flags;
+    size_t (*build)(const struct cec_responder *responder, int address, unsigned char *reply);
+};
+
+/* primary device type of each logical address, CEC 1.4 table 5 */
+static const signed char address_device_types[16] = {
+        CEC_DEVICE_TV,
+        CEC_DEVICE_RECORDER, CEC_DEVICE_RECORDER,
+        CEC_DEVICE_TUNER,
+        CEC_DEVICE_PLAYBACK,
+        CEC_DEVICE_AUDIO_SYSTEM,
+        CEC_DEVICE_TUNER, CEC_DEVICE_TUNER,
+        CEC_DEVICE_PLAYBACK,
+        CEC_DEVICE_RECORDER,
+        CEC_DEVICE_TUNER,
+        CEC_DEVICE_PLAYBACK,
+        -1, -1, -1, -1,
+};
+
+static int device_type(const struct cec_responder *responder, int address) {
+    int type = address >= 0 && address < 16 ? address_device_types[address] : -1;
+    return type >= 0 ? type : responder->device_type;
+}
+
+static size_t report_physical_address(const struct cec_responder *responder, int address, unsigned char *reply) {
+    if (responder->physical_address == 0xffff) {
+        return 0;
+    }
+    reply[0] = CEC_MESSAGE_REPORT_PHYSICAL_ADDRESS;
+    reply[1] = responder->physical_address >> 8;
+    reply[2] = responder->physical_address;
+    reply[3] = device_type(responder, address);
+    return 4;
+}
+
+static size_t cec_version(const struct cec_responder *responder, int address, unsigned char *reply) {
+    reply[0] = CEC_MESSAGE_CEC_VERSION;
+    reply[1] = responder->cec_version;
+    return 2;
+}
+
+static size_t device_vendor_id(const struct cec_responder *responder, int address, unsigned char *reply) {
+    reply[0] = CEC_MESSAGE_DEVICE_VENDOR_ID;
+    reply[1] = responder->vendor_id >> 16;
+    reply[2] = responder->vendor_id >> 8;
+    reply[3] = responder->vendor_id;
+    return 4;
+}
+
+static size_t set_osd_name(const struct cec_responder *responder, int address, unsigned char *reply) {
+    size_t length = strlen(responder->osd_name);
+    reply[0] = CEC_MESSAGE_SET_OSD_NAME;
+    memcpy(reply + 1, responder->osd_name, length);
+    return length + 1;
+}
+
+static size_t report_power_status(const struct cec_responder *responder, int address, unsigned char *reply) {
+    reply[0] = CEC_MESSAGE_REPORT_POWER_STATUS;
+    reply[1] = responder->power_status;
+    return 2;
+}
+
+static size_t set_menu_language(const struct cec_responder *responder, int address, unsigned char *reply) {
+    if (!responder->language) {
+        // nothing to say until the framework tells us
+        return 0;
+    }
+    reply[0] = CEC_MESSAGE_SET_MENU_LANGUAGE;
+    reply[1] = responder->language >> 16;
+    reply[2] = responder->language >> 8;
+    reply[3] = responder->language;
+    return 4;
+}
+
+static size_t deck_status(const struct cec_responder *responder, int address, unsigned char *reply) {
+    reply[0] = CEC_MESSAGE_DECK_STATUS;
+    reply[1] = responder->deck_info;
+    return 2;
+}
+
+static const struct responder_entry responders[] = {
+        {CEC_MESSAGE_GIVE_PHYSICAL_ADDRESS,     REPLY_BROADCAST, report_physical_address},
+        {CEC_MESSAGE_GET_CEC_VERSION,           0,               cec_version},
+        {CEC_MESSAGE_GIVE_DEVICE_VENDOR_ID,     REPLY_BROADCAST, device_vendor_id},
+        {CEC_MESSAGE_GIVE_OSD_NAME,             0,               set_osd_name},
+        {CEC_MESSAGE_GIVE_DEVICE_POWER_STATUS,  0,               report_power_status},
+        {CEC_MESSAGE_GET_MENU_LANGUAGE,         REPLY_BROADCAST | REPLY_TV_ONLY, set_menu_language},
+        {CEC_MESSAGE_GIVE_DECK_STATUS,          REPLY_DECK_ONLY, deck_status},
+};
+
+#define RESPONDER_COUNT (sizeof(responders) / sizeof(responders[0]))
+
+/* opcode -> index into responders + 1, 0 when not answered here */
+static unsigned char responder_index[256];
+
+static void build_index(void) {
+    if (responder_index[responders[0].opcode]) {
+        return;
+    }
+    for (size_t i = 0; i < RESPONDER_COUNT; i++) {
+        responder_index[responders[i].opcode] = i + 1;
+    }
+}
+
+static void enable(struct cec_responder *responder, int opcode) {
+    responder->enabled[opcode / 32] |= 1u << (opcode % 32);
+}
+
+static void parse_enabled(struct cec_responder *responder, const char *list) {
+    memset(responder->enabled, 0, sizeof(responder->enabled));
+
+    if (!strcmp(list, "all")) {
+        for (size_t i = 0; i < RESPONDER_COUNT; i++) {
+            enable(responder, responders[i].opcode);
+        }
+        return;
+    } else if (!strcmp(list, "none")) {
+        return;
+    }
+
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long opcode = strtol(p, &end, 16);
+        if (end == p) {
+            break;
+        }
+        if (opcode >= 0 && opcode < 256 && responder_index[opcode]) {
+            enable(responder, opcode);
+        } else {
+            ALOGW("cec_responder: no responder for opcode %lx", opcode);
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+}
+
+void cec_responder_init(struct cec_responder *responder, uint32_t vendor_id, int cec_version) {
+    char value[PROP_VALUE_MAX];
+
+    build_index();
+    memset(responder, 0, sizeof(*responder));
+    responder->physical_address = 0xffff;
+    responder->vendor_id = vendor_id;
+    responder->cec_version = cec_version;
+    responder->power_status = CEC_POWER_STATUS_ON;
+    responder->deck_info = CEC_DECK_INFO_NO_MEDIA;
+    responder->device_type = cec_config_get_int("ro.hdmi.device_type", CEC_DEVICE_PLAYBACK);
+
+    cec_config_get("ro.hdmi.cec.osd_name", value, "");
+    size_t length = strnlen(value, CEC_OSD_NAME_MAX);
+    memcpy(responder->osd_name, value, length);
+    responder->osd_name[length] = 0;
+
+    cec_config_get("ro.hdmi.cec.auto_reply", value, "all");
+    parse_enabled(responder, value);
+
+    // Without a name fixed by the product, the framework answers with the
+    // device name set by the user.
+    if (!length) {
+        responder->enabled[CEC_MESSAGE_GIVE_OSD_NAME / 32] &= ~(1u << (CEC_MESSAGE_GIVE_OSD_NAME % 32));
+    }
+}
+
+size_t cec_responder_reply(const struct cec_responder *responder, int address, int opcode,
+                           unsigned char *reply, int *broadcast) {
+    if (opcode < 0 || opcode > 255 || !responder_index[opcode]) {
+        return 0;
+    }
+    if (!(responder->enabled[opcode / 32] & (1u << (opcode % 32)))) {
+        return 0;
+    }
+
+    const struct responder_entry *entry = &responders[responder_index[opcode] - 1];
+    if (entry->flags & REPLY_DECK_ONLY) {
+        int type = device_type(responder, address);
+        if (type != CEC_DEVICE_PLAYBACK && type != CEC_DEVICE_RECORDER) {
+            return 0;
+        }
+    }
+    if ((entry->flags & REPLY_TV_ONLY) && device_type(responder, address) != CEC_DEVICE_TV) {
+        reply[0] = CEC_MESSAGE_FEATURE_ABORT;
+        reply[1] = opcode;
+        reply[2] = ABORT_UNRECOGNIZED_MODE;
+        *broadcast = 0;
+        return 3;
+    }
+    *broadcast = !!(entry->flags & REPLY_BROADCAST);
+    return entry->build(responder, address, reply);
+}
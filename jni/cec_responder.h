@@ -0,0 +1,58 @@
+#ifndef SUNXI_HDMI_CEC_RESPONDER_H
+#define SUNXI_HDMI_CEC_RESPONDER_H
+
+#include <hardware/hdmi_cec.h>
+
+#include <stdint.h>
+
+/*
+ * Table-driven answers to the mandatory CEC queries, built from cached
+ * HAL state on the reader thread instead of round-tripping through the
+ * framework.
+ */
+
+#define CEC_OSD_NAME_MAX 14
+
+#define CEC_POWER_STATUS_ON 0x00
+#define CEC_POWER_STATUS_STANDBY 0x01
+
+#define CEC_DECK_INFO_NO_MEDIA 0x20
+
+struct cec_responder {
+    /* cached state replies are built from */
+    uint16_t physical_address;
+    int device_type;
+    uint32_t vendor_id;
+    int cec_version;
+    int power_status;
+    int deck_info;
+    uint32_t language;      /* ISO 639-2, e.g. 0x656e67 for "eng"; 0 if unknown */
+    char osd_name[CEC_OSD_NAME_MAX + 1];
+
+    /* opcodes answered by this product (bit per opcode) */
+    uint32_t enabled[256 / 32];
+};
+
+/*
+ * Loads the per-product configuration:
+ *   ro.hdmi.device_type          device type for addresses without one
+ *                                (default playback)
+ *   ro.hdmi.cec.osd_name         OSD name; unset leaves <Give OSD Name> to
+ *                                the framework and the user's device name
+ *   ro.hdmi.cec.auto_reply       "all", "none" or a comma separated list
+ *                                of opcodes to answer (default "all")
+ */
+void cec_responder_init(struct cec_responder *responder, uint32_t vendor_id, int cec_version);
+
+/*
+ * Builds the reply to opcode sent to our logical address into reply
+ * (opcode + operands); the device type reported follows that address.
+ * Queries only a TV answers, like <Get Menu Language>, get a Feature Abort
+ * from other device types. Returns its length, or 0 if the opcode is not
+ * answered here.
+ * *broadcast is set when the reply goes to all devices.
+ */
+size_t cec_responder_reply(const struct cec_responder *responder, int address, int opcode,
+                           unsigned char *reply, int *broadcast);
+
+#endif
@@ -0,0 +1,115 @@
+#define _GNU_SOURCE  /* CPU_SET and sched_setaffinity */
+
+#include "cec_sched.h"
+#include "cec_config.h"
+#include "log.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+void cec_sched_load(struct cec_sched *sched, const char *name) {
+    char key[PROP_NAME_MAX];
+    char value[PROP_VALUE_MAX];
+
+    memset(sched, 0, sizeof(*sched));
+    snprintf(sched->name, sizeof(sched->name), "%s", name);
+    atomic_init(&sched->result, 1);
+
+    snprintf(key, sizeof(key), "ro.hdmi.cec.sched.%s", name);
+    if (cec_config_get(key, value, "")) {
+        if (sscanf(value, "fifo:%d", &sched->value) == 1 &&
+            sched->value >= sched_get_priority_min(SCHED_FIFO) &&
+            sched->value <= sched_get_priority_max(SCHED_FIFO)) {
+            sched->kind = CEC_SCHED_FIFO;
+        } else if (sscanf(value, "nice:%d", &sched->value) == 1) {
+            sched->kind = CEC_SCHED_NICE;
+        } else {
+            ALOGW("cec_sched_load: invalid %s: %s", key, value);
+        }
+    }
+
+    snprintf(key, sizeof(key), "ro.hdmi.cec.cpus.%s", name);
+    if (cec_config_get(key, value, "")) {
+        sched->cpus = strtoul(value, NULL, 0);
+    }
+    sched->lock_stack = cec_config_get_int("ro.hdmi.cec.mlock", 0) != 0;
+}
+
+// Locks the stack from just below the caller's frame upwards, the part
+// a CEC thread actually uses.
+static int lock_stack(void) {
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t top = ((uintptr_t) __builtin_frame_address(0) + page - 1) & ~(page - 1);
+    if (mlock((void *) (top - CEC_SCHED_STACK_LOCK), CEC_SCHED_STACK_LOCK) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+
+int cec_sched_apply(struct cec_sched *sched) {
+    if (sched == NULL) {
+        return 0;
+    }
+
+    char thread_name[16];
+    snprintf(thread_name, sizeof(thread_name), "cec-%s", sched->name);
+    prctl(PR_SET_NAME, thread_name, 0, 0, 0);
+
+    int result = 0;
+    if (sched->kind == CEC_SCHED_FIFO) {
+        struct sched_param param = {.sched_priority = sched->value};
+        if (sched_setscheduler(0, SCHED_FIFO, &param) < 0) {
+            result = -errno;
+        }
+    } else if (sched->kind == CEC_SCHED_NICE) {
+        if (setpriority(PRIO_PROCESS, 0, sched->value) < 0) {
+            result = -errno;
+        }
+    }
+
+    if (sched->cpus) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (unsigned int cpu = 0; cpu < sizeof(sched->cpus) * 8; cpu++) {
+            if (sched->cpus & (1UL << cpu)) {
+                CPU_SET(cpu, &set);
+            }
+        }
+        if (sched_setaffinity(0, sizeof(set), &set) < 0 && !result) {
+            result = -errno;
+        }
+    }
+
+    if (sched->lock_stack) {
+        int ret = lock_stack();
+        if (ret < 0 && !result) {
+            result = ret;
+        }
+    }
+
+    if (result < 0) {
+        ALOGW("cec_sched_apply: %s: %s", sched->name, strerror(-result));
+    }
+    atomic_store(&sched->result, result);
+    return result;
+}
+
+void cec_sched_describe(const struct cec_sched *sched, char *buffer, size_t size) {
+    static const char *kinds[] = {"default", "nice", "fifo"};
+    int length = snprintf(buffer, size, "%s=%s", sched->name, kinds[sched->kind]);
+    if (sched->kind != CEC_SCHED_INHERIT && length < (int) size) {
+        length += snprintf(buffer + length, size - length, ":%d", sched->value);
+    }
+    if (length < (int) size) {
+        snprintf(buffer + length, size - length, " cpus=%#lx mlock=%d result=%d", sched->cpus,
+                 sched->lock_stack, atomic_load((atomic_int *) &sched->result));
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef SUNXI_HDMI_CEC_SCHED_H
+#define SUNXI_HDMI_CEC_SCHED_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+/*
+ * Scheduling of a HAL thread, configured per thread name:
+ *   ro.hdmi.cec.sched.<name>  "fifo:<1-99>" for SCHED_FIFO, "nice:<n>"
+ *   ro.hdmi.cec.cpus.<name>   CPU mask, e.g. 0x8
+ *   ro.hdmi.cec.mlock         1 to lock the thread's stack (and the
+ *                             device context) into memory
+ * Unset leaves the thread as created. Each thread applies its own
+ * settings when it starts, so nothing needs another thread's id.
+ */
+
+#define CEC_SCHED_STACK_LOCK (64 * 1024)
+
+enum cec_sched_kind {
+    CEC_SCHED_INHERIT,
+    CEC_SCHED_NICE,
+    CEC_SCHED_FIFO,
+};
+
+struct cec_sched {
+    char name[12];          /* also the property suffix; the thread is cec-<name> */
+    int kind;               /* enum cec_sched_kind */
+    int value;              /* nice level or SCHED_FIFO priority */
+    unsigned long cpus;     /* 0 for any */
+    int lock_stack;
+    atomic_int result;      /* 0, -errno of the first failure, or 1 until applied */
+};
+
+/* Reads the properties of thread name. */
+void cec_sched_load(struct cec_sched *sched, const char *name);
+
+/* Applies sched (may be NULL) to the calling thread; returns its result. */
+int cec_sched_apply(struct cec_sched *sched);
+
+/* Formats e.g. "io=fifo:50 cpus=0x8 result=0" for the dump. */
+void cec_sched_describe(const struct cec_sched *sched, char *buffer, size_t size);
+
+#endif
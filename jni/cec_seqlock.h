@@ -0,0 +1,97 @@
+#ifndef SUNXI_HDMI_CEC_SEQLOCK_H
+#define SUNXI_HDMI_CEC_SEQLOCK_H
+
+#include <stdatomic.h>
+
+#include <pthread.h>
+#include <sched.h>
+
+/*
+ * Sequence locks for state that is written rarely and read from any
+ * thread without blocking. The sequence is odd while a write is in
+ * progress; a reader copies the data and retries if the sequence was odd
+ * or moved meanwhile.
+ *
+ * Two flavours share the read side:
+ *  - struct cec_seqlock: writers from any thread serialise on a mutex,
+ *    so a writer never spins against a preempted one.
+ *  - cec_seqlock_slot_begin/end: ring slots whose writer owns them by
+ *    index; the sequence ends at 2 * (index + 1) so that a reader can
+ *    tell both torn and overwritten records.
+ */
+
+/* Reader spins before giving the CPU to a writer in progress. */
+#define CEC_SEQLOCK_SPINS 64
+
+struct cec_seqlock {
+    atomic_uint sequence;
+    pthread_mutex_t writer;
+};
+
+static inline void cec_seqlock_init(struct cec_seqlock *lock) {
+    atomic_init(&lock->sequence, 0);
+    pthread_mutex_init(&lock->writer, NULL);
+}
+
+static inline void cec_seqlock_destroy(struct cec_seqlock *lock) {
+    pthread_mutex_destroy(&lock->writer);
+}
+
+static inline void cec_seqlock_write_begin(struct cec_seqlock *lock) {
+    pthread_mutex_lock(&lock->writer);
+    unsigned int seq = atomic_load_explicit(&lock->sequence, memory_order_relaxed);
+    atomic_store_explicit(&lock->sequence, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void cec_seqlock_write_end(struct cec_seqlock *lock) {
+    unsigned int seq = atomic_load_explicit(&lock->sequence, memory_order_relaxed);
+    atomic_store_explicit(&lock->sequence, seq + 1, memory_order_release);
+    pthread_mutex_unlock(&lock->writer);
+}
+
+/*
+ * Waits out a write in progress and returns the sequence to check against.
+ * A writer can be preempted mid-write on the reader's CPU. sched_yield()
+ * only hands the CPU to threads of the same priority, so a SCHED_FIFO
+ * reader then also waits for the writer on its mutex.
+ */
+static inline unsigned int cec_seqlock_read_begin(struct cec_seqlock *lock) {
+    unsigned int seq;
+    for (int spins = 0; (seq = atomic_load_explicit(&lock->sequence, memory_order_acquire)) & 1; spins++) {
+        if (spins >= CEC_SEQLOCK_SPINS) {
+            sched_yield();
+            pthread_mutex_lock(&lock->writer);
+            pthread_mutex_unlock(&lock->writer);
+        }
+    }
+    return seq;
+}
+
+/* Nonzero if the copy made since cec_seqlock_read_begin may be torn. */
+static inline int cec_seqlock_read_retry(struct cec_seqlock *lock, unsigned int seq) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&lock->sequence, memory_order_relaxed) != seq;
+}
+
+static inline void cec_seqlock_slot_begin(atomic_uint *sequence, unsigned int index) {
+    atomic_store_explicit(sequence, 2 * index + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void cec_seqlock_slot_end(atomic_uint *sequence, unsigned int index) {
+    atomic_store_explicit(sequence, 2 * index + 2, memory_order_release);
+}
+
+/* Nonzero if the slot holds the complete record for index; copy it, then check cec_seqlock_slot_retry. */
+static inline int cec_seqlock_slot_ready(const atomic_uint *sequence, unsigned int index) {
+    return atomic_load_explicit((atomic_uint *) sequence, memory_order_acquire) == 2 * index + 2;
+}
+
+/* Nonzero if the record copied since cec_seqlock_slot_ready may be torn or overwritten. */
+static inline int cec_seqlock_slot_retry(const atomic_uint *sequence, unsigned int index) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit((atomic_uint *) sequence, memory_order_relaxed) != 2 * index + 2;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "cec_stats.h"
+
+#include <hardware/hdmi_cec.h>
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *const stage_names[CEC_STAGE_COUNT] = {
+        [CEC_STAGE_RX_READ_TO_HANDLE] = "rx read->handle",
+        [CEC_STAGE_RX_READ_TO_REPLY] = "rx read->reply sent",
+        [CEC_STAGE_RX_READ_TO_CALLBACK] = "rx read->callback",
+        [CEC_STAGE_RX_CALLBACK] = "rx callback",
+        [CEC_STAGE_RX_READ_TO_KEY] = "rx read->key event",
+        [CEC_STAGE_TX_QUEUE] = "tx submit->write",
+        [CEC_STAGE_TX_WIRE] = "tx write",
+        [CEC_STAGE_TX_TOTAL] = "tx submit->complete",
+};
+
+static const char *const result_names[4] = {
+        [HDMI_RESULT_SUCCESS] = "success",
+        [HDMI_RESULT_NACK] = "nack",
+        [HDMI_RESULT_BUSY] = "busy",
+        [HDMI_RESULT_FAIL] = "fail",
+};
+
+void cec_hist_record(struct cec_hist *hist, uint64_t ns) {
+    uint64_t us = ns / 1000;
+    unsigned int bucket = us ? 64 - __builtin_clzll(us) : 0;
+    if (bucket >= CEC_HIST_BUCKETS) {
+        bucket = CEC_HIST_BUCKETS - 1;
+    }
+
+    atomic_fetch_add_explicit(&hist->buckets[bucket], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->sum_us, us, memory_order_relaxed);
+
+    unsigned int max = atomic_load_explicit(&hist->max_us, memory_order_relaxed);
+    unsigned int value = us > UINT32_MAX ? UINT32_MAX : us;
+    while (value > max &&
+           !atomic_compare_exchange_weak_explicit(&hist->max_us, &max, value,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+uint64_t cec_hist_percentile(const struct cec_hist *hist, unsigned int percent) {
+    uint64_t count = atomic_load_explicit(&hist->count, memory_order_relaxed);
+    uint64_t target = (count * percent + 99) / 100;
+    uint64_t seen = 0;
+
+    for (unsigned int i = 0; i < CEC_HIST_BUCKETS; i++) {
+        seen += atomic_load_explicit(&hist->buckets[i], memory_order_relaxed);
+        if (seen >= target && seen > 0) {
+            return 1ULL << i;
+        }
+    }
+    return 0;
+}
+
+void cec_stats_reset(struct cec_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+void cec_stats_stage(struct cec_stats *stats, enum cec_stage stage, uint64_t start_ns, uint64_t end_ns) {
+    if (start_ns && end_ns >= start_ns) {
+        cec_hist_record(&stats->stage[stage], end_ns - start_ns);
+    }
+}
+
+static void dump_hist(int fd, const char *name, const struct cec_hist *hist) {
+    uint64_t count = atomic_load_explicit(&hist->count, memory_order_relaxed);
+    if (!count) {
+        return;
+    }
+
+    dprintf(fd, "  %-22s %8llu %9llu %9llu %9llu %9llu %9u\n", name,
+            (unsigned long long) count,
+            (unsigned long long) (atomic_load_explicit(&hist->sum_us, memory_order_relaxed) / count),
+            (unsigned long long) cec_hist_percentile(hist, 50),
+            (unsigned long long) cec_hist_percentile(hist, 90),
+            (unsigned long long) cec_hist_percentile(hist, 99),
+            atomic_load_explicit(&hist->max_us, memory_order_relaxed));
+}
+
+static void dump_opcodes(int fd, const char *prefix, const struct cec_hist *hists) {
+    char name[32];
+    for (int i = 0; i < CEC_HIST_OPCODES; i++) {
+        if (i == CEC_HIST_POLL) {
+            snprintf(name, sizeof(name), "%s poll", prefix);
+        } else {
+            snprintf(name, sizeof(name), "%s 0x%02x", prefix, i);
+        }
+        dump_hist(fd, name, &hists[i]);
+    }
+}
+
+void cec_stats_dump(struct cec_stats *stats, int fd) {
+    dprintf(fd, "latency (us, percentiles are bucket upper bounds):\n");
+    dprintf(fd, "  %-22s %8s %9s %9s %9s %9s %9s\n", "", "count", "mean", "p50", "p90", "p99", "max");
+    for (int i = 0; i < CEC_STAGE_COUNT; i++) {
+        dump_hist(fd, stage_names[i], &stats->stage[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "tx %s", result_names[i]);
+        dump_hist(fd, name, &stats->tx_result[i]);
+    }
+    dump_opcodes(fd, "rx", stats->rx_opcode);
+    dump_opcodes(fd, "tx", stats->tx_opcode);
+}
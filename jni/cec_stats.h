@@ -0,0 +1,76 @@
+#ifndef SUNXI_HDMI_CEC_STATS_H
+#define SUNXI_HDMI_CEC_STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Lock-free latency histograms. Bucket n counts samples in
+ * [2^(n-1), 2^n) microseconds, bucket 0 those under 1 us, so
+ * recording is a handful of relaxed atomic adds from any thread.
+ */
+
+#define CEC_HIST_BUCKETS 26     /* the last bucket holds everything over 16 s */
+#define CEC_HIST_OPCODES 257    /* one per opcode, plus polling messages */
+#define CEC_HIST_POLL 256
+
+struct cec_hist {
+    atomic_uint buckets[CEC_HIST_BUCKETS];
+    atomic_ullong count;
+    atomic_ullong sum_us;
+    atomic_uint max_us;
+};
+
+enum cec_stage {
+    CEC_STAGE_RX_READ_TO_HANDLE,    /* read returned -> handle_cec_event */
+    CEC_STAGE_RX_READ_TO_REPLY,     /* read returned -> auto-reply on the wire */
+    CEC_STAGE_RX_READ_TO_CALLBACK,  /* read returned -> framework callback entry */
+    CEC_STAGE_RX_CALLBACK,          /* framework callback entry -> exit */
+    CEC_STAGE_RX_READ_TO_KEY,       /* read returned -> uinput key event written */
+    CEC_STAGE_TX_QUEUE,             /* submit -> write started */
+    CEC_STAGE_TX_WIRE,              /* write started -> write returned */
+    CEC_STAGE_TX_TOTAL,             /* submit -> complete */
+    CEC_STAGE_COUNT
+};
+
+struct cec_stats {
+    struct cec_hist stage[CEC_STAGE_COUNT];
+    struct cec_hist rx_opcode[CEC_HIST_OPCODES];   /* read -> callback entry */
+    struct cec_hist tx_opcode[CEC_HIST_OPCODES];   /* submit -> complete */
+    struct cec_hist tx_result[4];                  /* submit -> complete, by HDMI_RESULT_* */
+};
+
+static inline uint64_t cec_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Counters bumped by one thread and read by any: a relaxed load and
+ * store, so no locked read-modify-write on the frame paths.
+ */
+static inline void cec_counter_add(atomic_ullong *counter, uint64_t n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+static inline uint64_t cec_counter_get(atomic_ullong *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+void cec_hist_record(struct cec_hist *hist, uint64_t ns);
+
+/* Upper bound in microseconds of the bucket holding the given percentile. */
+uint64_t cec_hist_percentile(const struct cec_hist *hist, unsigned int percent);
+
+void cec_stats_reset(struct cec_stats *stats);
+
+/* Records start_ns -> end_ns in a stage histogram; a zero start is ignored. */
+void cec_stats_stage(struct cec_stats *stats, enum cec_stage stage, uint64_t start_ns, uint64_t end_ns);
+
+/* Writes all non-empty histograms to fd as text. */
+void cec_stats_dump(struct cec_stats *stats, int fd);
+
+#endif
@@ -0,0 +1,179 @@
+#include "cec_topology.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <hardware/hdmi_cec.h>
+
+static const struct sunxi_cec_topology_entry unknown_entry = {
+        .vendor_id = SUNXI_CEC_TOPOLOGY_UNKNOWN_VENDOR,
+        .physical_address = SUNXI_CEC_TOPOLOGY_UNKNOWN_ADDRESS,
+        .device_type = -1,
+        .power_status = -1,
+        .cec_version = -1,
+};
+
+// Two threads may write the same slot, so writers take its lock.
+static struct sunxi_cec_topology_entry *write_begin(struct cec_topology_slot *slot) {
+    cec_seqlock_write_begin(&slot->lock);
+    return &slot->entry;
+}
+
+static void write_end(struct cec_topology_slot *slot) {
+    cec_seqlock_write_end(&slot->lock);
+}
+
+void cec_topology_init(struct cec_topology *topology) {
+    for (int address = 0; address < CEC_TOPOLOGY_SIZE; address++) {
+        cec_seqlock_init(&topology->slots[address].lock);
+    }
+    cec_topology_reset(topology);
+}
+
+void cec_topology_destroy(struct cec_topology *topology) {
+    for (int address = 0; address < CEC_TOPOLOGY_SIZE; address++) {
+        cec_seqlock_destroy(&topology->slots[address].lock);
+    }
+}
+
+void cec_topology_reset(struct cec_topology *topology) {
+    for (int address = 0; address < CEC_TOPOLOGY_SIZE; address++) {
+        struct cec_topology_slot *slot = &topology->slots[address];
+        *write_begin(slot) = unknown_entry;
+        write_end(slot);
+    }
+    atomic_store_explicit(&topology->active_source, -1, memory_order_relaxed);
+}
+
+static uint16_t operand_address(const unsigned char *operands) {
+    return operands[0] << 8 | operands[1];
+}
+
+// A physical address belongs to one device; whoever reported it before
+// has been replaced or moved.
+static void release_physical_address(struct cec_topology *topology, int owner, uint16_t physical_address) {
+    for (int address = 0; address < CEC_TOPOLOGY_SIZE; address++) {
+        struct cec_topology_slot *slot = &topology->slots[address];
+        if (address == owner || slot->entry.physical_address != physical_address) {
+            continue;
+        }
+        struct sunxi_cec_topology_entry *entry = write_begin(slot);
+        if (entry->physical_address == physical_address) {
+            entry->physical_address = SUNXI_CEC_TOPOLOGY_UNKNOWN_ADDRESS;
+        }
+        write_end(slot);
+    }
+}
+
+void cec_topology_observe(struct cec_topology *topology, int initiator, int destination,
+                          const unsigned char *body, size_t length, uint64_t now_ns) {
+    // unregistered devices share address 15 and cannot be told apart
+    if (initiator < 0 || initiator >= CEC_TOPOLOGY_SIZE) {
+        return;
+    }
+
+    int opcode = length ? body[0] : -1;
+    const unsigned char *operands = length ? body + 1 : NULL;
+    size_t count = length ? length - 1 : 0;
+    uint16_t reported = SUNXI_CEC_TOPOLOGY_UNKNOWN_ADDRESS;
+
+    struct cec_topology_slot *slot = &topology->slots[initiator];
+    struct sunxi_cec_topology_entry *entry = write_begin(slot);
+    entry->last_seen_ns = now_ns;
+
+    switch (opcode) {
+        case CEC_MESSAGE_REPORT_PHYSICAL_ADDRESS:
+            if (count >= 3) {
+                reported = entry->physical_address = operand_address(operands);
+                entry->device_type = operands[2];
+            }
+            break;
+
+        case CEC_MESSAGE_ACTIVE_SOURCE:
+            if (count >= 2) {
+                reported = entry->physical_address = operand_address(operands);
+                atomic_store_explicit(&topology->active_source, initiator, memory_order_relaxed);
+            }
+            break;
+
+        case CEC_MESSAGE_INACTIVE_SOURCE: {
+            int expected = initiator;
+            atomic_compare_exchange_strong_explicit(&topology->active_source, &expected, -1,
+                                                    memory_order_relaxed, memory_order_relaxed);
+            break;
+        }
+
+        case CEC_MESSAGE_DEVICE_VENDOR_ID:
+            if (count >= 3) {
+                entry->vendor_id = operands[0] << 16 | operands[1] << 8 | operands[2];
+            }
+            break;
+
+        case CEC_MESSAGE_SET_OSD_NAME:
+            if (count >= 1) {
+                if (count > sizeof(entry->osd_name) - 1) {
+                    count = sizeof(entry->osd_name) - 1;
+                }
+                memcpy(entry->osd_name, operands, count);
+                entry->osd_name[count] = 0;
+            }
+            break;
+
+        case CEC_MESSAGE_REPORT_POWER_STATUS:
+            if (count >= 1) {
+                entry->power_status = operands[0];
+            }
+            break;
+
+        case CEC_MESSAGE_CEC_VERSION:
+            if (count >= 1) {
+                entry->cec_version = operands[0];
+            }
+            break;
+    }
+    write_end(slot);
+
+    if (reported != SUNXI_CEC_TOPOLOGY_UNKNOWN_ADDRESS) {
+        release_physical_address(topology, initiator, reported);
+    }
+    atomic_fetch_add_explicit(&topology->updates, 1, memory_order_relaxed);
+}
+
+int cec_topology_get(struct cec_topology *topology, int address, struct sunxi_cec_topology_entry *entry) {
+    if (address < 0 || address >= CEC_TOPOLOGY_SIZE) {
+        return -EINVAL;
+    }
+
+    struct cec_topology_slot *slot = &topology->slots[address];
+    unsigned int sequence;
+    do {
+        sequence = cec_seqlock_read_begin(&slot->lock);
+        *entry = slot->entry;
+    } while (cec_seqlock_read_retry(&slot->lock, sequence));
+
+    if (!entry->last_seen_ns) {
+        return -ENOENT;
+    }
+    entry->active_source = atomic_load_explicit(&topology->active_source, memory_order_relaxed) == address;
+    return 0;
+}
+
+void cec_topology_dump(struct cec_topology *topology, int fd) {
+    dprintf(fd, "topology: updates=%llu active_source=%d\n",
+            (unsigned long long) atomic_load_explicit(&topology->updates, memory_order_relaxed),
+            atomic_load_explicit(&topology->active_source, memory_order_relaxed));
+
+    for (int address = 0; address < CEC_TOPOLOGY_SIZE; address++) {
+        struct sunxi_cec_topology_entry entry;
+        if (cec_topology_get(topology, address, &entry) < 0) {
+            continue;
+        }
+        dprintf(fd, "  %2d: pa=%04x type=%d vendor=%06x power=%d version=%d active=%d seen=%llu.%06llu name=\"%s\"\n",
+                address, entry.physical_address, entry.device_type, entry.vendor_id,
+                entry.power_status, entry.cec_version, entry.active_source,
+                (unsigned long long) (entry.last_seen_ns / 1000000000ULL),
+                (unsigned long long) (entry.last_seen_ns % 1000000000ULL / 1000),
+                entry.osd_name);
+    }
+}
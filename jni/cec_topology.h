@@ -0,0 +1,50 @@
+#ifndef SUNXI_HDMI_CEC_TOPOLOGY_H
+#define SUNXI_HDMI_CEC_TOPOLOGY_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cec_seqlock.h"
+#include "sunxi_cec.h"
+
+/*
+ * What we know about every logical address, learned only by watching
+ * frames go by. The reader and transmit threads both write; each entry
+ * is a seqlock so that queries from any thread never block them.
+ */
+
+#define CEC_TOPOLOGY_SIZE 15    /* logical addresses 0..14 */
+
+struct cec_topology_slot {
+    struct cec_seqlock lock;
+    struct sunxi_cec_topology_entry entry;
+};
+
+struct cec_topology {
+    atomic_int active_source;   /* logical address, or -1 */
+    atomic_uint_least64_t updates;
+    struct cec_topology_slot slots[CEC_TOPOLOGY_SIZE];
+};
+
+/* Sets up the slot locks and starts with every device unknown. */
+void cec_topology_init(struct cec_topology *topology);
+void cec_topology_destroy(struct cec_topology *topology);
+
+/* Forgets every device, e.g. when the sink goes away; safe at any time. */
+void cec_topology_reset(struct cec_topology *topology);
+
+/*
+ * Learns from a frame that was received, or that we transmitted and
+ * was acknowledged; body starts with the opcode. The destination of an
+ * acknowledged frame is passed as initiator with no body.
+ */
+void cec_topology_observe(struct cec_topology *topology, int initiator, int destination,
+                          const unsigned char *body, size_t length, uint64_t now_ns);
+
+/* Returns 0 and a consistent copy of the entry, or -ENOENT if never seen. */
+int cec_topology_get(struct cec_topology *topology, int address, struct sunxi_cec_topology_entry *entry);
+
+void cec_topology_dump(struct cec_topology *topology, int fd);
+
+#endif
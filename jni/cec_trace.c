@@ -0,0 +1,85 @@
+#include "cec_seqlock.h"
+#include "cec_stats.h"
+#include "cec_trace.h"
+#include "log.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int cec_log_level = ANDROID_LOG_INFO;
+
+static const char *const direction_names[] = {
+        [CEC_TRACE_RX] = "rx",
+        [CEC_TRACE_TX] = "tx",
+        [CEC_TRACE_HOTPLUG] = "hotplug",
+};
+
+void cec_trace_reset(struct cec_trace *trace) {
+    memset(trace, 0, sizeof(*trace));
+}
+
+void cec_trace_add(struct cec_trace *trace, int direction, int header, const unsigned char *body,
+                   size_t length, int result, int error) {
+    unsigned int index = atomic_fetch_add_explicit(&trace->next, 1, memory_order_relaxed);
+    struct cec_trace_slot *slot = &trace->slots[index % CEC_TRACE_SIZE];
+
+    cec_seqlock_slot_begin(&slot->sequence, index);
+
+    slot->record.ns = cec_now_ns();
+    slot->record.direction = direction;
+    slot->record.header = header;
+    slot->record.opcode = length ? body[0] : 0;
+    slot->record.length = length;
+    slot->record.result = result;
+    slot->record.error = error;
+
+    cec_seqlock_slot_end(&slot->sequence, index);
+}
+
+static int read_record(struct cec_trace *trace, unsigned int index, struct cec_trace_record *record) {
+    struct cec_trace_slot *slot = &trace->slots[index % CEC_TRACE_SIZE];
+
+    if (!cec_seqlock_slot_ready(&slot->sequence, index)) {
+        return 0;
+    }
+    *record = slot->record;
+    return !cec_seqlock_slot_retry(&slot->sequence, index);
+}
+
+void cec_trace_dump(struct cec_trace *trace, int fd, unsigned int count) {
+    unsigned int end = atomic_load_explicit(&trace->next, memory_order_acquire);
+    if (count > CEC_TRACE_SIZE) {
+        count = CEC_TRACE_SIZE;
+    }
+    unsigned int start = end > count ? end - count : 0;
+
+    dprintf(fd, "trace: %u records, showing %u\n", end, end - start);
+    for (unsigned int index = start; index != end; index++) {
+        struct cec_trace_record record;
+        if (!read_record(trace, index, &record)) {
+            continue;
+        }
+
+        const char *direction = record.direction < sizeof(direction_names) / sizeof(direction_names[0]) &&
+                                direction_names[record.direction] ? direction_names[record.direction] : "?";
+        if (record.direction == CEC_TRACE_HOTPLUG) {
+            dprintf(fd, "  %llu.%06llu %-7s port=%d connected=%d\n",
+                    (unsigned long long) (record.ns / 1000000000ULL),
+                    (unsigned long long) (record.ns % 1000000000ULL / 1000),
+                    direction, record.header, record.result);
+            continue;
+        }
+
+        char opcode[8];
+        if (record.length) {
+            snprintf(opcode, sizeof(opcode), "%02x", record.opcode);
+        } else {
+            snprintf(opcode, sizeof(opcode), "poll");
+        }
+        dprintf(fd, "  %llu.%06llu %-7s %x->%x opcode=%s length=%u result=%d errno=%d\n",
+                (unsigned long long) (record.ns / 1000000000ULL),
+                (unsigned long long) (record.ns % 1000000000ULL / 1000),
+                direction, record.header >> 4, record.header & 0x0f, opcode,
+                record.length, record.result, record.error);
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef SUNXI_HDMI_CEC_TRACE_H
+#define SUNXI_HDMI_CEC_TRACE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Fixed-size binary trace of every frame and hotplug event. Writers from
+ * any thread claim a slot with one atomic add and never format or block;
+ * records are only turned into text by cec_trace_dump().
+ */
+
+#define CEC_TRACE_SIZE 1024     /* power of two */
+
+enum cec_trace_direction {
+    CEC_TRACE_RX = 1,
+    CEC_TRACE_TX = 2,
+    CEC_TRACE_HOTPLUG = 3,
+};
+
+struct cec_trace_record {
+    uint64_t ns;            /* CLOCK_MONOTONIC */
+    uint8_t direction;
+    uint8_t header;         /* initiator << 4 | destination; port for hotplug */
+    uint8_t opcode;
+    uint8_t length;         /* body length; 0 for polling messages */
+    int8_t result;          /* HDMI_RESULT_* for TX, connected for hotplug */
+    uint8_t reserved;
+    int16_t error;          /* errno, if any */
+};
+
+struct cec_trace_slot {
+    atomic_uint sequence;   /* odd while being written */
+    struct cec_trace_record record;
+};
+
+struct cec_trace {
+    atomic_uint next;
+    struct cec_trace_slot slots[CEC_TRACE_SIZE];
+};
+
+void cec_trace_reset(struct cec_trace *trace);
+
+void cec_trace_add(struct cec_trace *trace, int direction, int header, const unsigned char *body,
+                   size_t length, int result, int error);
+
+/* Formats up to the last count records to fd, oldest first. */
+void cec_trace_dump(struct cec_trace *trace, int fd, unsigned int count);
+
+#endif
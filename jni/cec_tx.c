@@ -0,0 +1,505 @@
+#define LOG_TAG "sunxi-hdmi-cec"
+
+#include "cec_stats.h"
+#include "cec_tx.h"
+#include "log.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Polls are how the framework finds free addresses, so a NACK is an
+ * answer there. Key presses are worthless once late.
+ */
+static const struct cec_tx_retry_policy default_retry[CEC_TX_PRIORITY_COUNT] = {
+        [CEC_TX_PRIORITY_USER_CONTROL] = {.nack_retries = 1, .busy_retries = 3},
+        [CEC_TX_PRIORITY_NORMAL] = {.nack_retries = 2, .busy_retries = 5},
+        [CEC_TX_PRIORITY_STATUS] = {.nack_retries = 2, .busy_retries = 5},
+        [CEC_TX_PRIORITY_POLL] = {.nack_retries = 0, .busy_retries = 2},
+};
+
+struct cec_tx_waiter {
+    pthread_cond_t done;
+    int completed;
+    int result;
+};
+
+static struct cec_tx_entry *dequeue_locked(struct cec_tx *tx) {
+    for (int priority = 0; priority < CEC_TX_PRIORITY_COUNT; priority++) {
+        struct cec_tx_entry *entry = tx->head[priority];
+        if (entry) {
+            tx->head[priority] = entry->next;
+            if (!tx->head[priority]) {
+                tx->tail[priority] = NULL;
+            }
+            entry->next = NULL;
+            tx->queued--;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void release_locked(struct cec_tx *tx, struct cec_tx_entry *entry) {
+    entry->waiter = NULL;
+    entry->next = tx->free_list;
+    tx->free_list = entry;
+}
+
+static void finish_locked(struct cec_tx *tx, struct cec_tx_entry *entry, int result) {
+    if (entry->waiter) {
+        entry->waiter->result = result;
+        entry->waiter->completed = 1;
+        pthread_cond_signal(&entry->waiter->done);
+    }
+    release_locked(tx, entry);
+}
+
+static int retry_delay_us(const struct cec_tx *tx, const struct cec_tx_entry *entry, int result) {
+    const struct cec_tx_retry_policy *policy = &tx->retry[entry->priority];
+    int retries = entry->attempts - 1;
+
+    if (result == HDMI_RESULT_NACK && retries < policy->nack_retries) {
+        return CEC_SIGNAL_FREE_RETRANSMIT * CEC_BIT_PERIOD_US;
+    }
+    if (result == HDMI_RESULT_BUSY && retries < policy->busy_retries) {
+        // whoever won the bus goes first; we start again as a new initiator
+        return CEC_SIGNAL_FREE_NEW_INITIATOR * CEC_BIT_PERIOD_US;
+    }
+    return 0;
+}
+
+// Sleeps for the signal free time unless the engine is stopped meanwhile.
+static void wait_signal_free_locked(struct cec_tx *tx, int delay_us) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_nsec += delay_us * 1000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while (!tx->stopped) {
+        if (pthread_cond_timedwait(&tx->wakeup, &tx->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+}
+
+static int is_state_report(const cec_message_t *msg) {
+    if (msg->length == 0) {
+        return 0;
+    }
+
+    switch (msg->body[0]) {
+        case CEC_MESSAGE_REPORT_POWER_STATUS:
+        case CEC_MESSAGE_ACTIVE_SOURCE:
+        case CEC_MESSAGE_INACTIVE_SOURCE:
+        case CEC_MESSAGE_REPORT_PHYSICAL_ADDRESS:
+        case CEC_MESSAGE_DEVICE_VENDOR_ID:
+        case CEC_MESSAGE_SET_OSD_NAME:
+        case CEC_MESSAGE_SET_MENU_LANGUAGE:
+        case CEC_MESSAGE_CEC_VERSION:
+        case CEC_MESSAGE_DECK_STATUS:
+        case CEC_MESSAGE_MENU_STATUS:
+        case CEC_MESSAGE_TUNER_DEVICE_STATUS:
+        case CEC_MESSAGE_REPORT_AUDIO_STATUS:
+        case CEC_MESSAGE_SYSTEM_AUDIO_MODE_STATUS:
+            return 1;
+
+        default:
+            return 0;
+    }
+}
+
+static int same_kind(const cec_message_t *a, const cec_message_t *b) {
+    return a->initiator == b->initiator && a->destination == b->destination &&
+           a->length && b->length && a->body[0] == b->body[0];
+}
+
+static int same_frame(const cec_message_t *a, const cec_message_t *b) {
+    return same_kind(a, b) && a->length == b->length && !memcmp(a->body, b->body, a->length);
+}
+
+static void remember_locked(struct cec_tx *tx, const cec_message_t *msg) {
+    if (!tx->dedup_window_ns || !is_state_report(msg)) {
+        return;
+    }
+
+    // One slot per kind of report so that the newest one wins.
+    struct cec_tx_sent *slot = NULL;
+    for (int i = 0; i < CEC_TX_HISTORY_SIZE && !slot; i++) {
+        if (tx->history[i].ns && same_kind(&tx->history[i].msg, msg)) {
+            slot = &tx->history[i];
+        }
+    }
+    if (!slot) {
+        slot = &tx->history[tx->history_next++ % CEC_TX_HISTORY_SIZE];
+    }
+    slot->msg = *msg;
+    slot->ns = cec_now_ns();
+}
+
+static int recently_sent_locked(struct cec_tx *tx, const cec_message_t *msg, uint64_t now) {
+    for (int i = 0; i < CEC_TX_HISTORY_SIZE; i++) {
+        const struct cec_tx_sent *sent = &tx->history[i];
+        if (sent->ns && now - sent->ns < tx->dedup_window_ns && same_frame(&sent->msg, msg)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Folds msg into a queued report of the same kind. Returns that entry, or
+ * NULL when msg has to be queued on its own.
+ */
+static struct cec_tx_entry *coalesce_locked(struct cec_tx *tx, const cec_message_t *msg,
+                                            int flags, struct cec_tx_waiter *waiter) {
+    for (int priority = 0; priority < CEC_TX_PRIORITY_COUNT; priority++) {
+        for (struct cec_tx_entry *entry = tx->head[priority]; entry; entry = entry->next) {
+            if (!same_kind(&entry->msg, msg)) {
+                continue;
+            }
+            if (waiter && entry->waiter) {
+                // both callers want their own result
+                return NULL;
+            }
+            if ((flags | entry->flags) & CEC_TX_NOTIFY) {
+                // each notifying submission owes its own TX_STATUS event
+                return NULL;
+            }
+
+            if (same_frame(&entry->msg, msg)) {
+                tx->coalesce_stats.merged++;
+            } else {
+                entry->msg = *msg;
+                tx->coalesce_stats.superseded++;
+            }
+            entry->flags |= flags;
+            if (waiter) {
+                entry->waiter = waiter;
+            }
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void *tx_thread(void *arg) {
+    struct cec_tx *tx = arg;
+
+    cec_sched_apply(tx->sched);
+    pthread_mutex_lock(&tx->lock);
+    while (!tx->stopped) {
+        struct cec_tx_entry *entry = dequeue_locked(tx);
+        if (!entry) {
+            pthread_cond_wait(&tx->wakeup, &tx->lock);
+            continue;
+        }
+
+        // The entry stays owned by us while unlocked; a waiter that times
+        // out only detaches itself from it.
+        struct cec_tx_entry job = *entry;
+        pthread_mutex_unlock(&tx->lock);
+
+        job.start_ns = cec_now_ns();
+        int result;
+        for (;;) {
+            job.attempts++;
+            result = tx->transmit(tx, &job.msg);
+
+            pthread_mutex_lock(&tx->lock);
+            int delay_us = retry_delay_us(tx, &job, result);
+            if (delay_us) {
+                struct cec_tx_retry_stats *stats = &tx->retry_stats[job.priority];
+                if (result == HDMI_RESULT_NACK) {
+                    stats->nack_retries++;
+                } else {
+                    stats->busy_retries++;
+                }
+                wait_signal_free_locked(tx, delay_us);
+            }
+            int stopped = tx->stopped;
+            pthread_mutex_unlock(&tx->lock);
+            if (!delay_us || stopped) {
+                break;
+            }
+        }
+        if (tx->complete) {
+            tx->complete(tx, &job, result);
+        }
+
+        pthread_mutex_lock(&tx->lock);
+        if (result == HDMI_RESULT_SUCCESS) {
+            remember_locked(tx, &job.msg);
+        }
+        if (job.attempts > 1) {
+            if (result == HDMI_RESULT_SUCCESS) {
+                tx->retry_stats[job.priority].recovered++;
+            } else {
+                tx->retry_stats[job.priority].exhausted++;
+            }
+        }
+        finish_locked(tx, entry, result);
+    }
+
+    // Fail whatever is left so that no caller waits for the timeout.
+    struct cec_tx_entry *entry;
+    while ((entry = dequeue_locked(tx)) != NULL) {
+        finish_locked(tx, entry, HDMI_RESULT_FAIL);
+    }
+    pthread_mutex_unlock(&tx->lock);
+    return NULL;
+}
+
+int cec_tx_start(struct cec_tx *tx, cec_tx_transmit_t transmit, cec_tx_complete_t complete, void *arg,
+                 struct cec_sched *sched) {
+    memset(tx, 0, sizeof(*tx));
+    tx->transmit = transmit;
+    tx->complete = complete;
+    tx->arg = arg;
+    tx->sched = sched;
+    memcpy(tx->retry, default_retry, sizeof(tx->retry));
+    tx->dedup_window_ns = CEC_TX_DEDUP_WINDOW_MS * 1000000ULL;
+
+    for (int i = CEC_TX_QUEUE_SIZE - 1; i >= 0; i--) {
+        release_locked(tx, &tx->entries[i]);
+    }
+
+    // the backoff waits on wakeup with an absolute monotonic deadline
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&tx->lock, NULL);
+    pthread_cond_init(&tx->wakeup, &attr);
+    pthread_condattr_destroy(&attr);
+
+    int ret = pthread_create(&tx->thread, NULL, tx_thread, tx);
+    if (ret != 0) {
+        ALOGE("cec_tx_start: unable to start thread: %d", ret);
+        pthread_cond_destroy(&tx->wakeup);
+        pthread_mutex_destroy(&tx->lock);
+        return -ret;
+    }
+
+    tx->running = 1;
+    return 0;
+}
+
+void cec_tx_stop(struct cec_tx *tx) {
+    if (!tx->running) {
+        return;
+    }
+
+    pthread_mutex_lock(&tx->lock);
+    tx->stopped = 1;
+    pthread_cond_signal(&tx->wakeup);
+    pthread_mutex_unlock(&tx->lock);
+
+    pthread_join(tx->thread, NULL);
+    tx->running = 0;
+
+    pthread_cond_destroy(&tx->wakeup);
+    pthread_mutex_destroy(&tx->lock);
+}
+
+void cec_tx_set_retry(struct cec_tx *tx, int priority, const struct cec_tx_retry_policy *policy) {
+    if (priority < 0 || priority >= CEC_TX_PRIORITY_COUNT) {
+        return;
+    }
+    pthread_mutex_lock(&tx->lock);
+    tx->retry[priority] = *policy;
+    pthread_mutex_unlock(&tx->lock);
+}
+
+void cec_tx_get_retry_stats(struct cec_tx *tx, struct cec_tx_retry_stats stats[CEC_TX_PRIORITY_COUNT]) {
+    if (!tx->running) {
+        memset(stats, 0, sizeof(tx->retry_stats));
+        return;
+    }
+    pthread_mutex_lock(&tx->lock);
+    memcpy(stats, tx->retry_stats, sizeof(tx->retry_stats));
+    pthread_mutex_unlock(&tx->lock);
+}
+
+void cec_tx_set_dedup_window(struct cec_tx *tx, int window_ms) {
+    pthread_mutex_lock(&tx->lock);
+    tx->dedup_window_ns = window_ms > 0 ? window_ms * 1000000ULL : 0;
+    memset(tx->history, 0, sizeof(tx->history));
+    pthread_mutex_unlock(&tx->lock);
+}
+
+void cec_tx_forget(struct cec_tx *tx, int destination, int opcode) {
+    pthread_mutex_lock(&tx->lock);
+    for (int i = 0; i < CEC_TX_HISTORY_SIZE; i++) {
+        struct cec_tx_sent *sent = &tx->history[i];
+        if ((destination < 0 || sent->msg.destination == destination) &&
+            (opcode < 0 || sent->msg.body[0] == opcode)) {
+            sent->ns = 0;
+        }
+    }
+    pthread_mutex_unlock(&tx->lock);
+}
+
+void cec_tx_get_coalesce_stats(struct cec_tx *tx, struct cec_tx_coalesce_stats *stats) {
+    if (!tx->running) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    pthread_mutex_lock(&tx->lock);
+    *stats = tx->coalesce_stats;
+    pthread_mutex_unlock(&tx->lock);
+}
+
+int cec_tx_classify(const cec_message_t *msg) {
+    if (msg->length == 0) {
+        return CEC_TX_PRIORITY_POLL;
+    }
+
+    switch (msg->body[0]) {
+        case CEC_MESSAGE_USER_CONTROL_PRESSED:
+        case CEC_MESSAGE_USER_CONTROL_RELEASED:
+        case CEC_MESSAGE_VENDOR_REMOTE_BUTTON_DOWN:
+        case CEC_MESSAGE_VENDOR_REMOTE_BUTTON_UP:
+            return CEC_TX_PRIORITY_USER_CONTROL;
+
+        case CEC_MESSAGE_REPORT_POWER_STATUS:
+        case CEC_MESSAGE_DECK_STATUS:
+        case CEC_MESSAGE_TUNER_DEVICE_STATUS:
+        case CEC_MESSAGE_REPORT_AUDIO_STATUS:
+        case CEC_MESSAGE_SYSTEM_AUDIO_MODE_STATUS:
+        case CEC_MESSAGE_MENU_STATUS:
+        case CEC_MESSAGE_RECORD_STATUS:
+        case CEC_MESSAGE_TIMER_STATUS:
+            return CEC_TX_PRIORITY_STATUS;
+
+        default:
+            return CEC_TX_PRIORITY_NORMAL;
+    }
+}
+
+static int submit_locked(struct cec_tx *tx, const cec_message_t *msg, int priority, int flags,
+                         uint64_t origin_ns, struct cec_tx_waiter *waiter, struct cec_tx_entry **out) {
+    if (tx->stopped || !tx->running) {
+        return -ENODEV;
+    }
+
+    if (is_state_report(msg)) {
+        uint64_t now = cec_now_ns();
+        // a caller asking for TX_STATUS gets a real transmission
+        if (tx->dedup_window_ns && !(flags & CEC_TX_NOTIFY) && recently_sent_locked(tx, msg, now)) {
+            tx->coalesce_stats.suppressed++;
+            if (waiter) {
+                waiter->result = HDMI_RESULT_SUCCESS;
+                waiter->completed = 1;
+            }
+            return 0;
+        }
+
+        struct cec_tx_entry *entry = coalesce_locked(tx, msg, flags, waiter);
+        if (entry) {
+            if (out) {
+                *out = entry;
+            }
+            return 0;
+        }
+    }
+
+    struct cec_tx_entry *entry = tx->free_list;
+    if (!entry) {
+        return -EAGAIN;
+    }
+    tx->free_list = entry->next;
+
+    if (priority < 0 || priority >= CEC_TX_PRIORITY_COUNT) {
+        priority = cec_tx_classify(msg);
+    }
+
+    entry->next = NULL;
+    entry->msg = *msg;
+    entry->priority = priority;
+    entry->flags = flags;
+    entry->attempts = 0;
+    entry->waiter = waiter;
+    entry->origin_ns = origin_ns;
+    entry->submit_ns = cec_now_ns();
+
+    if (tx->tail[priority]) {
+        tx->tail[priority]->next = entry;
+    } else {
+        tx->head[priority] = entry;
+    }
+    tx->tail[priority] = entry;
+    tx->queued++;
+
+    pthread_cond_signal(&tx->wakeup);
+    if (out) {
+        *out = entry;
+    }
+    return 0;
+}
+
+int cec_tx_submit(struct cec_tx *tx, const cec_message_t *msg, int priority, int flags, uint64_t origin_ns) {
+    if (msg->length > CEC_MESSAGE_BODY_MAX_LENGTH) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&tx->lock);
+    int ret = submit_locked(tx, msg, priority, flags, origin_ns, NULL, NULL);
+    pthread_mutex_unlock(&tx->lock);
+
+    if (ret < 0) {
+        ALOGW("cec_tx_submit: dropped destination=%d opcode=%02x: %d",
+              msg->destination, msg->length ? msg->body[0] : -1, ret);
+    }
+    return ret;
+}
+
+int cec_tx_send(struct cec_tx *tx, const cec_message_t *msg, int priority) {
+    if (msg->length > CEC_MESSAGE_BODY_MAX_LENGTH) {
+        return HDMI_RESULT_FAIL;
+    }
+
+    struct cec_tx_waiter waiter;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&waiter.done, &attr);
+    pthread_condattr_destroy(&attr);
+    waiter.completed = 0;
+    waiter.result = HDMI_RESULT_FAIL;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += CEC_TX_SEND_TIMEOUT_MS / 1000;
+    deadline.tv_nsec += (CEC_TX_SEND_TIMEOUT_MS % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&tx->lock);
+    struct cec_tx_entry *entry = NULL;
+    int ret = submit_locked(tx, msg, priority, 0, 0, &waiter, &entry);
+    if (ret == 0) {
+        while (!waiter.completed) {
+            if (pthread_cond_timedwait(&waiter.done, &tx->lock, &deadline) == ETIMEDOUT) {
+                break;
+            }
+        }
+        if (!waiter.completed) {
+            // Let the TX thread finish the frame without us.
+            ALOGW("cec_tx_send: timed out destination=%d", msg->destination);
+            entry->waiter = NULL;
+        }
+    }
+    pthread_mutex_unlock(&tx->lock);
+    pthread_cond_destroy(&waiter.done);
+
+    if (ret < 0) {
+        return ret == -EAGAIN ? HDMI_RESULT_BUSY : HDMI_RESULT_FAIL;
+    }
+    return waiter.result;
+}
@@ -0,0 +1,148 @@
+#ifndef SUNXI_HDMI_CEC_TX_H
+#define SUNXI_HDMI_CEC_TX_H
+
+#include <hardware/hdmi_cec.h>
+
+#include <pthread.h>
+
+#include "cec_sched.h"
+#include "sunxi_cec.h"
+
+/*
+ * Transmit engine: a bounded, prioritized queue drained by a dedicated
+ * thread, so callers never block on the (slow) CEC bus themselves.
+ */
+
+#define CEC_TX_QUEUE_SIZE 32
+#define CEC_TX_SEND_TIMEOUT_MS 2000
+#define CEC_TX_HISTORY_SIZE 8
+#define CEC_TX_DEDUP_WINDOW_MS 500
+
+/* CEC 1.4 signal free times, in 2.4 ms bit periods */
+#define CEC_BIT_PERIOD_US 2400
+#define CEC_SIGNAL_FREE_RETRANSMIT 3
+#define CEC_SIGNAL_FREE_NEW_INITIATOR 5
+
+enum {
+    /* report completion with SUNXI_CEC_EVENT_TX_STATUS */
+    CEC_TX_NOTIFY = 1 << 0,
+};
+
+struct cec_tx;
+struct cec_tx_waiter;
+
+struct cec_tx_entry {
+    struct cec_tx_entry *next;
+    cec_message_t msg;
+    int priority;
+    int flags;
+    int attempts;           /* transmissions so far, retries included */
+    struct cec_tx_waiter *waiter;
+
+    /* CLOCK_MONOTONIC stamps */
+    uint64_t origin_ns;     /* read of the frame this replies to, or 0 */
+    uint64_t submit_ns;
+    uint64_t start_ns;      /* handed to the transmitter */
+};
+
+/* Puts a frame on the wire; returns one of HDMI_RESULT_*. */
+typedef int (*cec_tx_transmit_t)(struct cec_tx *tx, const cec_message_t *msg);
+
+/* Called on the TX thread once a frame has been sent or has failed. */
+typedef void (*cec_tx_complete_t)(struct cec_tx *tx, const struct cec_tx_entry *entry, int result);
+
+/* How often a failed frame is retransmitted by the TX thread itself. */
+struct cec_tx_retry_policy {
+    int nack_retries;       /* CEC allows up to 5 */
+    int busy_retries;       /* lost arbitration or line busy */
+};
+
+struct cec_tx_retry_stats {
+    uint64_t nack_retries;
+    uint64_t busy_retries;
+    uint64_t recovered;     /* succeeded after at least one retry */
+    uint64_t exhausted;     /* failed with retries used up */
+};
+
+struct cec_tx_coalesce_stats {
+    uint64_t merged;        /* identical to a queued frame */
+    uint64_t superseded;    /* replaced the operands of a queued frame */
+    uint64_t suppressed;    /* identical to a frame acknowledged within the window */
+};
+
+struct cec_tx_sent {
+    cec_message_t msg;
+    uint64_t ns;
+};
+
+struct cec_tx {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    pthread_t thread;
+    int running;
+    int stopped;
+
+    struct cec_tx_entry entries[CEC_TX_QUEUE_SIZE];
+    struct cec_tx_entry *free_list;
+    struct cec_tx_entry *head[CEC_TX_PRIORITY_COUNT];
+    struct cec_tx_entry *tail[CEC_TX_PRIORITY_COUNT];
+    int queued;
+
+    struct cec_tx_retry_policy retry[CEC_TX_PRIORITY_COUNT];
+    struct cec_tx_retry_stats retry_stats[CEC_TX_PRIORITY_COUNT];
+
+    /* state reports acknowledged recently, for deduplication */
+    uint64_t dedup_window_ns;
+    struct cec_tx_sent history[CEC_TX_HISTORY_SIZE];
+    unsigned int history_next;
+    struct cec_tx_coalesce_stats coalesce_stats;
+
+    cec_tx_transmit_t transmit;
+    cec_tx_complete_t complete;
+    void *arg;
+    struct cec_sched *sched;
+};
+
+/* sched (may be NULL) is applied by the TX thread when it starts. */
+int cec_tx_start(struct cec_tx *tx, cec_tx_transmit_t transmit, cec_tx_complete_t complete, void *arg,
+                 struct cec_sched *sched);
+void cec_tx_stop(struct cec_tx *tx);
+
+/* Replaces the retry policy of a priority class; safe while running. */
+void cec_tx_set_retry(struct cec_tx *tx, int priority, const struct cec_tx_retry_policy *policy);
+
+void cec_tx_get_retry_stats(struct cec_tx *tx, struct cec_tx_retry_stats stats[CEC_TX_PRIORITY_COUNT]);
+
+/*
+ * State reports (power status, active source, vendor ID...) are coalesced:
+ * one identical to a queued frame is merged into it, one with new operands
+ * replaces a queued frame of the same kind, and one identical to a frame
+ * acknowledged less than window_ms ago is dropped. 0 turns the latter off.
+ * Submissions with CEC_TX_NOTIFY are never merged nor dropped, since each
+ * gets its own status event.
+ */
+void cec_tx_set_dedup_window(struct cec_tx *tx, int window_ms);
+
+/*
+ * Forgets acknowledged frames so they are sent again: those to destination
+ * (-1 for any) with opcode (-1 for any). Used when the bus state they
+ * reported may have changed.
+ */
+void cec_tx_forget(struct cec_tx *tx, int destination, int opcode);
+
+void cec_tx_get_coalesce_stats(struct cec_tx *tx, struct cec_tx_coalesce_stats *stats);
+
+/* Picks the priority class for a frame based on its opcode. */
+int cec_tx_classify(const cec_message_t *msg);
+
+/*
+ * Queues a frame and returns immediately. origin_ns stamps the received
+ * frame that triggered it, if any.
+ * Returns 0 on success, -EAGAIN when the queue is full or -ENODEV when stopped.
+ */
+int cec_tx_submit(struct cec_tx *tx, const cec_message_t *msg, int priority, int flags, uint64_t origin_ns);
+
+/* Queues a frame and waits for its completion; returns one of HDMI_RESULT_*. */
+int cec_tx_send(struct cec_tx *tx, const cec_message_t *msg, int priority);
+
+#endif
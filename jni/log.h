@@ -0,0 +1,30 @@
+#ifndef SUNXI_HDMI_CEC_LOG_H
+#define SUNXI_HDMI_CEC_LOG_H
+
+#include <android/log.h>
+
+#ifndef LOG_TAG
+#define LOG_TAG "sunxi-hdmi-cec"
+#endif
+
+/*
+ * Messages below cec_log_level are skipped before any formatting
+ * happens. Verbose messages are still printed at INFO priority so they
+ * show up in a default logcat once enabled.
+ */
+extern int cec_log_level;
+
+#define CEC_LOG(level, prio, ...) \
+    do { \
+        if ((level) >= cec_log_level) { \
+            __android_log_print(prio, LOG_TAG, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define ALOGD(...) CEC_LOG(ANDROID_LOG_DEBUG, ANDROID_LOG_DEBUG, __VA_ARGS__)
+#define ALOGV(...) CEC_LOG(ANDROID_LOG_VERBOSE, ANDROID_LOG_INFO, __VA_ARGS__)
+#define ALOGI(...) CEC_LOG(ANDROID_LOG_INFO, ANDROID_LOG_INFO, __VA_ARGS__)
+#define ALOGW(...) CEC_LOG(ANDROID_LOG_WARN, ANDROID_LOG_WARN, __VA_ARGS__)
+#define ALOGE(...) CEC_LOG(ANDROID_LOG_ERROR, ANDROID_LOG_ERROR, __VA_ARGS__)
+
+#endif
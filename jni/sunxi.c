@@ -2,197 +2,674 @@
 
 #include <hardware/hdmi_cec.h>
 
+#include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
-#include <android/log.h>
-#include <sys/ioctl.h>
-#include <sys/time.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-
-#define ALOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
-#define ALOGV(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define ALOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
-#define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
-#define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
-
-#define HDMICEC_IOC_MAGIC  'H'
-#define HDMICEC_IOC_SETLOGICALADDRESS _IOW(HDMICEC_IOC_MAGIC,  1, unsigned char)
-#define HDMICEC_IOC_STARTDEVICE _IO(HDMICEC_IOC_MAGIC,  2)
-#define HDMICEC_IOC_STOPDEVICE  _IO(HDMICEC_IOC_MAGIC,  3)
-#define HDMICEC_IOC_GETPHYADDRESS _IOR(HDMICEC_IOC_MAGIC,  4, unsigned char[4])
-
-#define CEC_SUNXI_PATH "/dev/sunxi_hdmi_cec"
+
+#include "cec_backend.h"
+#include "cec_capture.h"
+#include "cec_coalesce.h"
+#include "cec_config.h"
+#include "cec_dispatch.h"
+#include "cec_edid.h"
+#include "cec_filter.h"
+#include "cec_hotplug.h"
+#include "cec_keys.h"
+#include "cec_loop.h"
+#include "cec_responder.h"
+#include "cec_sched.h"
+#include "cec_seqlock.h"
+#include "cec_stats.h"
+#include "cec_topology.h"
+#include "cec_trace.h"
+#include "cec_tx.h"
+#include "log.h"
+#include "sunxi_cec.h"
+
 #define CEC_VENDOR_PULSE_EIGHT 0x001582
 #define CEC_VERSION_1_4 0x05
 
-#define MESSAGE_TYPE_RECEIVE_SUCCESS            1
-#define MESSAGE_TYPE_NOACK              2
-#define MESSAGE_TYPE_DISCONNECTED               3
-#define MESSAGE_TYPE_CONNECTED          4
-#define MESSAGE_TYPE_SEND_SUCCESS               5
-
-typedef struct hdmi_cec_event {
-    int event_type;
-    int msg_len;
-    unsigned char msg[17];
-} hdmi_cec_event_t;
-
-static int sunxi_hdmi_cec = -1;
-static int enabled = 0;
-static int closed = 0;
-static int powered = 0;
-static pthread_t process_thread_handle = -1;
-static event_callback_t callback_func;
-static void *callback_arg;
-static cec_logical_address_t logical_address = CEC_DEVICE_INACTIVE;
-
-static int enable_hdmi_cec() {
-    if (enabled) {
+#define READ_RETRY_DELAY_MS 500
+#define STARTUP_WAIT_MS 200
+#define PHYSICAL_ADDRESS_REFRESH_MS 100
+#define RX_BATCH_SIZE SUNXI_CEC_RX_BATCH_MAX
+
+#define PHYSICAL_ADDRESS_INVALID 0xffff
+#define PHYSICAL_ADDRESS_CACHED 0x10000
+#define PHYSICAL_ADDRESS_GENERATION 0x20000    /* bumped by every invalidation */
+
+#define CEC_UI_POWER 0x40
+#define CEC_UI_POWER_TOGGLE 0x6b
+#define CEC_UI_POWER_ON 0x6d
+
+/* transport used by the next open */
+static const struct cec_backend_ops *backend_ops = &cec_backend_sunxi;
+static void *backend_arg;
+
+/* struct sunxi_cec_rx_stats as written by the reader thread */
+struct rx_counters {
+    atomic_ullong wakeups;
+    atomic_ullong reads;
+    atomic_ullong events;
+    atomic_ullong spurious;
+    atomic_ullong max_batch;
+    atomic_ullong batches[RX_BATCH_SIZE + 1];
+};
+
+/* registered event callback; replaced as a whole, never modified in place */
+struct sunxi_cec_callback {
+    event_callback_t func;
+    void *arg;
+    unsigned int retired_seq;           /* callback_seq when it was replaced */
+    struct sunxi_cec_callback *next;    /* on the retired or free list */
+};
+
+/*
+ * Everything one open device owns. Control state is changed under
+ * control_lock; the frame paths only read atomics, the seqlocked
+ * responder snapshot and the RCU-style callback pointer.
+ */
+struct sunxi_cec_device {
+    hdmi_cec_device_t device;   /* must stay first */
+
+    struct cec_backend backend;
+    int fd;
+    atomic_int closing;
+
+    pthread_mutex_t control_lock;
+    int enabled;
+    int logical_mask_supported;
+    atomic_uint logical_mask;
+
+    pthread_t process_thread;
+    struct cec_loop process_loop;
+    struct cec_loop_source device_source;
+    struct cec_timer read_retry_timer;
+    struct cec_timer physical_address_timer;
+    struct cec_keys keys;
+    struct cec_hotplug hotplug;
+    struct cec_tx tx_engine;
+    struct cec_dispatch dispatcher;
+    struct cec_coalesce rx_coalesce;
+    struct cec_sched io_sched;
+    struct cec_sched tx_sched;
+    struct cec_sched dispatch_sched;
+    int context_locked;     /* 1, 0, or -errno of mlock */
+
+    /* reader thread only */
+    hdmi_cec_event_t rx_batch[RX_BATCH_SIZE];
+    uint64_t rx_stamp_ns;
+    /* written by the reader thread, read by any */
+    struct rx_counters rx_counters;
+    atomic_ullong standby_forwarded;
+    atomic_ullong standby_dropped;
+
+    /* HDMI_OPTION_SYSTEM_CEC_CONTROL off; HDMI_OPTION_WAKEUP */
+    atomic_int standby;
+    atomic_int wakeup;
+
+    struct cec_stats stats;
+    struct cec_topology topology;
+    struct cec_filter filter;
+    int rx_filter_supported;
+    struct cec_trace trace;
+    struct cec_capture capture;
+
+    /* written by any thread, read by the reader when it builds replies */
+    struct cec_seqlock responder_lock;
+    struct cec_responder responder;
+
+    char edid_path[PROP_VALUE_MAX];
+    atomic_uint physical_address_cache;
+    atomic_uint physical_address_lookups;
+    atomic_uint physical_address_mismatches;
+
+    _Atomic(struct sunxi_cec_callback *) callback;
+    atomic_uint callback_seq;   /* odd while the dispatcher holds a callback */
+    /* under control_lock: replaced pairs the dispatcher may still hold, and reusable ones */
+    struct sunxi_cec_callback *retired_callbacks;
+    struct sunxi_cec_callback *free_callbacks;
+
+    /* handed out by get_port_info; written only with the physical address cache */
+    hdmi_port_info_t port_info;
+
+    /* startup phases; ready once every pending phase is done */
+    struct sunxi_cec_startup_stats startup;
+    uint64_t open_start_ns;
+    atomic_int startup_pending;
+    pthread_mutex_t ready_lock;
+    pthread_cond_t ready_cond;
+    int ready;
+};
+
+static struct sunxi_cec_device *to_sunxi(const struct hdmi_cec_device *dev) {
+    return (struct sunxi_cec_device *) dev;
+}
+
+static int enable_hdmi_cec(struct sunxi_cec_device *ctx) {
+    if (ctx->enabled) {
         ALOGV("enable_hdmi_cec: is already enabled");
         return 0;
     }
-    int ret = ioctl(sunxi_hdmi_cec, HDMICEC_IOC_STARTDEVICE, NULL);
+    int ret = ctx->backend.ops->start(&ctx->backend);
     if (ret < 0) {
         ALOGW("enable_hdmi_cec: failed: %d", ret);
     } else {
         ALOGV("enable_hdmi_cec: enabled");
-        enabled = 1;
+        ctx->enabled = 1;
     }
     return ret;
 }
 
-static int disable_hdmi_cec() {
-    if (!enabled) {
+static int disable_hdmi_cec(struct sunxi_cec_device *ctx) {
+    if (!ctx->enabled) {
         ALOGV("disable_hdmi_cec: is already disabled");
         return 0;
     }
-    int ret = ioctl(sunxi_hdmi_cec, HDMICEC_IOC_STOPDEVICE, NULL);
+    int ret = ctx->backend.ops->stop(&ctx->backend);
     if (ret < 0) {
         ALOGW("disable_hdmi_cec: failed: %d", ret);
     } else {
         ALOGV("disable_hdmi_cec: disabled");
-        enabled = 0;
+        ctx->enabled = 0;
     }
     return ret;
 }
 
+/* The responder is seqlocked; it may be written from any thread. */
+static void responder_write_begin(struct sunxi_cec_device *ctx) {
+    cec_seqlock_write_begin(&ctx->responder_lock);
+}
+
+static void responder_write_end(struct sunxi_cec_device *ctx) {
+    cec_seqlock_write_end(&ctx->responder_lock);
+}
+
+static void responder_snapshot(struct sunxi_cec_device *ctx, struct cec_responder *responder) {
+    unsigned int seq;
+    do {
+        seq = cec_seqlock_read_begin(&ctx->responder_lock);
+        *responder = ctx->responder;
+    } while (cec_seqlock_read_retry(&ctx->responder_lock, seq));
+}
+
+static const char *const priority_names[CEC_TX_PRIORITY_COUNT] = {
+        [CEC_TX_PRIORITY_USER_CONTROL] = "user_control",
+        [CEC_TX_PRIORITY_NORMAL] = "normal",
+        [CEC_TX_PRIORITY_STATUS] = "status",
+        [CEC_TX_PRIORITY_POLL] = "poll",
+};
+
 static void get_vendor_id(const struct hdmi_cec_device *dev, uint32_t *vendor_id) {
     *vendor_id = CEC_VENDOR_PULSE_EIGHT;
 }
 
+static int primary_address(unsigned int mask) {
+    return mask ? __builtin_ctz(mask) : CEC_ADDR_UNREGISTERED;
+}
+
+// Pushes every claimed address to the transport at once. Drivers without
+// the mask ioctl only acknowledge the lowest claimed address.
+static int update_logical_mask(struct sunxi_cec_device *ctx, unsigned int mask) {
+    struct cec_backend *backend = &ctx->backend;
+    unsigned int old_mask = atomic_load_explicit(&ctx->logical_mask, memory_order_relaxed);
+    int ret = -ENOTTY;
+
+    if (ctx->logical_mask_supported && backend->ops->set_logical_mask) {
+        ret = backend->ops->set_logical_mask(backend, mask);
+        if (ret == -ENOTTY) {
+            ALOGI("update_logical_mask: not supported, acknowledging one address only");
+            ctx->logical_mask_supported = 0;
+        }
+    }
+    if (ret == -ENOTTY) {
+        ret = 0;
+        if (primary_address(mask) != primary_address(old_mask)) {
+            ret = backend->ops->set_logical_address(backend, primary_address(mask));
+        }
+    }
+    if (ret < 0) {
+        return ret;
+    }
+
+    atomic_store_explicit(&ctx->logical_mask, mask, memory_order_release);
+    return 0;
+}
+
+// Lets the driver drop what neither the framework nor the HAL needs, so
+// such frames never wake the reader. Called with control_lock held.
+static void update_driver_filter(struct sunxi_cec_device *ctx) {
+    struct cec_backend *backend = &ctx->backend;
+    if (!ctx->rx_filter_supported || !backend->ops->set_rx_filter) {
+        return;
+    }
+
+    uint32_t mask[CEC_FILTER_WORDS];
+    cec_filter_driver_mask(&ctx->filter, atomic_load_explicit(&ctx->standby, memory_order_relaxed), mask);
+    int ret = backend->ops->set_rx_filter(backend, mask);
+    if (ret == -ENOTTY) {
+        ALOGI("update_driver_filter: not supported, filtering in the HAL only");
+        ctx->rx_filter_supported = 0;
+    } else if (ret < 0) {
+        ALOGW("update_driver_filter: failed: %d", ret);
+    }
+}
+
 static int add_logical_address(const struct hdmi_cec_device *dev, cec_logical_address_t addr) {
-    if (logical_address == addr) {
-        return 0;
+    struct sunxi_cec_device *ctx = to_sunxi(dev);
+    if (addr < CEC_ADDR_TV || addr >= CEC_ADDR_BROADCAST) {
+        return -EINVAL;
     }
-    int ret = ioctl(sunxi_hdmi_cec, HDMICEC_IOC_SETLOGICALADDRESS, addr);
+
+    pthread_mutex_lock(&ctx->control_lock);
+    unsigned int mask = atomic_load_explicit(&ctx->logical_mask, memory_order_relaxed);
+    int ret = 0;
+    if (!(mask & (1u << addr))) {
+        ret = update_logical_mask(ctx, mask | 1u << addr);
+    }
+    pthread_mutex_unlock(&ctx->control_lock);
+
     if (ret == 0) {
-        logical_address = addr;
-        ALOGV("add_logical_address: %d", addr);
+        ALOGV("add_logical_address: %d mask=%04x", addr, mask | 1u << addr);
         return 0;
     } else {
-        ALOGE("add_logical_address: %d failed: %d", addr, errno);
-        return -errno;
+        ALOGE("add_logical_address: %d failed: %d", addr, -ret);
+        return ret;
     }
 }
 
 static void clear_logical_address(const struct hdmi_cec_device *dev) {
-    add_logical_address(dev, 15);
+    struct sunxi_cec_device *ctx = to_sunxi(dev);
+
+    pthread_mutex_lock(&ctx->control_lock);
+    int ret = update_logical_mask(ctx, 0);
+    pthread_mutex_unlock(&ctx->control_lock);
+
+    if (ret < 0) {
+        ALOGE("clear_logical_address: failed: %d", -ret);
+    }
+}
+
+/* logical addresses each device type may use, in order of preference */
+static const int8_t address_candidates[CEC_DEVICE_MAX + 1][5] = {
+        [CEC_DEVICE_TV] = {CEC_ADDR_TV, CEC_ADDR_FREE_USE, -1},
+        [CEC_DEVICE_RECORDER] = {CEC_ADDR_RECORDER_1, CEC_ADDR_RECORDER_2, CEC_ADDR_RECORDER_3, -1},
+        [CEC_DEVICE_RESERVED] = {-1},
+        [CEC_DEVICE_TUNER] = {CEC_ADDR_TUNER_1, CEC_ADDR_TUNER_2, CEC_ADDR_TUNER_3, CEC_ADDR_TUNER_4, -1},
+        [CEC_DEVICE_PLAYBACK] = {CEC_ADDR_PLAYBACK_1, CEC_ADDR_PLAYBACK_2, CEC_ADDR_PLAYBACK_3, -1},
+        [CEC_DEVICE_AUDIO_SYSTEM] = {CEC_ADDR_AUDIO_SYSTEM, -1},
+};
+
+/* address + 1 each device type claimed last, kept across opens; 0 if none */
+static atomic_int last_allocated[CEC_DEVICE_MAX + 1];
+
+// Polls one candidate; only a NACK means nobody owns it.
+static int poll_logical_address(struct sunxi_cec_device *ctx, int addr) {
+    cec_message_t msg;
+    msg.initiator = addr;
+    msg.destination = addr;
+    msg.length = 0;
+
+    return cec_tx_send(&ctx->tx_engine, &msg, CEC_TX_PRIORITY_POLL);
+}
+
+int sunxi_cec_allocate_logical_address(const struct hdmi_cec_device *dev, int device_type) {
+    struct sunxi_cec_device *ctx = to_sunxi(dev);
+    if (device_type < CEC_DEVICE_TV || device_type > CEC_DEVICE_MAX || address_candidates[device_type][0] < 0) {
+        return -EINVAL;
+    }
+    if (atomic_load_explicit(&ctx->closing, memory_order_relaxed)) {
+        return -ENODEV;
+    }
+
+    uint64_t start = cec_now_ns();
+    int candidates[6];
+    int count = 0;
+    int last = atomic_load_explicit(&last_allocated[device_type], memory_order_relaxed) - 1;
+    if (last >= 0) {
+        candidates[count++] = last;
+    }
+    for (const int8_t *addr = address_candidates[device_type]; *addr >= 0; addr++) {
+        if (*addr != last) {
+            candidates[count++] = *addr;
+        }
+    }
+
+    int errors = 0;
+    for (int i = 0; i < count; i++) {
+        int addr = candidates[i];
+        // one of ours already; polling it would only hear ourselves
+        if (atomic_load_explicit(&ctx->logical_mask, memory_order_acquire) & (1u << addr)) {
+            return addr;
+        }
+
+        int result = poll_logical_address(ctx, addr);
+        if (result == HDMI_RESULT_SUCCESS) {
+            continue;
+        } else if (result != HDMI_RESULT_NACK) {
+            errors++;
+            continue;
+        }
+
+        int ret = add_logical_address(dev, addr);
+        if (ret < 0) {
+            return ret;
+        }
+        atomic_store_explicit(&last_allocated[device_type], addr + 1, memory_order_relaxed);
+        ALOGI("allocate_logical_address: type=%d address=%d polls=%d in %llu us",
+              device_type, addr, i + 1, (unsigned long long) ((cec_now_ns() - start) / 1000));
+        return addr;
+    }
+
+    ALOGW("allocate_logical_address: type=%d none free, %d polls failed", device_type, errors);
+    return errors == count ? -EIO : CEC_ADDR_UNREGISTERED;
+}
+
+// Parses the sink EDID and cross-checks it with the driver. Only runs when
+// nothing is cached: at startup, and after a hotplug from the refresh timer
+// or for the first caller.
+static int lookup_physical_address(struct sunxi_cec_device *ctx, uint16_t *addr) {
+    uint16_t from_edid, from_driver;
+    int edid_ret = cec_edid_read_physical_address(ctx->edid_path, &from_edid);
+    int driver_ret = ctx->backend.ops->get_physical_address(&ctx->backend, &from_driver);
+
+    atomic_fetch_add_explicit(&ctx->physical_address_lookups, 1, memory_order_relaxed);
+
+    if (edid_ret == 0 && driver_ret == 0 && from_edid != from_driver) {
+        ALOGW("physical address mismatch: edid=%04x driver=%04x, using driver",
+              from_edid, from_driver);
+        atomic_fetch_add_explicit(&ctx->physical_address_mismatches, 1, memory_order_relaxed);
+        *addr = from_driver;
+        return 0;
+    } else if (edid_ret == 0) {
+        *addr = from_edid;
+        return 0;
+    } else if (driver_ret == 0) {
+        ALOGV("physical address: no edid from %s: %d", ctx->edid_path, edid_ret);
+        *addr = from_driver;
+        return 0;
+    }
+    return driver_ret;
+}
+
+// The cache and its copies in the responder and port_info change together
+// inside the responder write section, so a lookup that raced an
+// invalidation is not published.
+static void invalidate_physical_address(struct sunxi_cec_device *ctx) {
+    responder_write_begin(ctx);
+    unsigned int cached = atomic_load_explicit(&ctx->physical_address_cache, memory_order_relaxed);
+    atomic_store_explicit(&ctx->physical_address_cache,
+                          (cached & ~(PHYSICAL_ADDRESS_GENERATION - 1)) + PHYSICAL_ADDRESS_GENERATION,
+                          memory_order_release);
+    ctx->responder.physical_address = PHYSICAL_ADDRESS_INVALID;
+    ctx->port_info.physical_address = PHYSICAL_ADDRESS_INVALID;
+    responder_write_end(ctx);
+}
+
+static int cached_physical_address(struct sunxi_cec_device *ctx, uint16_t *addr) {
+    unsigned int cached = atomic_load_explicit(&ctx->physical_address_cache, memory_order_acquire);
+    if (cached & PHYSICAL_ADDRESS_CACHED) {
+        *addr = cached & 0xffff;
+        return 0;
+    }
+
+    int ret = lookup_physical_address(ctx, addr);
+    if (ret == 0) {
+        responder_write_begin(ctx);
+        if (atomic_load_explicit(&ctx->physical_address_cache, memory_order_relaxed) == cached) {
+            atomic_store_explicit(&ctx->physical_address_cache, cached | PHYSICAL_ADDRESS_CACHED | *addr,
+                                  memory_order_release);
+            ctx->responder.physical_address = *addr;
+            ctx->port_info.physical_address = *addr;
+        }
+        responder_write_end(ctx);
+    }
+    return ret;
+}
+
+static void startup_phase_done(struct sunxi_cec_device *ctx) {
+    if (atomic_fetch_sub_explicit(&ctx->startup_pending, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+
+    struct sunxi_cec_startup_stats *startup = &ctx->startup;
+    startup->ready_ns = cec_now_ns() - ctx->open_start_ns;
+    ALOGI("ready in %llu us: backend_open=%llu loop_init=%llu threads=%llu start=%llu physical_address=%llu",
+          (unsigned long long) (startup->ready_ns / 1000),
+          (unsigned long long) (startup->backend_open_ns / 1000),
+          (unsigned long long) (startup->loop_init_ns / 1000),
+          (unsigned long long) (startup->threads_ns / 1000),
+          (unsigned long long) (startup->start_ns / 1000),
+          (unsigned long long) (startup->physical_address_ns / 1000));
+
+    pthread_mutex_lock(&ctx->ready_lock);
+    ctx->ready = 1;
+    pthread_cond_broadcast(&ctx->ready_cond);
+    pthread_mutex_unlock(&ctx->ready_lock);
+}
+
+static int wait_ready(struct sunxi_cec_device *ctx, int timeout_ms) {
+    if (atomic_load_explicit(&ctx->startup_pending, memory_order_acquire) == 0) {
+        return 0;
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&ctx->ready_lock);
+    while (!ctx->ready) {
+        if (pthread_cond_timedwait(&ctx->ready_cond, &ctx->ready_lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    int ready = ctx->ready;
+    pthread_mutex_unlock(&ctx->ready_lock);
+    return ready ? 0 : -ETIMEDOUT;
 }
 
 static int get_physical_address(const struct hdmi_cec_device *dev, uint16_t *addr) {
-    int ret = ioctl(sunxi_hdmi_cec, HDMICEC_IOC_GETPHYADDRESS, addr);
+    struct sunxi_cec_device *ctx = to_sunxi(dev);
+    // The processing thread fetches it during startup; don't race it. Once
+    // started this is one atomic load, no call and no lock.
+    if (atomic_load_explicit(&ctx->startup_pending, memory_order_acquire) != 0) {
+        wait_ready(ctx, STARTUP_WAIT_MS);
+    }
+    int ret = cached_physical_address(ctx, addr);
     if (ret == 0) {
         ALOGV("get_physical_address: %d", *addr);
         return 0;
     } else {
         ALOGE("get_physical_address: failed: %d", ret);
-        return -errno;
+        return ret;
     }
 }
 
-static int send_message(const struct hdmi_cec_device *dev, const cec_message_t *msg) {
-    if (sunxi_hdmi_cec < 0) {
-        ALOGE("send_message: not ready");
-        return HDMI_RESULT_FAIL;
-    }
-
+static int transmit_frame(struct cec_tx *tx, const cec_message_t *msg) {
+    struct sunxi_cec_device *ctx = tx->arg;
     unsigned char message[CEC_MESSAGE_BODY_MAX_LENGTH + 1];
     message[0] = (msg->initiator << 4) | (msg->destination & 0x0f);
     memcpy(message + 1, msg->body, msg->length);
 
-    int ret = write(sunxi_hdmi_cec, message, msg->length + 1);
-    if (ret >= 0) {
+    // Whoever we ask gets its answer delivered, even if unchanged.
+    if (msg->destination != CEC_ADDR_BROADCAST) {
+        cec_coalesce_forget(&ctx->rx_coalesce, msg->destination);
+    } else if (msg->length && msg->body[0] == CEC_MESSAGE_REQUEST_ACTIVE_SOURCE) {
+        cec_coalesce_forget(&ctx->rx_coalesce, -1);
+    }
+
+    int ret = ctx->backend.ops->write_frame(&ctx->backend, message, msg->length + 1);
+    // taken before anything else can overwrite it
+    int error = ret == HDMI_RESULT_SUCCESS ? 0 : errno;
+    cec_capture_add(&ctx->capture, CEC_CAPTURE_TX, 0, message, msg->length + 1, ret);
+    cec_trace_add(&ctx->trace, CEC_TRACE_TX, message[0], msg->body, msg->length, ret, error);
+    if (ret == HDMI_RESULT_SUCCESS) {
         ALOGV("hdmi-cec sent initiator=%d destination=%d length=%ld msg=%02x %02x %02x",
               msg->initiator, msg->destination, msg->length,
               msg->body[0], msg->body[1], msg->body[2]);
-        return HDMI_RESULT_SUCCESS;
+        return ret;
     }
 
-    ALOGW("hdmi-cec sent failed initiator=%d destination=%d length=%ld msg=%02x %02x %02x errno=%d",
+    ALOGW("hdmi-cec sent failed initiator=%d destination=%d length=%ld msg=%02x %02x %02x result=%d errno=%d",
           msg->initiator, msg->destination, msg->length,
           msg->body[0], msg->body[1], msg->body[2],
-          errno);
+          ret, error);
+    return ret;
+}
 
-    if (errno == EBUSY) {
-        return HDMI_RESULT_BUSY;
-    } else if (errno == EIO) {
-        return HDMI_RESULT_NACK;
-    } else {
+static void tx_status_event(struct cec_tx *tx, const struct cec_tx_entry *entry, int result) {
+    struct sunxi_cec_device *ctx = tx->arg;
+    struct cec_stats *stats = &ctx->stats;
+    const cec_message_t *msg = &entry->msg;
+    uint64_t now = cec_now_ns();
+
+    cec_stats_stage(stats, CEC_STAGE_TX_QUEUE, entry->submit_ns, entry->start_ns);
+    cec_stats_stage(stats, CEC_STAGE_TX_WIRE, entry->start_ns, now);
+    cec_stats_stage(stats, CEC_STAGE_TX_TOTAL, entry->submit_ns, now);
+    cec_hist_record(&stats->tx_opcode[msg->length ? msg->body[0] : CEC_HIST_POLL], now - entry->submit_ns);
+    if (result >= HDMI_RESULT_SUCCESS && result <= HDMI_RESULT_FAIL) {
+        cec_hist_record(&stats->tx_result[result], now - entry->submit_ns);
+    }
+    if (result == HDMI_RESULT_SUCCESS) {
+        cec_stats_stage(stats, CEC_STAGE_RX_READ_TO_REPLY, entry->origin_ns, now);
+        cec_topology_observe(&ctx->topology, msg->initiator, msg->destination, msg->body, msg->length, now);
+        if (msg->destination != CEC_ADDR_BROADCAST) {
+            cec_topology_observe(&ctx->topology, msg->destination, -1, NULL, 0, now);
+        }
+    }
+
+    if (!(entry->flags & CEC_TX_NOTIFY) ||
+        !cec_filter_tx(&ctx->filter,
+                       msg->destination == CEC_ADDR_BROADCAST ? SUNXI_CEC_FILTER_BROADCAST : SUNXI_CEC_FILTER_DIRECTED,
+                       msg->length ? msg->body[0] : -1)) {
+        return;
+    }
+
+    hdmi_event_t event;
+    sunxi_cec_set_tx_status(&event, result, msg->length ? msg->body[0] : -1);
+    event.dev = &ctx->device;
+
+    cec_dispatch_push(&ctx->dispatcher, &ctx->dispatcher.tx, &event, now);
+}
+
+static int send_message(const struct hdmi_cec_device *dev, const cec_message_t *msg) {
+    struct sunxi_cec_device *ctx = to_sunxi(dev);
+    if (atomic_load_explicit(&ctx->closing, memory_order_relaxed)) {
+        ALOGE("send_message: not ready");
         return HDMI_RESULT_FAIL;
     }
+
+    return cec_tx_send(&ctx->tx_engine, msg, cec_tx_classify(msg));
+}
+
+int sunxi_cec_submit(const struct hdmi_cec_device *dev, const cec_message_t *msg, int priority) {
+    struct sunxi_cec_device *ctx = to_sunxi(dev);
+    if (atomic_load_explicit(&ctx->closing, memory_order_relaxed)) {
+        return -ENODEV;
+    }
+
+    return cec_tx_submit(&ctx->tx_engine, msg, priority, CEC_TX_NOTIFY, 0);
 }
 
-static void hotplug_event(struct hdmi_cec_device *dev, int port_id, int connected) {
+// Called by the debouncer once per settled transition.
+static void hotplug_event(struct cec_hotplug *debouncer, int connected) {
+    struct sunxi_cec_device *ctx = debouncer->arg;
+    int port_id = ctx->port_info.port_id;
     hdmi_event_t event;
     event.type = HDMI_EVENT_HOT_PLUG;
-    event.dev = dev;
+    event.dev = &ctx->device;
     event.hotplug.port_id = port_id;
     event.hotplug.connected = connected;
-    powered = connected;
 
+    // A new sink may sit behind a different port, so the address is
+    // looked up again rather than trusted from before the hotplug. The
+    // EDID read is left to the timer, or to whoever asks first, so the
+    // event is not held up behind it.
+    invalidate_physical_address(ctx);
+    if (connected) {
+        cec_timer_arm(&ctx->physical_address_timer, PHYSICAL_ADDRESS_REFRESH_MS);
+    } else {
+        cec_timer_cancel(&ctx->physical_address_timer);
+        cec_topology_reset(&ctx->topology);
+    }
+    cec_coalesce_forget(&ctx->rx_coalesce, -1);
+
+    cec_trace_add(&ctx->trace, CEC_TRACE_HOTPLUG, port_id, NULL, 0, connected, 0);
     ALOGI("hdmi-hotplug: port_id=%d connected=%d",
           port_id, connected);
 
-    if (callback_func) {
-        callback_func(&event, callback_arg);
-    }
+    cec_dispatch_push(&ctx->dispatcher, &ctx->dispatcher.rx, &event, cec_now_ns());
 }
 
-static int send_cec_message(struct hdmi_cec_device *dev, int initiator, int destination, const unsigned char *data,
-                            size_t length) {
+static int send_cec_message(struct sunxi_cec_device *ctx, int initiator, int destination,
+                            const unsigned char *data, size_t length) {
     cec_message_t msg;
     msg.initiator = initiator;
     msg.destination = destination;
     msg.length = length;
     memcpy(msg.body, data, length);
-    return send_message(dev, &msg);
+
+    // Replies are queued so that the reader never waits for the bus.
+    return cec_tx_submit(&ctx->tx_engine, &msg, cec_tx_classify(&msg), 0, ctx->rx_stamp_ns);
 }
 
 static int
-handle_cec_opcode(struct hdmi_cec_device *dev, int initiator, int destination,
+handle_cec_opcode(struct sunxi_cec_device *ctx, int initiator, int destination,
                   int opcode, const unsigned char *data, size_t length) {
-    switch (opcode) {
-        case CEC_MESSAGE_GIVE_DECK_STATUS: {
-            unsigned char data[] = {CEC_MESSAGE_DECK_STATUS, 0x20};
-            send_cec_message(dev, destination, initiator, data, 2);
+    unsigned int mask = atomic_load_explicit(&ctx->logical_mask, memory_order_acquire);
+
+    // Only keys sent to us; the filter lets keys to other devices reach the
+    // HAL as well. No injection (and no repeat timer) while the system sleeps.
+    if ((opcode == CEC_MESSAGE_USER_CONTROL_PRESSED || opcode == CEC_MESSAGE_USER_CONTROL_RELEASED) &&
+        destination != CEC_ADDR_BROADCAST && (mask & (1u << destination)) &&
+        !atomic_load_explicit(&ctx->standby, memory_order_relaxed) &&
+        cec_keys_handle(&ctx->keys, opcode, data, length)) {
+        cec_stats_stage(&ctx->stats, CEC_STAGE_RX_READ_TO_KEY, ctx->rx_stamp_ns, cec_now_ns());
+        return 1;
+    }
+
+    // Directed queries are answered from the address they were sent to.
+    if (destination != CEC_ADDR_BROADCAST && (mask & (1u << destination))) {
+        struct cec_responder responder;
+        unsigned char reply[CEC_MESSAGE_BODY_MAX_LENGTH];
+        int broadcast = 0;
+
+        responder_snapshot(ctx, &responder);
+        size_t reply_length = cec_responder_reply(&responder, destination, opcode, reply, &broadcast);
+        if (reply_length) {
+            send_cec_message(ctx, destination, broadcast ? CEC_ADDR_BROADCAST : initiator,
+                             reply, reply_length);
             return 1;
         }
+    }
 
+    switch (opcode) {
         case CEC_MESSAGE_DEVICE_VENDOR_ID: {
             if (initiator != CEC_DEVICE_TV) {
                 break;
             }
-            if (!powered) {
-                hotplug_event(dev, 0, 1);
+            // the TV talking to us is as good as a hotplug
+            cec_hotplug_signal(&ctx->hotplug, 1, CEC_HOTPLUG_CEC);
+            if (!mask) {
+                break;
             }
 
             // We broadcast our vendor ID
             uint32_t vendor_id = 0;
-            get_vendor_id(dev, &vendor_id);
+            get_vendor_id(&ctx->device, &vendor_id);
 
             unsigned char data[] = {
                     CEC_MESSAGE_DEVICE_VENDOR_ID,
@@ -200,46 +677,200 @@ handle_cec_opcode(struct hdmi_cec_device *dev, int initiator, int destination,
                     vendor_id >> 8,
                     vendor_id
             };
-            send_cec_message(dev, logical_address, 15, data, 4);
+            send_cec_message(ctx, primary_address(mask), 15, data, 4);
             return 0;
         }
 
         default:
             return 0;
     }
+    return 0;
+}
+
+// Reports we sent recently are suppressed as duplicates; anything that may
+// have made them stale lets them through again.
+static void forget_stale_reports(struct sunxi_cec_device *ctx, int initiator, int destination, int opcode) {
+    switch (opcode) {
+        case CEC_MESSAGE_USER_CONTROL_PRESSED:
+        case CEC_MESSAGE_USER_CONTROL_RELEASED:
+            return;
+
+        case CEC_MESSAGE_ACTIVE_SOURCE:
+        case CEC_MESSAGE_ROUTING_CHANGE:
+        case CEC_MESSAGE_ROUTING_INFORMATION:
+        case CEC_MESSAGE_SET_STREAM_PATH:
+            cec_tx_forget(&ctx->tx_engine, -1, CEC_MESSAGE_ACTIVE_SOURCE);
+            break;
+    }
+
+    // a device asking us directly deserves an answer even if repeated
+    if (destination != CEC_ADDR_BROADCAST) {
+        cec_tx_forget(&ctx->tx_engine, initiator, -1);
+    }
+}
+
+static int destination_class(struct sunxi_cec_device *ctx, int destination) {
+    if (destination == CEC_ADDR_BROADCAST) {
+        return SUNXI_CEC_FILTER_BROADCAST;
+    }
+    unsigned int mask = atomic_load_explicit(&ctx->logical_mask, memory_order_relaxed);
+    return mask & (1u << destination) ? SUNXI_CEC_FILTER_DIRECTED : SUNXI_CEC_FILTER_OTHER;
+}
+
+static int routes_to_us(struct sunxi_cec_device *ctx, const unsigned char *operands, size_t length) {
+    unsigned int cached = atomic_load_explicit(&ctx->physical_address_cache, memory_order_acquire);
+    if (length < 2 || !(cached & PHYSICAL_ADDRESS_CACHED)) {
+        return 1;
+    }
+    return (operands[0] << 8 | operands[1]) == (cached & 0xffff);
+}
+
+// In standby only what may wake the system reaches the framework, which
+// is the wake handler; the responder has already answered the queries.
+static int is_wake_event(struct sunxi_cec_device *ctx, int opcode, const unsigned char *operands, size_t length) {
+    if (!(cec_opcode_table[opcode].flags & CEC_OPCODE_WAKE)) {
+        return 0;
+    }
+
+    switch (opcode) {
+        case CEC_MESSAGE_IMAGE_VIEW_ON:
+        case CEC_MESSAGE_TEXT_VIEW_ON:
+            return atomic_load_explicit(&ctx->wakeup, memory_order_relaxed);
+
+        case CEC_MESSAGE_SET_STREAM_PATH:
+            return routes_to_us(ctx, operands, length);
+
+        case CEC_MESSAGE_ROUTING_CHANGE:
+            return length >= 4 ? routes_to_us(ctx, operands + 2, length - 2) : 1;
+
+        case CEC_MESSAGE_USER_CONTROL_PRESSED:
+            return length >= 1 && (operands[0] == CEC_UI_POWER || operands[0] == CEC_UI_POWER_TOGGLE ||
+                                   operands[0] == CEC_UI_POWER_ON);
+
+        default:
+            return 1;
+    }
 }
 
 static void
-cec_event(struct hdmi_cec_device *dev, int initiator, int destination, const unsigned char *data, size_t length) {
+cec_event(struct sunxi_cec_device *ctx, int initiator, int destination, const unsigned char *data, size_t length) {
     if (length <= 0) {
         return;
     }
 
+    cec_trace_add(&ctx->trace, CEC_TRACE_RX, (initiator << 4) | (destination & 0x0f), data, length, 0, 0);
+    ALOGV("hdmi-cec received initiator=%d destination=%d length=%ld msg=%02x %02x %02x",
+          initiator, destination, (long) length, data[0], data[1], data[2]);
+
+    // Decided before any work: frames nobody wants stop here.
+    int verdict = cec_filter_rx(&ctx->filter, destination_class(ctx, destination), data[0], length - 1);
+    if (verdict == CEC_FILTER_DROP) {
+        return;
+    }
+
+    cec_topology_observe(&ctx->topology, initiator, destination, data, length, ctx->rx_stamp_ns);
+    forget_stale_reports(ctx, initiator, destination, data[0]);
+    if (handle_cec_opcode(ctx, initiator, destination, data[0], data + 1, length - 1) ||
+        verdict == CEC_FILTER_HAL_ONLY) {
+        return;
+    }
+
+    if (atomic_load_explicit(&ctx->standby, memory_order_relaxed)) {
+        if (!is_wake_event(ctx, data[0], data + 1, length - 1)) {
+            cec_counter_add(&ctx->standby_dropped, 1);
+            return;
+        }
+        cec_counter_add(&ctx->standby_forwarded, 1);
+    }
+
+    if (!cec_coalesce_rx(&ctx->rx_coalesce, initiator, destination, data, length, ctx->rx_stamp_ns)) {
+        return;
+    }
+
     hdmi_event_t event;
     event.type = HDMI_EVENT_CEC_MESSAGE;
-    event.dev = dev;
+    event.dev = &ctx->device;
     event.cec.initiator = initiator;
     event.cec.destination = destination;
     event.cec.length = length;
     memcpy(&event.cec.body, data, length);
 
-    ALOGV("hdmi-cec received initiator=%d destination=%d length=%ld msg=%02x %02x %02x",
-          event.cec.initiator, event.cec.destination, event.cec.length,
-          event.cec.body[0], event.cec.body[1], event.cec.body[2]);
+    if (cec_dispatch_push(&ctx->dispatcher, &ctx->dispatcher.rx, &event, ctx->rx_stamp_ns) < 0) {
+        ALOGW("hdmi-cec dropped initiator=%d destination=%d opcode=%02x: dispatch ring full",
+              initiator, destination, data[0]);
+    }
+}
+
+static void dispatch_event(struct cec_dispatch *dispatch, const struct cec_dispatch_item *item) {
+    struct sunxi_cec_device *ctx = dispatch->arg;
+    const hdmi_event_t *event = &item->event;
 
-    if (length >= 1 && handle_cec_opcode(dev, initiator, destination, data[0], data + 1, length - 1)) {
+    // The odd sequence tells registration that the pair loaded below may
+    // be in use; it is reused only once the sequence has moved on.
+    atomic_fetch_add(&ctx->callback_seq, 1);
+    const struct sunxi_cec_callback *callback = atomic_load(&ctx->callback);
+    if (!callback || !callback->func) {
+        atomic_fetch_add_explicit(&ctx->callback_seq, 1, memory_order_release);
         return;
     }
 
-    if (callback_func) {
-        callback_func(&event, callback_arg);
+    uint64_t entry = cec_now_ns();
+    if (event->type == HDMI_EVENT_CEC_MESSAGE) {
+        cec_stats_stage(&ctx->stats, CEC_STAGE_RX_READ_TO_CALLBACK, item->stamp_ns, entry);
+        cec_hist_record(&ctx->stats.rx_opcode[event->cec.length ? event->cec.body[0] : CEC_HIST_POLL],
+                        entry - item->stamp_ns);
+    }
+
+    callback->func(event, callback->arg);
+    atomic_fetch_add_explicit(&ctx->callback_seq, 1, memory_order_release);
+    cec_stats_stage(&ctx->stats, CEC_STAGE_RX_CALLBACK, entry, cec_now_ns());
+}
+
+// Moves retired pairs the dispatcher can no longer hold to the free list:
+// it was outside a callback when they were replaced, or has left that
+// callback since. Called with control_lock held.
+static void reclaim_callbacks(struct sunxi_cec_device *ctx) {
+    unsigned int seq = atomic_load_explicit(&ctx->callback_seq, memory_order_acquire);
+    struct sunxi_cec_callback **link = &ctx->retired_callbacks;
+    while (*link) {
+        struct sunxi_cec_callback *callback = *link;
+        if ((callback->retired_seq & 1) && callback->retired_seq == seq) {
+            link = &callback->next;
+            continue;
+        }
+        *link = callback->next;
+        callback->next = ctx->free_callbacks;
+        ctx->free_callbacks = callback;
     }
 }
 
 static void register_event_callback(const struct hdmi_cec_device *dev,
                                     event_callback_t callback, void *arg) {
-    callback_func = callback;
-    callback_arg = arg;
+    struct sunxi_cec_device *ctx = to_sunxi(dev);
+
+    pthread_mutex_lock(&ctx->control_lock);
+    reclaim_callbacks(ctx);
+    struct sunxi_cec_callback *next = ctx->free_callbacks;
+    if (next) {
+        ctx->free_callbacks = next->next;
+    } else if ((next = calloc(1, sizeof(*next))) == NULL) {
+        pthread_mutex_unlock(&ctx->control_lock);
+        ALOGE("register_event_callback: out of memory");
+        return;
+    }
+    next->func = callback;
+    next->arg = arg;
+    next->next = NULL;
+
+    // Publish the new pair in one store. The old one is retired until the
+    // dispatcher is past any callback that may have loaded it.
+    struct sunxi_cec_callback *old = atomic_exchange(&ctx->callback, next);
+    if (old) {
+        old->retired_seq = atomic_load(&ctx->callback_seq);
+        old->next = ctx->retired_callbacks;
+        ctx->retired_callbacks = old;
+    }
+    pthread_mutex_unlock(&ctx->control_lock);
     ALOGV("register_event_callback: %p", callback);
 }
 
@@ -249,37 +880,53 @@ static void get_version(const struct hdmi_cec_device *dev, int *version) {
 
 static void get_port_info(const struct hdmi_cec_device *dev,
                           struct hdmi_port_info *list[], int *total) {
-    static hdmi_port_info_t info = {
-            .type = HDMI_OUTPUT,
-            .port_id = 0,
-            .cec_supported = 1,
-            .arc_supported = 0,
-            .physical_address = 0,
-    };
+    struct sunxi_cec_device *ctx = to_sunxi(dev);
+
+    // port_info is only written when the cache is republished; this makes
+    // sure it is, once, after a hotplug.
+    uint16_t physical_address;
+    cached_physical_address(ctx, &physical_address);
 
     *total = 1;
-    list[0] = &info;
+    list[0] = &ctx->port_info;
 }
 
 static void set_option(const struct hdmi_cec_device *dev, int flag, int value) {
+    struct sunxi_cec_device *ctx = to_sunxi(dev);
     ALOGV("set_option: flag=%d value=%d", flag, value);
 
     switch (flag) {
         case HDMI_OPTION_WAKEUP:
+            atomic_store_explicit(&ctx->wakeup, !!value, memory_order_relaxed);
             break;
 
         case HDMI_OPTION_ENABLE_CEC:
+            pthread_mutex_lock(&ctx->control_lock);
             if (value) {
-                enable_hdmi_cec();
+                enable_hdmi_cec(ctx);
             } else {
-                disable_hdmi_cec();
+                disable_hdmi_cec(ctx);
             }
+            pthread_mutex_unlock(&ctx->control_lock);
             break;
 
         case HDMI_OPTION_SYSTEM_CEC_CONTROL:
+            responder_write_begin(ctx);
+            ctx->responder.power_status = value ? CEC_POWER_STATUS_ON : CEC_POWER_STATUS_STANDBY;
+            responder_write_end(ctx);
+            pthread_mutex_lock(&ctx->control_lock);
+            atomic_store_explicit(&ctx->standby, !value, memory_order_relaxed);
+            update_driver_filter(ctx);
+            pthread_mutex_unlock(&ctx->control_lock);
+            // the framework asks for the state it missed once awake
+            cec_coalesce_forget(&ctx->rx_coalesce, -1);
+            ALOGI("set_option: %s standby", value ? "leaving" : "entering");
             break;
 
         case HDMI_OPTION_SET_LANG:
+            responder_write_begin(ctx);
+            ctx->responder.language = value & 0xffffff;
+            responder_write_end(ctx);
             break;
     }
 }
@@ -289,43 +936,76 @@ static void set_audio_return_channel(const struct hdmi_cec_device *dev, int port
 }
 
 static int is_connected(const struct hdmi_cec_device *dev, int port_id) {
-    return HDMI_CONNECTED; // or HDMI_NOT_CONNECTED
+    struct sunxi_cec_device *ctx = to_sunxi(dev);
+    // nothing heard yet counts as connected, as before the debouncer
+    int reported = atomic_load_explicit(&ctx->hotplug.reported, memory_order_relaxed);
+    return reported != CEC_HOTPLUG_DISCONNECTED ? HDMI_CONNECTED : HDMI_NOT_CONNECTED;
+}
+
+static void free_device(struct sunxi_cec_device *ctx) {
+    struct sunxi_cec_callback *callback = atomic_load_explicit(&ctx->callback, memory_order_relaxed);
+    free(callback);
+    while ((callback = ctx->retired_callbacks) != NULL) {
+        ctx->retired_callbacks = callback->next;
+        free(callback);
+    }
+    while ((callback = ctx->free_callbacks) != NULL) {
+        ctx->free_callbacks = callback->next;
+        free(callback);
+    }
+    pthread_mutex_destroy(&ctx->control_lock);
+    pthread_cond_destroy(&ctx->ready_cond);
+    pthread_mutex_destroy(&ctx->ready_lock);
+    cec_seqlock_destroy(&ctx->responder_lock);
+    cec_topology_destroy(&ctx->topology);
+    if (ctx->context_locked > 0) {
+        munlock(ctx, sizeof(*ctx));
+    }
+    free(ctx);
 }
 
+/*
+ * Single-shot, like every hw_device_t: the context is freed on return, so
+ * a second close is a use-after-free that no flag in it could catch.
+ * closing only turns away calls that race with this one.
+ */
 static int close_hdmi_cec(struct hw_device_t *device) {
+    struct sunxi_cec_device *ctx = to_sunxi((hdmi_cec_device_t *) device);
     ALOGV("close_hdmi_cec");
 
-    if (sunxi_hdmi_cec < 0) {
-        return -1;
-    }
+    atomic_store_explicit(&ctx->closing, 1, memory_order_relaxed);
 
     ALOGD("closing processing thread...");
-    closed = 1;
-    pthread_join(process_thread_handle, NULL);
-    process_thread_handle = 0;
-    disable_hdmi_cec();
-    close(sunxi_hdmi_cec);
-    sunxi_hdmi_cec = -1;
+    cec_loop_stop(&ctx->process_loop);
+    pthread_join(ctx->process_thread, NULL);
+    cec_tx_stop(&ctx->tx_engine);
+    cec_dispatch_stop(&ctx->dispatcher);
+    cec_hotplug_destroy(&ctx->hotplug);
+    cec_keys_destroy(&ctx->keys);
+    cec_timer_destroy(&ctx->physical_address_timer);
+    cec_timer_destroy(&ctx->read_retry_timer);
+    cec_loop_destroy(&ctx->process_loop);
+    struct sunxi_cec_rx_stats rx_stats;
+    sunxi_cec_get_rx_stats(&ctx->device, &rx_stats);
+    ALOGD("rx: wakeups=%llu reads=%llu events=%llu max_batch=%llu",
+          (unsigned long long) rx_stats.wakeups, (unsigned long long) rx_stats.reads,
+          (unsigned long long) rx_stats.events, (unsigned long long) rx_stats.max_batch);
+    disable_hdmi_cec(ctx);
+    ctx->backend.ops->close(&ctx->backend);
+    cec_capture_close(&ctx->capture);
+    free_device(ctx);
     return 0;
 }
 
-static int poll_data() {
-    fd_set set;
-    struct timeval timeout;
-    FD_ZERO(&set);
-    FD_SET(sunxi_hdmi_cec, &set);
+static void handle_cec_event(struct sunxi_cec_device *ctx, const hdmi_cec_event_t *event) {
+    cec_stats_stage(&ctx->stats, CEC_STAGE_RX_READ_TO_HANDLE, ctx->rx_stamp_ns, cec_now_ns());
+    cec_capture_add(&ctx->capture, CEC_CAPTURE_RX, event->event_type, event->msg,
+                    event->msg_len > 0 ? event->msg_len : 0, 0);
 
-    timeout.tv_sec = 0;
-    timeout.tv_usec = 100000;
-
-    return select(sunxi_hdmi_cec + 1, &set, NULL, NULL, &timeout);
-}
-
-static void handle_cec_event(struct hdmi_cec_device *dev, const hdmi_cec_event_t *event) {
     switch (event->event_type) {
         case MESSAGE_TYPE_RECEIVE_SUCCESS:
             if (event->msg_len >= 1) {
-                cec_event(dev, event->msg[0] >> 4,
+                cec_event(ctx, event->msg[0] >> 4,
                           event->msg[0] & 0x0f,
                           event->msg + 1,
                           event->msg_len - 1);
@@ -333,11 +1013,11 @@ static void handle_cec_event(struct hdmi_cec_device *dev, const hdmi_cec_event_t
             break;
 
         case MESSAGE_TYPE_CONNECTED:
-            hotplug_event(dev, 0, 1);
+            cec_hotplug_signal(&ctx->hotplug, 1, CEC_HOTPLUG_KERNEL);
             break;
 
         case MESSAGE_TYPE_DISCONNECTED:
-            hotplug_event(dev, 0, 0);
+            cec_hotplug_signal(&ctx->hotplug, 0, CEC_HOTPLUG_KERNEL);
             break;
 
         default:
@@ -346,60 +1026,293 @@ static void handle_cec_event(struct hdmi_cec_device *dev, const hdmi_cec_event_t
     }
 }
 
-static void *process_thread(void *dev) {
-    while (!closed) {
-        int ret = poll_data();
-        if (ret == -1) {
-            usleep(500 * 1000);
-            ALOGW("failed to receive data");
-            continue;
-        } else if (ret == 0) {
-            continue;
-        }
+static void read_retry(struct cec_timer *timer) {
+    struct sunxi_cec_device *ctx = timer->arg;
+    if (cec_loop_add(&ctx->process_loop, &ctx->device_source, EPOLLIN) < 0) {
+        cec_timer_arm(&ctx->read_retry_timer, READ_RETRY_DELAY_MS);
+    }
+}
+
+static void refresh_physical_address(struct cec_timer *timer) {
+    uint16_t physical_address;
+    cached_physical_address(timer->arg, &physical_address);
+}
 
-        hdmi_cec_event_t event;
-        ret = read(sunxi_hdmi_cec, &event, sizeof(event));
+static void device_readable(struct cec_loop_source *source, uint32_t events) {
+    struct sunxi_cec_device *ctx = source->arg;
+    struct rx_counters *rx_counters = &ctx->rx_counters;
+    size_t total = 0;
+    int ret;
+
+    cec_counter_add(&rx_counters->wakeups, 1);
+
+    // Drain everything that is pending; the backend returns as many
+    // records as it has per call.
+    for (;;) {
+        ret = ctx->backend.ops->read_events(&ctx->backend, ctx->rx_batch, RX_BATCH_SIZE);
+        cec_counter_add(&rx_counters->reads, 1);
         if (ret <= 0) {
-            ALOGW("invalid data receeived: ret=%d msg_len=%d", ret, event.msg_len);
-            continue;
+            break;
         }
+        ctx->rx_stamp_ns = cec_now_ns();
 
-        handle_cec_event(dev, &event);
+        for (int i = 0; i < ret; i++) {
+            handle_cec_event(ctx, &ctx->rx_batch[i]);
+        }
+        total += ret;
+
+        if (ret < RX_BATCH_SIZE) {
+            break;
+        }
     }
-    return NULL;
-}
 
-static int open_hdmi_cec(const struct hw_module_t *module, char const *name,
-                         struct hw_device_t **device) {
-    ALOGV("open_hdmi_cec");
+    if (total > 0) {
+        cec_counter_add(&rx_counters->events, total);
+        cec_counter_add(&rx_counters->batches[total < RX_BATCH_SIZE ? total : RX_BATCH_SIZE], 1);
+        if (total > cec_counter_get(&rx_counters->max_batch)) {
+            atomic_store_explicit(&rx_counters->max_batch, total, memory_order_relaxed);
+        }
+        return;
+    }
 
-    int ret;
-    hdmi_cec_device_t *dev = (hdmi_cec_device_t *) malloc(sizeof(hdmi_cec_device_t));
+    if (ret == 0) {
+        cec_counter_add(&rx_counters->spurious, 1);
+        return;
+    }
 
-    if (dev == NULL) {
-        ALOGE("failed to allocate");
-        return -1;
+    // Stop watching the device until it recovers, otherwise a persistent
+    // error (e.g. ENODEV) would turn the level-triggered loop into a busy loop.
+    ALOGW("failed to receive data: ret=%d", ret);
+    cec_loop_remove(&ctx->process_loop, source);
+    cec_timer_arm(&ctx->read_retry_timer, READ_RETRY_DELAY_MS);
+}
+
+int sunxi_cec_set_backend(const char *name) {
+    const struct cec_backend_ops *ops = cec_backend_find(name);
+    if (!ops) {
+        return -ENOENT;
     }
+    backend_ops = ops;
+    backend_arg = NULL;
+    return 0;
+}
 
-    sunxi_hdmi_cec = open(CEC_SUNXI_PATH, O_RDWR);
-    if (sunxi_hdmi_cec < 0) {
-        ALOGE("unable to open device: %d", errno);
-        free(dev);
-        return -1;
+void sunxi_cec_set_backend_ops(const struct cec_backend_ops *ops, void *arg) {
+    backend_ops = ops;
+    backend_arg = arg;
+}
+
+struct cec_backend *sunxi_cec_get_backend(const struct hdmi_cec_device *dev) {
+    return &to_sunxi(dev)->backend;
+}
+
+void sunxi_cec_get_dispatch_stats(const struct hdmi_cec_device *dev, struct sunxi_cec_dispatch_stats *stats) {
+    cec_dispatch_get_stats(&to_sunxi(dev)->dispatcher, stats);
+}
+
+void sunxi_cec_dump(const struct hdmi_cec_device *dev, int fd) {
+    struct sunxi_cec_device *ctx = to_sunxi(dev);
+    struct sunxi_cec_rx_stats rx_stats;
+    sunxi_cec_get_rx_stats(dev, &rx_stats);
+    struct sunxi_cec_dispatch_stats dispatch;
+    cec_dispatch_get_stats(&ctx->dispatcher, &dispatch);
+
+    dprintf(fd, "sunxi hdmi cec: backend=%s enabled=%d connected=%d logical_mask=%04x mask_supported=%d\n",
+            ctx->backend.ops ? ctx->backend.ops->name : "none", ctx->enabled,
+            atomic_load_explicit(&ctx->hotplug.reported, memory_order_relaxed),
+            atomic_load_explicit(&ctx->logical_mask, memory_order_relaxed), ctx->logical_mask_supported);
+    dprintf(fd, "rx: wakeups=%llu reads=%llu events=%llu spurious=%llu max_batch=%llu\n",
+            (unsigned long long) rx_stats.wakeups, (unsigned long long) rx_stats.reads,
+            (unsigned long long) rx_stats.events, (unsigned long long) rx_stats.spurious,
+            (unsigned long long) rx_stats.max_batch);
+    dprintf(fd, "dispatch: callbacks=%llu mean_us=%llu max_us=%llu slow=%llu "
+                "rx_overflows=%llu rx_high_water=%u tx_overflows=%llu tx_high_water=%u\n",
+            (unsigned long long) dispatch.callbacks,
+            (unsigned long long) (dispatch.callbacks ? dispatch.callback_ns_total / dispatch.callbacks / 1000 : 0),
+            (unsigned long long) (dispatch.callback_ns_max / 1000),
+            (unsigned long long) dispatch.slow_callbacks,
+            (unsigned long long) dispatch.rx_overflows, dispatch.rx_high_water,
+            (unsigned long long) dispatch.tx_overflows, dispatch.tx_high_water);
+    unsigned int physical_address = atomic_load_explicit(&ctx->physical_address_cache, memory_order_acquire);
+    dprintf(fd, "physical_address: %04x cached=%d lookups=%u mismatches=%u edid=%s\n",
+            physical_address & 0xffff, !!(physical_address & PHYSICAL_ADDRESS_CACHED),
+            atomic_load_explicit(&ctx->physical_address_lookups, memory_order_relaxed),
+            atomic_load_explicit(&ctx->physical_address_mismatches, memory_order_relaxed), ctx->edid_path);
+    struct cec_tx_retry_stats retry[CEC_TX_PRIORITY_COUNT];
+    cec_tx_get_retry_stats(&ctx->tx_engine, retry);
+    for (int priority = 0; priority < CEC_TX_PRIORITY_COUNT; priority++) {
+        dprintf(fd, "retry %-12s nack=%llu busy=%llu recovered=%llu exhausted=%llu\n",
+                priority_names[priority],
+                (unsigned long long) retry[priority].nack_retries,
+                (unsigned long long) retry[priority].busy_retries,
+                (unsigned long long) retry[priority].recovered,
+                (unsigned long long) retry[priority].exhausted);
+    }
+    struct cec_keys *keys = &ctx->keys;
+    dprintf(fd, "keys: fast_path=%d device=%s presses=%llu repeats=%llu timeouts=%llu write_errors=%llu\n",
+            atomic_load_explicit(&keys->enabled, memory_order_relaxed), keys->path,
+            (unsigned long long) cec_counter_get(&keys->presses),
+            (unsigned long long) cec_counter_get(&keys->repeats),
+            (unsigned long long) cec_counter_get(&keys->timeouts),
+            (unsigned long long) cec_counter_get(&keys->write_errors));
+    dprintf(fd, "standby: active=%d wakeup=%d forwarded=%llu dropped=%llu\n",
+            atomic_load_explicit(&ctx->standby, memory_order_relaxed),
+            atomic_load_explicit(&ctx->wakeup, memory_order_relaxed),
+            (unsigned long long) cec_counter_get(&ctx->standby_forwarded),
+            (unsigned long long) cec_counter_get(&ctx->standby_dropped));
+    struct cec_hotplug *hotplug = &ctx->hotplug;
+    dprintf(fd, "hotplug: kernel_signals=%llu cec_signals=%llu reports=%llu flaps=%llu pending=%d\n",
+            (unsigned long long) cec_counter_get(&hotplug->signals[CEC_HOTPLUG_KERNEL]),
+            (unsigned long long) cec_counter_get(&hotplug->signals[CEC_HOTPLUG_CEC]),
+            (unsigned long long) cec_counter_get(&hotplug->reports),
+            (unsigned long long) cec_counter_get(&hotplug->flaps),
+            atomic_load_explicit(&hotplug->pending, memory_order_relaxed));
+    struct cec_tx_coalesce_stats coalesce;
+    cec_tx_get_coalesce_stats(&ctx->tx_engine, &coalesce);
+    dprintf(fd, "coalesce: merged=%llu superseded=%llu suppressed=%llu\n",
+            (unsigned long long) coalesce.merged, (unsigned long long) coalesce.superseded,
+            (unsigned long long) coalesce.suppressed);
+    struct sunxi_cec_startup_stats *startup = &ctx->startup;
+    dprintf(fd, "startup (us): open=%llu ready=%llu backend_open=%llu loop_init=%llu threads=%llu "
+                "start=%llu (%d) physical_address=%llu (%d)\n",
+            (unsigned long long) (startup->open_ns / 1000), (unsigned long long) (startup->ready_ns / 1000),
+            (unsigned long long) (startup->backend_open_ns / 1000),
+            (unsigned long long) (startup->loop_init_ns / 1000),
+            (unsigned long long) (startup->threads_ns / 1000),
+            (unsigned long long) (startup->start_ns / 1000), startup->start_result,
+            (unsigned long long) (startup->physical_address_ns / 1000), startup->physical_address_result);
+    char io[64], tx[64], dispatcher[64];
+    cec_sched_describe(&ctx->io_sched, io, sizeof(io));
+    cec_sched_describe(&ctx->tx_sched, tx, sizeof(tx));
+    cec_sched_describe(&ctx->dispatch_sched, dispatcher, sizeof(dispatcher));
+    dprintf(fd, "threads: %s, %s, %s, context_mlock=%d\n", io, tx, dispatcher, ctx->context_locked);
+    dprintf(fd, "driver filter: supported=%d\n", ctx->rx_filter_supported);
+    if (ctx->capture.header) {
+        dprintf(fd, "capture: enabled=%d records=%llu capacity=%u\n",
+                atomic_load_explicit(&ctx->capture.enabled, memory_order_relaxed),
+                (unsigned long long) atomic_load_explicit(&ctx->capture.header->next, memory_order_relaxed),
+                ctx->capture.header->capacity);
     }
+    cec_filter_dump(&ctx->filter, fd);
+    cec_coalesce_dump(&ctx->rx_coalesce, fd,
+                      dispatch.callbacks ? dispatch.callback_ns_total / dispatch.callbacks : 0);
+    cec_topology_dump(&ctx->topology, fd);
+    cec_stats_dump(&ctx->stats, fd);
+    cec_trace_dump(&ctx->trace, fd, CEC_TRACE_SIZE);
+}
 
-    ret = pthread_create(&process_thread_handle, NULL, process_thread, dev);
+static int start_capture(struct sunxi_cec_device *ctx, const char *path, unsigned int records) {
+    if (ctx->capture.header) {
+        return -EBUSY;
+    }
+    int ret = cec_capture_open(&ctx->capture, path, records ? records : CEC_CAPTURE_DEFAULT_RECORDS);
     if (ret < 0) {
-        ALOGE("unable to start thread: %d", ret);
-        free(dev);
-        close(sunxi_hdmi_cec);
-        sunxi_hdmi_cec = 0;
-        return -1;
+        ALOGW("start_capture: %s: %d", path, ret);
+    } else {
+        ALOGI("start_capture: %s, %u records", path, ctx->capture.header->capacity);
     }
+    return ret;
+}
+
+int sunxi_cec_start_capture(const struct hdmi_cec_device *dev, const char *path, unsigned int records) {
+    struct sunxi_cec_device *ctx = to_sunxi(dev);
+    pthread_mutex_lock(&ctx->control_lock);
+    int ret = start_capture(ctx, path, records);
+    pthread_mutex_unlock(&ctx->control_lock);
+    return ret;
+}
+
+void sunxi_cec_stop_capture(const struct hdmi_cec_device *dev) {
+    atomic_store_explicit(&to_sunxi(dev)->capture.enabled, 0, memory_order_relaxed);
+}
+
+int sunxi_cec_set_filter(const struct hdmi_cec_device *dev, int direction, int destination,
+                         int opcode, int allow) {
+    struct sunxi_cec_device *ctx = to_sunxi(dev);
+    int ret = cec_filter_set(&ctx->filter, direction, destination, opcode, allow);
+    if (ret == 0 && direction == SUNXI_CEC_FILTER_RX) {
+        pthread_mutex_lock(&ctx->control_lock);
+        update_driver_filter(ctx);
+        pthread_mutex_unlock(&ctx->control_lock);
+    }
+    return ret;
+}
 
-    closed = 0;
+int sunxi_cec_get_topology(const struct hdmi_cec_device *dev, int address,
+                           struct sunxi_cec_topology_entry *entry) {
+    return cec_topology_get(&to_sunxi(dev)->topology, address, entry);
+}
+
+void sunxi_cec_get_startup_stats(const struct hdmi_cec_device *dev, struct sunxi_cec_startup_stats *stats) {
+    *stats = to_sunxi(dev)->startup;
+}
+
+int sunxi_cec_wait_ready(const struct hdmi_cec_device *dev, int timeout_ms) {
+    return wait_ready(to_sunxi(dev), timeout_ms);
+}
+
+void sunxi_cec_set_key_fast_path(const struct hdmi_cec_device *dev, int enabled) {
+    cec_keys_set_enabled(&to_sunxi(dev)->keys, enabled);
+}
+
+void sunxi_cec_set_log_level(int level) {
+    cec_log_level = level;
+}
+
+void sunxi_cec_get_rx_stats(const struct hdmi_cec_device *dev, struct sunxi_cec_rx_stats *stats) {
+    struct sunxi_cec_device *ctx = to_sunxi(dev);
+    struct rx_counters *rx_counters = &ctx->rx_counters;
+    stats->wakeups = cec_counter_get(&rx_counters->wakeups);
+    stats->reads = cec_counter_get(&rx_counters->reads);
+    stats->events = cec_counter_get(&rx_counters->events);
+    stats->spurious = cec_counter_get(&rx_counters->spurious);
+    stats->max_batch = cec_counter_get(&rx_counters->max_batch);
+    for (int i = 0; i <= RX_BATCH_SIZE; i++) {
+        stats->batches[i] = cec_counter_get(&rx_counters->batches[i]);
+    }
+    stats->duplicates = cec_counter_get(&ctx->rx_coalesce.duplicates);
+    stats->key_repeats = cec_counter_get(&ctx->rx_coalesce.key_repeats);
+}
+
+// ro.hdmi.cec.retry.<class> = "<nack retries>,<busy retries>"
+static void load_retry_policy(struct sunxi_cec_device *ctx) {
+    for (int priority = 0; priority < CEC_TX_PRIORITY_COUNT; priority++) {
+        char key[PROP_NAME_MAX];
+        char value[PROP_VALUE_MAX];
+        snprintf(key, sizeof(key), "ro.hdmi.cec.retry.%s", priority_names[priority]);
+        if (!cec_config_get(key, value, "")) {
+            continue;
+        }
+
+        struct cec_tx_retry_policy policy;
+        if (sscanf(value, "%d,%d", &policy.nack_retries, &policy.busy_retries) != 2 ||
+            policy.nack_retries < 0 || policy.busy_retries < 0) {
+            ALOGW("load_retry_policy: invalid %s: %s", key, value);
+            continue;
+        }
+        cec_tx_set_retry(&ctx->tx_engine, priority, &policy);
+    }
+}
 
-    memset(dev, 0, sizeof(*dev));
+static void *process_thread(void *arg) {
+    struct sunxi_cec_device *ctx = arg;
+
+    cec_sched_apply(&ctx->io_sched);
+
+    // Warm the address cache while the opening thread starts the device;
+    // events arriving meanwhile wait in the level-triggered loop.
+    uint64_t start = cec_now_ns();
+    uint16_t physical_address;
+    ctx->startup.physical_address_result = cached_physical_address(ctx, &physical_address);
+    ctx->startup.physical_address_ns = cec_now_ns() - start;
+    startup_phase_done(ctx);
+
+    cec_loop_run(&ctx->process_loop);
+    return NULL;
+}
+
+static void init_device(struct sunxi_cec_device *ctx, const struct hw_module_t *module) {
+    hdmi_cec_device_t *dev = &ctx->device;
 
     dev->common.tag = HARDWARE_DEVICE_TAG;
     dev->common.version = 0;
@@ -417,10 +1330,166 @@ static int open_hdmi_cec(const struct hw_module_t *module, char const *name,
     dev->set_audio_return_channel = set_audio_return_channel;
     dev->is_connected = is_connected;
 
-    *device = (struct hw_device_t *) dev;
+    pthread_mutex_init(&ctx->control_lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&ctx->ready_lock, NULL);
+    pthread_cond_init(&ctx->ready_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    ctx->logical_mask_supported = 1;
+    ctx->rx_filter_supported = 1;
+    cec_filter_init(&ctx->filter);
+    // the framework hands control over explicitly; until then it is awake
+    atomic_store_explicit(&ctx->wakeup, 1, memory_order_relaxed);
+    cec_responder_init(&ctx->responder, CEC_VENDOR_PULSE_EIGHT, CEC_VERSION_1_4);
+    cec_stats_reset(&ctx->stats);
+    cec_trace_reset(&ctx->trace);
+    cec_seqlock_init(&ctx->responder_lock);
+    cec_topology_init(&ctx->topology);
+    cec_coalesce_init(&ctx->rx_coalesce);
+    cec_sched_load(&ctx->io_sched, "io");
+    cec_sched_load(&ctx->tx_sched, "tx");
+    cec_sched_load(&ctx->dispatch_sched, "dispatch");
+    cec_config_get("ro.hdmi.cec.edid_path", ctx->edid_path, CEC_EDID_DEFAULT_PATH);
+    ctx->responder.physical_address = PHYSICAL_ADDRESS_INVALID;
+
+    ctx->port_info.type = HDMI_OUTPUT;
+    ctx->port_info.port_id = 0;
+    ctx->port_info.cec_supported = 1;
+    ctx->port_info.arc_supported = 0;
+    ctx->port_info.physical_address = PHYSICAL_ADDRESS_INVALID;
+}
+
+static int open_hdmi_cec(const struct hw_module_t *module, char const *name,
+                         struct hw_device_t **device) {
+    ALOGV("open_hdmi_cec");
+
+    int ret;
+    uint64_t open_start = cec_now_ns();
+    uint64_t phase = open_start;
+    // Fully set up before any thread can see it.
+    struct sunxi_cec_device *ctx = calloc(1, sizeof(*ctx));
+    if (ctx == NULL) {
+        ALOGE("failed to allocate");
+        return -1;
+    }
+    init_device(ctx, module);
+    ctx->open_start_ns = open_start;
+    cec_log_level = cec_config_get_int("persist.sys.hdmi.cec.log_level", ANDROID_LOG_INFO);
+
+    // The rings, queues and batch buffers all live in the context, so
+    // locking it keeps the hot paths free of page faults.
+    if (ctx->io_sched.lock_stack) {
+        ctx->context_locked = mlock(ctx, sizeof(*ctx)) < 0 ? -errno : 1;
+        if (ctx->context_locked < 0) {
+            ALOGW("unable to lock device context: %s", strerror(errno));
+        }
+    }
+
+    ctx->backend.ops = backend_ops;
+    ctx->backend.arg = backend_arg;
+    ctx->fd = ctx->backend.ops->open(&ctx->backend);
+    if (ctx->fd < 0) {
+        ALOGE("unable to open %s backend: %d", ctx->backend.ops->name, ctx->fd);
+        goto err_free;
+    }
+    update_driver_filter(ctx);
+    char capture_path[PROP_VALUE_MAX];
+    if (cec_config_get("persist.sys.hdmi.cec.capture_path", capture_path, "")) {
+        start_capture(ctx, capture_path, cec_config_get_int("ro.hdmi.cec.capture_records", 0));
+    }
+    ctx->startup.backend_open_ns = cec_now_ns() - phase;
+    phase = cec_now_ns();
+
+    ctx->device_source.fd = ctx->fd;
+    ctx->device_source.handler = device_readable;
+    ctx->device_source.arg = ctx;
+
+    if (cec_loop_init(&ctx->process_loop) < 0) {
+        ALOGE("unable to set up event loop");
+        goto err_backend;
+    }
+    if (cec_loop_add(&ctx->process_loop, &ctx->device_source, EPOLLIN) < 0 ||
+        cec_timer_init(&ctx->read_retry_timer, &ctx->process_loop, read_retry, ctx) < 0) {
+        ALOGE("unable to watch the device");
+        goto err_loop;
+    }
+    if (cec_timer_init(&ctx->physical_address_timer, &ctx->process_loop, refresh_physical_address, ctx) < 0) {
+        ALOGE("unable to set up address timer");
+        goto err_read_retry;
+    }
+    if (cec_keys_init(&ctx->keys, &ctx->process_loop) < 0) {
+        ALOGE("unable to set up key timers");
+        goto err_address_timer;
+    }
+    if (cec_hotplug_init(&ctx->hotplug, &ctx->process_loop, hotplug_event, ctx) < 0) {
+        ALOGE("unable to set up hotplug debouncer");
+        goto err_keys;
+    }
+
+    ctx->startup.loop_init_ns = cec_now_ns() - phase;
+    phase = cec_now_ns();
+
+    // The START ioctl on this thread overlaps the physical address lookup
+    // on the processing thread.
+    int start_on_open = cec_config_get_int("ro.hdmi.cec.start_on_open", 1);
+    atomic_store_explicit(&ctx->startup_pending, start_on_open ? 2 : 1, memory_order_relaxed);
+
+    if (cec_dispatch_start(&ctx->dispatcher, dispatch_event, ctx, &ctx->dispatch_sched) < 0) {
+        ALOGE("unable to start dispatcher");
+        goto err_hotplug;
+    }
+    if (cec_tx_start(&ctx->tx_engine, transmit_frame, tx_status_event, ctx, &ctx->tx_sched) < 0) {
+        ALOGE("unable to start transmit engine");
+        goto err_dispatch;
+    }
+    load_retry_policy(ctx);
+    cec_tx_set_dedup_window(&ctx->tx_engine, cec_config_get_int("ro.hdmi.cec.tx_dedup_ms", CEC_TX_DEDUP_WINDOW_MS));
+
+    ret = pthread_create(&ctx->process_thread, NULL, process_thread, ctx);
+    if (ret != 0) {
+        ALOGE("unable to start thread: %d", ret);
+        goto err_tx;
+    }
+    ctx->startup.threads_ns = cec_now_ns() - phase;
+
+    if (start_on_open) {
+        phase = cec_now_ns();
+        pthread_mutex_lock(&ctx->control_lock);
+        ctx->startup.start_result = enable_hdmi_cec(ctx);
+        pthread_mutex_unlock(&ctx->control_lock);
+        ctx->startup.start_ns = cec_now_ns() - phase;
+        startup_phase_done(ctx);
+    }
+    ctx->startup.open_ns = cec_now_ns() - open_start;
+
+    *device = (struct hw_device_t *) &ctx->device;
 
     ALOGV("open_hdmi_cec: success");
     return 0;
+
+    // Undone in reverse order of setup.
+err_tx:
+    cec_tx_stop(&ctx->tx_engine);
+err_dispatch:
+    cec_dispatch_stop(&ctx->dispatcher);
+err_hotplug:
+    cec_hotplug_destroy(&ctx->hotplug);
+err_keys:
+    cec_keys_destroy(&ctx->keys);
+err_address_timer:
+    cec_timer_destroy(&ctx->physical_address_timer);
+err_read_retry:
+    cec_timer_destroy(&ctx->read_retry_timer);
+err_loop:
+    cec_loop_destroy(&ctx->process_loop);
+err_backend:
+    cec_capture_close(&ctx->capture);
+    ctx->backend.ops->close(&ctx->backend);
+err_free:
+    free_device(ctx);
+    return -1;
 }
 
 static struct hw_module_methods_t hdmi_cec_module_methods = {
@@ -436,4 +1505,3 @@ struct hw_module_t HAL_MODULE_INFO_SYM = {
         .author = "Kamil Trzcinski <ayufan@ayufan.eu>",
         .methods = &hdmi_cec_module_methods,
 };
-
@@ -0,0 +1,226 @@
+#ifndef SUNXI_HDMI_CEC_H
+#define SUNXI_HDMI_CEC_H
+
+#include <hardware/hdmi_cec.h>
+
+#include <string.h>
+
+/*
+ * Extensions exported by the sunxi HDMI-CEC HAL on top of hdmi_cec_device_t.
+ * Look them up with dlsym() on the loaded HAL module.
+ */
+
+__BEGIN_DECLS
+
+/*
+ * Completion of a frame queued with sunxi_cec_submit(), delivered to the
+ * registered callback with this event type. The upstream hdmi_event_t has
+ * no member for it, so the tx_status_event_t payload is stored in the
+ * event union; read it with sunxi_cec_tx_status(). The type is outside the
+ * upstream HDMI_EVENT_* range, so callbacks that only know those ignore it.
+ */
+#define SUNXI_CEC_EVENT_TX_STATUS 0x100
+
+static inline tx_status_event_t sunxi_cec_tx_status(const hdmi_event_t *event) {
+    tx_status_event_t status;
+    memcpy(&status, &event->cec, sizeof(status));
+    return status;
+}
+
+static inline void sunxi_cec_set_tx_status(hdmi_event_t *event, int status, int opcode) {
+    tx_status_event_t payload = {.status = status, .opcode = opcode};
+    event->type = SUNXI_CEC_EVENT_TX_STATUS;
+    memcpy(&event->cec, &payload, sizeof(payload));
+}
+
+/* Transmit priority classes, highest first. */
+enum cec_tx_priority {
+    CEC_TX_PRIORITY_USER_CONTROL = 0,   /* key press feedback */
+    CEC_TX_PRIORITY_NORMAL = 1,         /* commands and replies */
+    CEC_TX_PRIORITY_STATUS = 2,         /* status reports */
+    CEC_TX_PRIORITY_POLL = 3,           /* polling messages */
+    CEC_TX_PRIORITY_COUNT
+};
+
+/*
+ * Queues a message without waiting for the bus. priority is one of
+ * CEC_TX_PRIORITY_* (or -1 to derive it from the opcode). Completion is
+ * reported to the registered callback as SUNXI_CEC_EVENT_TX_STATUS.
+ *
+ * Returns 0 on success, -EAGAIN if the queue is full or -errno on error.
+ */
+int sunxi_cec_submit(const struct hdmi_cec_device *dev, const cec_message_t *msg, int priority);
+
+/*
+ * Allocates a logical address for device_type (CEC_DEVICE_*) without a
+ * framework round-trip per candidate: the candidates are polled back to
+ * back, starting with the address this type got last time, and the first
+ * one nobody acknowledges is claimed as by add_logical_address().
+ *
+ * Returns the claimed address, CEC_ADDR_UNREGISTERED if every candidate
+ * is taken, -EIO if no poll got through, or -EINVAL / -ENODEV.
+ */
+int sunxi_cec_allocate_logical_address(const struct hdmi_cec_device *dev, int device_type);
+
+/*
+ * Time spent in each phase of open, in nanoseconds. The START ioctl runs
+ * on the opening thread while the processing thread looks up the
+ * physical address; phases that have not finished yet read as 0.
+ */
+struct sunxi_cec_startup_stats {
+    uint64_t backend_open_ns;       /* opening the transport */
+    uint64_t loop_init_ns;          /* event loop, timers, keys and hotplug */
+    uint64_t threads_ns;            /* dispatcher, TX and processing threads */
+    uint64_t start_ns;              /* START ioctl, unless ro.hdmi.cec.start_on_open=0 */
+    uint64_t physical_address_ns;   /* EDID and driver lookup */
+    uint64_t open_ns;               /* open() entry to return */
+    uint64_t ready_ns;              /* open() entry to ready */
+    int start_result;
+    int physical_address_result;
+};
+
+void sunxi_cec_get_startup_stats(const struct hdmi_cec_device *dev, struct sunxi_cec_startup_stats *stats);
+
+/*
+ * Waits until the device is started and its physical address is cached.
+ * open() returns before that; get_physical_address() waits for it too.
+ * Returns 0 or -ETIMEDOUT.
+ */
+int sunxi_cec_wait_ready(const struct hdmi_cec_device *dev, int timeout_ms);
+
+#define SUNXI_CEC_RX_BATCH_MAX 16
+
+/*
+ * Receive path counters. events / wakeups is the average number of
+ * records handled per wakeup of the processing thread.
+ */
+struct sunxi_cec_rx_stats {
+    uint64_t wakeups;       /* device readable notifications */
+    uint64_t reads;         /* read syscalls issued */
+    uint64_t events;        /* records dispatched */
+    uint64_t spurious;      /* wakeups that found nothing to read */
+    uint64_t max_batch;     /* most records handled in one wakeup */
+    /* batches[n]: wakeups that handled n records (the last bucket is n or more) */
+    uint64_t batches[SUNXI_CEC_RX_BATCH_MAX + 1];
+    uint64_t duplicates;    /* unchanged reports not delivered again */
+    uint64_t key_repeats;   /* auto-repeat presses merged into a held key */
+};
+
+/* Returns a snapshot of the receive path counters. */
+void sunxi_cec_get_rx_stats(const struct hdmi_cec_device *dev, struct sunxi_cec_rx_stats *stats);
+
+/* Callback dispatch counters. */
+struct sunxi_cec_dispatch_stats {
+    uint64_t rx_overflows;      /* received events dropped on a full ring */
+    uint64_t tx_overflows;      /* TX status events dropped on a full ring */
+    unsigned int rx_high_water; /* most events ever waiting */
+    unsigned int tx_high_water;
+    uint64_t callbacks;
+    uint64_t callback_ns_total;
+    uint64_t callback_ns_max;
+    uint64_t slow_callbacks;    /* callbacks that took over 10 ms */
+};
+
+void sunxi_cec_get_dispatch_stats(const struct hdmi_cec_device *dev, struct sunxi_cec_dispatch_stats *stats);
+
+/*
+ * Writes counters, latency histograms (RX and TX stages, per opcode and
+ * per result) and the frame trace to fd as text. Safe to call at any time
+ * while the device is open.
+ */
+void sunxi_cec_dump(const struct hdmi_cec_device *dev, int fd);
+
+/*
+ * Turns the remote control fast path on or off at runtime. When on, UI
+ * commands with a key mapping go to a uinput device with HAL-side repeat
+ * and release timeout, and are not forwarded to the framework; everything
+ * else still is. Defaults to persist.sys.hdmi.cec.key_fast_path at open.
+ */
+void sunxi_cec_set_key_fast_path(const struct hdmi_cec_device *dev, int enabled);
+
+/*
+ * Sets the minimum android_LogPriority that is formatted and logged.
+ * ANDROID_LOG_VERBOSE enables per-frame messages; the default is
+ * ANDROID_LOG_INFO or persist.sys.hdmi.cec.log_level at open.
+ */
+void sunxi_cec_set_log_level(int level);
+
+#define SUNXI_CEC_TOPOLOGY_UNKNOWN_ADDRESS 0xffff
+#define SUNXI_CEC_TOPOLOGY_UNKNOWN_VENDOR 0xffffffff
+
+/*
+ * A device on the bus as last seen in its own frames. Fields that were
+ * never reported are -1, or the UNKNOWN values above.
+ */
+struct sunxi_cec_topology_entry {
+    uint64_t last_seen_ns;      /* CLOCK_MONOTONIC of its last frame or ack */
+    uint32_t vendor_id;
+    uint16_t physical_address;
+    int8_t device_type;         /* CEC_DEVICE_* */
+    int8_t power_status;
+    int8_t cec_version;
+    int8_t active_source;       /* 1 if it was the last to claim active source */
+    char osd_name[15];          /* NUL-terminated, empty if unknown */
+};
+
+/*
+ * Looks up a logical address in the topology learned from bus traffic,
+ * without sending anything. The table is cleared on disconnect.
+ *
+ * Returns 0, -ENOENT if nothing was heard from address or -EINVAL.
+ */
+int sunxi_cec_get_topology(const struct hdmi_cec_device *dev, int address,
+                           struct sunxi_cec_topology_entry *entry);
+
+enum sunxi_cec_filter_direction {
+    SUNXI_CEC_FILTER_RX = 0,        /* received frames delivered to the callback */
+    SUNXI_CEC_FILTER_TX = 1,        /* SUNXI_CEC_EVENT_TX_STATUS of submitted frames */
+};
+
+enum sunxi_cec_filter_destination {
+    SUNXI_CEC_FILTER_DIRECTED = 0,  /* to (or from) one of our logical addresses */
+    SUNXI_CEC_FILTER_BROADCAST = 1,
+    SUNXI_CEC_FILTER_OTHER = 2,     /* received frames directed to other devices */
+};
+
+/*
+ * Allows or denies delivery of opcode (-1 for all) to the framework.
+ * Denied frames are still traced, counted and handled inside the HAL
+ * where it acts on them; opcodes nothing needs are also dropped in the
+ * driver when it supports filtering. Malformed frames are never delivered.
+ *
+ * Returns 0 or -EINVAL.
+ */
+int sunxi_cec_set_filter(const struct hdmi_cec_device *dev, int direction, int destination,
+                         int opcode, int allow);
+
+/*
+ * Records every driver record read and every frame transmitted, with
+ * timestamps, into a ring of records entries (0 for the default) mapped
+ * from path; host/cec_replay.c plays it back. Also started at open from
+ * persist.sys.hdmi.cec.capture_path and ro.hdmi.cec.capture_records.
+ * One capture file per open: returns 0, -EBUSY or -errno.
+ */
+int sunxi_cec_start_capture(const struct hdmi_cec_device *dev, const char *path, unsigned int records);
+
+/* Stops appending; the file stays valid and is unmapped at close. */
+void sunxi_cec_stop_capture(const struct hdmi_cec_device *dev);
+
+struct cec_backend;
+struct cec_backend_ops;
+
+/*
+ * Selects the transport used by the next open ("sunxi" or "loopback").
+ * Returns 0 or -ENOENT for an unknown backend.
+ */
+int sunxi_cec_set_backend(const char *name);
+
+/* Selects a transport provided by the caller; arg is passed to its open(). */
+void sunxi_cec_set_backend_ops(const struct cec_backend_ops *ops, void *arg);
+
+/* Returns the transport of an open device, e.g. to script the loopback. */
+struct cec_backend *sunxi_cec_get_backend(const struct hdmi_cec_device *dev);
+
+__END_DECLS
+
+#endif